@@ -0,0 +1,311 @@
+# Flash/RAM/stack footprint of the feather32u4 build, checked against footprint_budget.ini
+#
+# As a PlatformIO extra script it checks the budget after every link and fails the build when it is exceeded.
+#   pio run -e feather32u4 -t footprint            full report: per library, per symbol, stack call paths
+#   pio run -e feather32u4 -t footprint_baseline   record the per-symbol sizes the report compares against
+# Standalone (toolchain in PATH): python footprint.py firmware.elf [firmware.map] [--baseline FILE] [--update-baseline]
+#
+# Stack: worst case over the static call graph taken from the disassembly - frame of each function from its prologue
+# (pushes, rcall .+0 and the SP adjustment) plus 2 bytes return address per call, tail jumps at the same depth. The
+# main path (main -> setup/loop) and the deepest interrupt vector add up, interrupts do not nest. Indirect calls
+# (icall) and recursion cannot be bounded and are listed, the stack_margin of the budget has to cover them and the heap.
+import configparser
+import os
+import re
+import subprocess
+import sys
+
+RETURN_ADDRESS = 2  # 16 bit program counter below 128 KB flash
+FLASH_SECTIONS = ('.text', '.data', '.progmem', '.rodata')
+RAM_SECTIONS = ('.data', '.bss', '.noinit')
+
+
+def run(tool, args, env=None):
+    return subprocess.run([tool] + args, check=True, stdout=subprocess.PIPE, universal_newlines=True, env=env).stdout
+
+
+def section_sizes(size_tool, elf, env=None):
+    # avr-size -A: "<section> <size> <address>"
+    sizes = {}
+    for line in run(size_tool, ['-A', elf], env).splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[0].startswith('.') and parts[1].isdigit():
+            sizes[parts[0]] = int(parts[1])
+    return sizes
+
+
+def symbols(nm_tool, elf, env=None):
+    # (name, size, kind) - kind flash for code and constants, ram for .bss, both for .data (initial values in flash)
+    result = []
+    for line in run(nm_tool, ['-S', '-C', '--size-sort', '-t', 'd', elf], env).splitlines():
+        m = re.match(r'\d+ (\d+) (\w) (.+)$', line)
+        if not m:
+            continue
+        size, letter, name = int(m.group(1)), m.group(2).lower(), m.group(3)
+        kind = {'t': 'flash', 'r': 'flash', 'd': 'data', 'b': 'bss'}.get(letter)
+        if kind:
+            result.append((name, size, kind))
+    return result
+
+
+def library_of(path):
+    # map file input name -> library: libSlimLoRa.a(SlimLoRa.cpp.o) -> SlimLoRa, src/main.cpp.o -> src
+    m = re.search(r'lib([^/\\]+)\.a\(', path)
+    if m:
+        return m.group(1)
+    if re.search(r'[/\\]src[/\\]', path):
+        return 'src'
+    return os.path.basename(path.split('(')[0]) or path
+
+
+def library_sizes(map_file):
+    # per library flash and RAM from the "Linker script and memory map" part of the GNU ld map file
+    sizes = {}
+    in_map, pending = False, None
+    with open(map_file) as f:
+        for line in f:
+            if line.startswith('Linker script and memory map'):
+                in_map = True
+                continue
+            if not in_map:
+                continue
+            m = re.match(r'^ (\.\S+)\s*$', line)
+            if m:  # long section name, address, size and file on the next line
+                pending = m.group(1)
+                continue
+            m = re.match(r'^ (\.\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$', line)
+            section = (m.group(1) or pending) if m else None
+            pending = None
+            if not m or not section:
+                continue
+            size = int(m.group(3), 16)
+            if size == 0:
+                continue
+            entry = sizes.setdefault(library_of(m.group(4).strip()), {'flash': 0, 'ram': 0})
+            if section.startswith(FLASH_SECTIONS):
+                entry['flash'] += size
+            if section.startswith(RAM_SECTIONS):
+                entry['ram'] += size
+    return sizes
+
+
+def call_graph(objdump_tool, elf, env=None):
+    # frame bytes, direct callees, tail jumps and indirect calls of every function in the disassembly
+    functions = {}
+    current = None
+    for line in run(objdump_tool, ['-d', elf], env).splitlines():
+        m = re.match(r'^[0-9a-f]+ <(.+)>:$', line)
+        if m:
+            current = {'frame': 0, 'calls': set(), 'jumps': set(), 'indirect': False, 'prologue': True, 'pending_sp': False,
+                       'x': 0}
+            functions[m.group(1)] = current
+            continue
+        if current is None or '\t' not in line:
+            continue
+        fields = line.split('\t')
+        if len(fields) < 3:
+            continue
+        op = fields[2].strip()
+        args = fields[3].strip() if len(fields) > 3 else ''
+        target = re.search(r'<([^>+]+)(\+0x[0-9a-f]+)?>', line)
+        if current['prologue']:
+            if op == 'push':
+                current['frame'] += 1
+                continue
+            if op == 'rcall' and args.startswith('.+0'):
+                current['frame'] += RETURN_ADDRESS  # gcc reserves small frames this way
+                continue
+            if op == 'in' and ('0x3d' in args or '0x3e' in args):
+                current['pending_sp'] = True
+                continue
+            if current['pending_sp'] and op in ('sbiw', 'subi') and args.startswith('r28'):
+                current['frame'] += int(re.search(r'0x([0-9a-f]+)', args).group(1), 16)
+                continue
+            if current['pending_sp'] and op == 'sbci' and args.startswith('r29'):
+                current['frame'] += int(re.search(r'0x([0-9a-f]+)', args).group(1), 16) * 256
+                continue
+            if op == 'ldi' and re.match(r'r2[67],', args):  # -mcall-prologues passes the frame size in X
+                value = int(re.search(r'0x([0-9a-f]+)', args).group(1), 16)
+                current['x'] += value * 256 if args.startswith('r27') else value
+                continue
+            if op in ('jmp', 'rjmp', 'call', 'rcall') and target and target.group(1) == '__prologue_saves__':
+                current['frame'] += 18 + current['x']  # at most 18 registers saved
+                continue
+            if op in ('in', 'cli', 'out', 'eor', 'clr', 'ldi', 'mov', 'movw'):  # SREG save, SP write, zero reg
+                continue
+            current['prologue'] = False
+        if op in ('call', 'rcall') and target and not target.group(2):
+            current['calls'].add(target.group(1))
+        elif op in ('jmp', 'rjmp') and target and not target.group(2):
+            current['jumps'].add(target.group(1))  # tail call - jumps to the start of another function
+        elif op in ('icall', 'eicall', 'ijmp', 'eijmp'):
+            current['indirect'] = True
+    for name, f in functions.items():
+        f['jumps'].discard(name)
+    return functions
+
+
+def worst_stack(functions, root, memo, path=()):
+    # (bytes, deepest path, unbounded functions) - frame of root plus its deepest callee or tail jump
+    if root in memo:
+        return memo[root]
+    if root in path:
+        return 0, [root + ' (recursion)'], {root}
+    f = functions.get(root)
+    if f is None:
+        return 0, [root + ' (not found)'], set()
+    best, best_path, unbounded = 0, [], {root} if f['indirect'] else set()
+    for callee in f['calls']:
+        depth, sub, u = worst_stack(functions, callee, memo, path + (root,))
+        unbounded |= u
+        if depth + RETURN_ADDRESS > best:
+            best, best_path = depth + RETURN_ADDRESS, sub
+    for callee in f['jumps']:
+        depth, sub, u = worst_stack(functions, callee, memo, path + (root,))
+        unbounded |= u
+        if depth - f['frame'] > best:  # the frame is released before the jump
+            best, best_path = depth - f['frame'], sub
+    memo[root] = (f['frame'] + best, [root] + best_path, unbounded)
+    return memo[root]
+
+
+def stack_report(functions):
+    memo = {}
+    main_root = 'main' if 'main' in functions else 'loop'
+    main = worst_stack(functions, main_root, memo)
+    vectors = []
+    for name in functions:
+        if re.match(r'__vector_\d+$', name):  # the interrupt pushes the return address
+            depth, path, unbounded = worst_stack(functions, name, memo)
+            vectors.append(((depth + RETURN_ADDRESS, path, unbounded), name))
+    isr = max(vectors) if vectors else ((0, [], set()), None)
+    return main_root, main, isr, vectors
+
+
+def demangle(filt_tool, names, env=None):
+    try:
+        out = subprocess.run([filt_tool], input='\n'.join(names), check=True, stdout=subprocess.PIPE,
+                             universal_newlines=True, env=env).stdout.splitlines()
+        return dict(zip(names, out))
+    except (OSError, subprocess.CalledProcessError):
+        return {name: name for name in names}
+
+
+def read_baseline(path):
+    baseline = {}
+    if os.path.exists(path):
+        with open(path) as f:
+            for line in f:
+                parts = line.rstrip('\n').split('\t')
+                if len(parts) == 3:
+                    baseline[(parts[2], parts[0])] = int(parts[1])
+    return baseline
+
+
+def write_baseline(path, syms):
+    with open(path, 'w') as f:
+        for name, size, kind in sorted(syms, key=lambda s: (s[2], s[0])):
+            f.write('%s\t%d\t%s\n' % (kind, size, name))
+
+
+def analyse(elf, map_file, budget_file, baseline_file, tools, env=None, full=True, update_baseline=False):
+    budget = configparser.ConfigParser(inline_comment_prefixes=(';', '#'))
+    budget.read(budget_file)
+    limits = budget['budget']
+    sections = section_sizes(tools['size'], elf, env)
+    flash = sum(size for name, size in sections.items() if name.startswith(FLASH_SECTIONS))
+    static_ram = sum(size for name, size in sections.items() if name.startswith(RAM_SECTIONS))
+    functions = call_graph(tools['objdump'], elf, env)
+    main_root, (main_depth, main_path, main_unbounded), ((isr_depth, isr_path, isr_unbounded), isr_name), vectors = stack_report(functions)
+    stack = main_depth + isr_depth
+    ram = static_ram + stack + limits.getint('stack_margin')
+    syms = symbols(tools['nm'], elf, env)
+
+    if full:
+        print('\nFootprint by library (flash / RAM bytes):')
+        if map_file and os.path.exists(map_file):
+            for lib, s in sorted(library_sizes(map_file).items(), key=lambda e: -e[1]['flash']):
+                print('  %-32s %6d %5d' % (lib, s['flash'], s['ram']))
+        else:
+            print('  no linker map - link with -Wl,-Map')
+        print('\nLargest symbols (flash / data / bss):')
+        for name, size, kind in sorted(syms, key=lambda s: -s[1])[:limits.getint('report_symbols')]:
+            print('  %6d %-5s %s' % (size, kind, name))
+        baseline = read_baseline(baseline_file)
+        if baseline:
+            current = {(name, kind): size for name, size, kind in syms}
+            changes = [(current.get(k, 0) - baseline.get(k, 0), k) for k in set(current) | set(baseline)]
+            changes = [c for c in changes if c[0]]
+            print('\nChanges against %s:' % os.path.basename(baseline_file))
+            for delta, (name, kind) in sorted(changes, key=lambda c: -abs(c[0]))[:limits.getint('report_symbols')]:
+                print('  %+6d %-5s %s' % (delta, kind, name))
+            if not changes:
+                print('  none')
+        unbounded = sorted(main_unbounded | isr_unbounded)
+        names = demangle(tools['filt'], sorted(set(main_path + [n for v in vectors for n in v[0][1]] + unbounded)), env)
+        print('\nWorst-case stack from %s: %d bytes' % (main_root, main_depth))
+        print('  ' + ' -> '.join(names[n] for n in main_path))
+        for (depth, path, _), name in sorted(vectors, reverse=True):
+            print('  ISR %-12s %4d bytes  %s' % (name, depth, ' -> '.join(names[n] for n in path)))
+        if unbounded:
+            print('  not bounded (indirect calls or recursion): ' + ', '.join(names[n] for n in unbounded))
+    if update_baseline:
+        write_baseline(baseline_file, syms)
+        print('Baseline written to ' + baseline_file)
+
+    over = []
+    if flash > limits.getint('flash'):
+        over.append('flash %d > %d' % (flash, limits.getint('flash')))
+    if ram > limits.getint('ram'):
+        over.append('RAM %d > %d' % (ram, limits.getint('ram')))
+    print('Footprint: flash %d of %d (%d free), RAM %d static + %d stack (%s %d + ISR %d) + %d margin of %d (%d free)' % (
+        flash, limits.getint('flash'), limits.getint('flash') - flash, static_ram, stack, main_root, main_depth,
+        isr_depth, limits.getint('stack_margin'), limits.getint('ram'), limits.getint('ram') - ram))
+    for o in over:
+        print('Footprint budget exceeded: ' + o)
+    if not os.path.exists(baseline_file):
+        # the budget is only as good as the build it was set from
+        print('Footprint budget not measured: no %s - record it with -t footprint_baseline and set %s from its totals' % (
+            os.path.basename(baseline_file), os.path.basename(budget_file)))
+    return not over
+
+
+HERE = os.path.dirname(os.path.abspath(__file__)) if '__file__' in globals() else os.getcwd()
+BUDGET = os.path.join(HERE, 'footprint_budget.ini')
+BASELINE = os.path.join(HERE, 'footprint_baseline.txt')
+
+if __name__ == '__main__':
+    args = [a for a in sys.argv[1:] if not a.startswith('--')]
+    if not args:
+        sys.exit('usage: python footprint.py firmware.elf [firmware.map] [--baseline FILE] [--update-baseline]')
+    baseline = BASELINE
+    if '--baseline' in sys.argv:
+        baseline = sys.argv[sys.argv.index('--baseline') + 1]
+        args.remove(baseline)
+    tools = {'size': 'avr-size', 'nm': 'avr-nm', 'objdump': 'avr-objdump', 'filt': 'avr-c++filt'}
+    ok = analyse(args[0], args[1] if len(args) > 1 else None, BUDGET, baseline, tools,
+                 update_baseline='--update-baseline' in sys.argv)
+    sys.exit(0 if ok else 1)
+else:
+    Import('env')  # noqa: F821 - provided by PlatformIO
+    if env['PIOPLATFORM'] == 'atmelavr':  # noqa: F821
+        BUILD_MAP = os.path.join(env.subst('$BUILD_DIR'), 'firmware.map')  # noqa: F821
+        env.Append(LINKFLAGS=['-Wl,-Map,' + BUILD_MAP])  # noqa: F821
+        HERE = env.subst('$PROJECT_DIR')  # noqa: F821
+        BUDGET = os.path.join(HERE, 'footprint_budget.ini')
+        BASELINE = os.path.join(HERE, 'footprint_baseline.txt')
+        TOOLS = {'size': env.subst('$SIZETOOL'), 'nm': env.subst('$CC').replace('gcc', 'nm'),  # noqa: F821
+                 'objdump': env.subst('$CC').replace('gcc', 'objdump'), 'filt': env.subst('$CC').replace('gcc', 'c++filt')}  # noqa: F821
+
+        def footprint_action(full, update_baseline):
+            def action(target, source, env):
+                ok = analyse(env.subst('$BUILD_DIR/${PROGNAME}.elf'), BUILD_MAP, BUDGET, BASELINE, TOOLS, env['ENV'],
+                             full, update_baseline)
+                return 0 if ok else 1
+            return action
+
+        env.AddPostAction('$BUILD_DIR/${PROGNAME}.elf', footprint_action(False, False))  # noqa: F821
+        env.AddCustomTarget('footprint', '$BUILD_DIR/${PROGNAME}.elf', footprint_action(True, False),  # noqa: F821
+                            title='Footprint', description='Flash/RAM per library and symbol, worst-case stack')
+        env.AddCustomTarget('footprint_baseline', '$BUILD_DIR/${PROGNAME}.elf', footprint_action(True, True),  # noqa: F821
+                            title='Footprint baseline', description='Record the per-symbol sizes as baseline')
@@ -0,0 +1,34 @@
+#!/bin/sh
+# End-to-end benchmark of the firmware against the network server stand-in
+#
+#   lib/StationSim/benchmark.sh [PROGRAM]
+#
+# Runs every scenario in lib/StationSim/scenarios/benchmark with the native build (default .pio/build/native/program)
+# and prints one line per scenario from its --radio log: time to join, join requests, clock error after each
+# DeviceTimeAns, the share of answers that came in RX2, the latency of the scheduled downlinks from being
+# queued at the network to the uplink that confirms them, the share of uplinks no gateway heard, the mean
+# LinkCheckAns margin and the data rate and TX power of the last link check.
+set -e
+dir=$(dirname "$0")
+program=${1:-.pio/build/native/program}
+log=$(mktemp)
+trap 'rm -f "$log"' EXIT
+
+printf '%-16s %7s %5s %9s %9s %6s %9s %10s %10s %7s %9s %s\n' scenario join_s joins clock_ms clock_max rx2_% answered latency_s latency_max lost_% margin_db sf/dBm
+for script in "$dir"/scenarios/benchmark/*.txt; do
+  "$program" --script "$script" --no-serial --radio "$log" > /dev/null 2>&1
+  awk -F, -v name="$(basename "$script" .txt)" '
+    NR == 1 { next }
+    $2 == "join_request" { joins++; if (!joined && $8 == "\"JoinAccept\"") { joined = $6; joinsToJoin = joins } }
+    $2 == "uplink" { uplinks++; if ($8 == "\"not heard\"") unheard++ }
+    $2 == "uplink" && $5 > 0 { answers++; if ($5 == 2) rx2++ }
+    $2 == "link_check" { checks++; marginSum += $7; split($8, f, /[" ]/); link = f[2] "/" f[3] }
+    $2 == "clock_set" { sets++; e = $7 < 0 ? -$7 : $7; errSum += e; if (e > errMax) errMax = e }
+    $2 == "config_answered" { done++; latSum += $7; if ($7 > latMax) latMax = $7 }
+    END {
+      printf "%-16s %7s %5d %9.1f %9d %6.1f %9d %10.0f %10.0f %7.1f %9s %s\n", name, joined ? sprintf("%.1f", joined) : "-",
+             joined ? joinsToJoin : joins, sets ? errSum / sets : 0, errMax, answers ? 100 * rx2 / answers : 0, done,
+             done ? latSum / done : 0, latMax, uplinks ? 100 * unheard / uplinks : 0,
+             checks ? sprintf("%.1f", marginSum / checks) : "-", checks ? link : "-"
+    }' "$log"
+done
@@ -0,0 +1,89 @@
+// Minimal Arduino core for the host-native simulation - time is virtual, see SimCore.h
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "SimCore.h"
+
+#ifndef F_CPU
+#define F_CPU 8000000UL   // Feather 32u4
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define LED_BUILTIN 13
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define NOT_AN_INTERRUPT -1
+// external interrupts of the 32u4: INT0-INT3 on pins 3, 2, 0, 1 and INT6 on pin 7
+#define digitalPinToInterrupt(p) ((p) == 3 ? 0 : ((p) == 2 ? 1 : ((p) == 0 ? 2 : ((p) == 1 ? 3 : ((p) == 7 ? 4 : NOT_AN_INTERRUPT)))))
+
+#define DEC 10
+#define HEX 16
+
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define _BV(bit) (1 << (bit))
+
+// flash strings live in RAM on the host
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+// every attached external interrupt is taken as wired to the DS3231 INT/SQW pin
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int mode);
+void detachInterrupt(uint8_t interruptNum);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+class SimSerial {
+  public:
+    void begin(unsigned long) {}
+    void flush() {}
+    int available() { return 0; }
+    long parseInt() { return 0; }
+    operator bool() { return simSerialOut != NULL; }
+
+    void print(const __FlashStringHelper *s);
+    void print(const char *s);
+    void print(char c);
+    void print(long n, int base = DEC);
+    void print(unsigned long n, int base = DEC);
+    void print(int n, int base = DEC) { print((long)n, base); }
+    void print(unsigned int n, int base = DEC) { print((unsigned long)n, base); }
+    void print(double n, int digits = 2);
+    template <typename T> void println(T value) { print(value); print('\n'); }
+    template <typename T> void println(T value, int format) { print(value, format); print('\n'); }
+    void println() { print('\n'); }
+};
+
+extern SimSerial Serial;
+
+#endif
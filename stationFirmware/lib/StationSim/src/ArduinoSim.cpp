@@ -0,0 +1,178 @@
+// Arduino core, EEPROM and AVR sleep/watchdog behaviour on top of the virtual clock
+#include <stdio.h>
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+#include <RTClib.h>
+#include "SimCore.h"
+
+SimSerial Serial;
+FILE *simSerialOut = stderr;
+EEPROMClass EEPROM;
+
+volatile uint8_t MCUSR = 0;
+volatile uint8_t WDTCSR = 0;
+
+// the firmware's watchdog vector, if it defines one
+extern "C" void WDT_vect(void) __attribute__((weak));
+
+static uint8_t eepromData[E2END + 1];
+static bool eepromReady = false;
+static uint32_t eepromWrites = 0;
+static uint8_t sleepMode = SLEEP_MODE_IDLE;
+static bool sleepEnabled = false;
+#define SIM_EXTERNAL_INTERRUPTS 5
+static void (*externalIsr[SIM_EXTERNAL_INTERRUPTS])() = {};
+
+#define SIM_EEPROM_WRITE_US 3300UL
+#define SIM_CALL_OVERHEAD_US 2UL   // keeps firmware loops that only poll millis() moving
+
+unsigned long millis() {
+  simAdvance(SIM_CALL_OVERHEAD_US, SIM_BUSY_WAIT);
+  return simMillis();
+}
+
+unsigned long micros() {
+  simAdvance(SIM_CALL_OVERHEAD_US, SIM_BUSY_WAIT);
+  return simMicros();
+}
+
+void delay(unsigned long ms) { simAdvance((uint64_t)ms * 1000ULL, SIM_BUSY_WAIT); }
+
+void delayMicroseconds(unsigned int us) { simAdvance(us, SIM_BUSY_WAIT); }
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return LOW; }
+
+void attachInterrupt(uint8_t interruptNum, void (*isr)(), int) {
+  if (interruptNum < SIM_EXTERNAL_INTERRUPTS) externalIsr[interruptNum] = isr;
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+  if (interruptNum < SIM_EXTERNAL_INTERRUPTS) externalIsr[interruptNum] = NULL;
+}
+
+// LOW level interrupt on the RTC INT/SQW line - calls the first attached handler while the pin is low
+static bool rtcInterrupt() {
+  if (!simRtcIntLow()) return false;
+  for (uint8_t i = 0; i < SIM_EXTERNAL_INTERRUPTS; i++) {
+    if (externalIsr[i]) {
+      externalIsr[i]();
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool rtcInterruptAttached() {
+  for (uint8_t i = 0; i < SIM_EXTERNAL_INTERRUPTS; i++) {
+    if (externalIsr[i]) return true;
+  }
+  return false;
+}
+
+// the firmware's random() has its own generator, so its draws leave the sensor noise of a seed alone - randomSeed()
+// mixes its seed with the scenario seed
+static uint32_t randomState = 1;
+
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return (long)(randomState % (uint32_t)howbig);
+}
+long random(long howsmall, long howbig) { return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall); }
+void randomSeed(unsigned long seed) {
+  randomState = (uint32_t)seed ^ simScenario.seed ^ 0x6C078965UL;
+  if (randomState == 0) randomState = 1;
+}
+
+void SimSerial::print(const __FlashStringHelper *s) { if (simSerialOut) fputs(reinterpret_cast<const char *>(s), simSerialOut); }
+void SimSerial::print(const char *s) { if (simSerialOut) fputs(s, simSerialOut); }
+void SimSerial::print(char c) { if (simSerialOut) fputc(c, simSerialOut); }
+void SimSerial::print(long n, int base) { if (simSerialOut) fprintf(simSerialOut, base == HEX ? "%lX" : "%ld", n); }
+void SimSerial::print(unsigned long n, int base) { if (simSerialOut) fprintf(simSerialOut, base == HEX ? "%lX" : "%lu", n); }
+void SimSerial::print(double n, int digits) { if (simSerialOut) fprintf(simSerialOut, "%.*f", digits, n); }
+
+static void eepromInit() {
+  if (eepromReady) return;
+  memset(eepromData, 0xFF, sizeof(eepromData));
+  eepromReady = true;
+}
+
+uint8_t EEPROMClass::read(int idx) {
+  eepromInit();
+  return (idx >= 0 && idx <= E2END) ? eepromData[idx] : 0xFF;
+}
+
+void EEPROMClass::write(int idx, uint8_t val) {
+  eepromInit();
+  if (idx < 0 || idx > E2END) return;
+  if (simScenario.powerLossEepromWrite && ++eepromWrites >= simScenario.powerLossEepromWrite) {
+    simLog("power lost before EEPROM write %u at %d", eepromWrites, idx);
+    throw SimEnd();
+  }
+  eepromData[idx] = val;
+  simCountEepromWrite();
+  simAdvance(SIM_EEPROM_WRITE_US, SIM_ACTIVE);
+}
+
+// a missing image is an erased EEPROM
+bool simEepromLoad(const char *path) {
+  eepromInit();
+  FILE *f = fopen(path, "rb");
+  if (!f) return true;
+  bool ok = fread(eepromData, 1, sizeof(eepromData), f) == sizeof(eepromData);
+  fclose(f);
+  return ok;
+}
+
+bool simEepromSave(const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(eepromData, 1, sizeof(eepromData), f) == sizeof(eepromData);
+  return fclose(f) == 0 && ok;
+}
+
+void set_sleep_mode(uint8_t mode) { sleepMode = mode; }
+void sleep_enable() { sleepEnabled = true; }
+void sleep_disable() { sleepEnabled = false; }
+
+// period the watchdog prescaler bits in WDTCSR select: 2K cycles of the 128 kHz oscillator and up
+static uint64_t watchdogPeriodMicros() {
+  uint8_t prescaler = (WDTCSR & 0x07) | ((WDTCSR >> WDP3) & 0x01) << 3;
+  if (prescaler > 9) prescaler = 9;
+  double us = 16000.0 * (double)(1UL << prescaler);
+  return (uint64_t)(us * (1.0 + simScenario.wdtErrorPercent / 100.0));
+}
+
+void sleep_cpu() {
+  if (!sleepEnabled) return;
+  if (sleepMode != SLEEP_MODE_PWR_DOWN) {
+    simAdvance(1000, SIM_IDLE);   // idle - the next Timer0 tick wakes the CPU
+    return;
+  }
+  const bool watchdog = WDTCSR & (1 << WDIE);
+  const uint64_t rtcWakeUs = rtcInterruptAttached() ? simRtcAlarmTrueMicros() : UINT64_MAX;
+  if (!watchdog && rtcWakeUs == UINT64_MAX) {
+    fprintf(stderr, "sim: power-down without a wake-up source\n");
+    throw SimEnd();
+  }
+  static bool resetModeReported = false;
+  if (watchdog && (WDTCSR & (1 << WDE)) && !resetModeReported) {
+    fprintf(stderr, "sim: watchdog armed in interrupt+reset mode (WDE set) - the station resets on the first timeout it does not service\n");
+    resetModeReported = true;
+  }
+  const uint64_t nowUs = simTrueMicros();
+  if (!watchdog || rtcWakeUs - nowUs < watchdogPeriodMicros()) {
+    simAdvance(rtcWakeUs - nowUs, SIM_SLEEP);
+    if (rtcInterrupt()) simCountRtcWakeup();
+    return;
+  }
+  simAdvance(watchdogPeriodMicros(), SIM_SLEEP);
+  simCountWdtWakeup();
+  if (WDT_vect) WDT_vect();
+}
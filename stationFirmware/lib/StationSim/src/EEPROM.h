@@ -0,0 +1,31 @@
+// 1 KB ATmega32u4 EEPROM for the host-native simulation - every write costs 3.3 ms of awake time
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define E2END 0x3FF
+
+class EEPROMClass {
+  public:
+    uint8_t read(int idx);
+    void write(int idx, uint8_t val);
+    void update(int idx, uint8_t val) { if (read(idx) != val) write(idx, val); }
+    uint16_t length() { return E2END + 1; }
+
+    template <typename T> T &get(int idx, T &t) {
+      uint8_t *p = (uint8_t *)&t;
+      for (uint16_t i = 0; i < sizeof(T); i++) p[i] = read(idx + i);
+      return t;
+    }
+    template <typename T> const T &put(int idx, const T &t) {
+      const uint8_t *p = (const uint8_t *)&t;
+      for (uint16_t i = 0; i < sizeof(T); i++) update(idx + i, p[i]);
+      return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
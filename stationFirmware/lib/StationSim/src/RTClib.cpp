@@ -0,0 +1,216 @@
+// DS3231 and TimeLib software clock on top of the virtual clock
+#include <stdio.h>
+#include <RTClib.h>
+#include <TimeLib.h>
+#include <Arduino.h>
+#include "SimCore.h"
+#include "SimNetwork.h"
+
+#define SIM_I2C_TRANSFER_US 600UL
+
+static const uint32_t SECONDS_FROM_1970_TO_2000 = 946684800UL;
+
+static uint32_t daysFromCivil(int32_t y, uint32_t m, uint32_t d) {
+  y -= m <= 2;
+  const int32_t era = (y >= 0 ? y : y - 399) / 400;
+  const uint32_t yoe = (uint32_t)(y - era * 400);
+  const uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  const uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return (uint32_t)(era * 146097 + (int32_t)doe - 719468);
+}
+
+DateTime::DateTime(uint32_t t) {
+  if (t < SECONDS_FROM_1970_TO_2000) t = SECONDS_FROM_1970_TO_2000;
+  ss = t % 60;
+  mm = (t / 60) % 60;
+  hh = (t / 3600) % 24;
+  int32_t z = (int32_t)(t / 86400) + 719468;
+  const int32_t era = z / 146097;
+  const uint32_t doe = (uint32_t)(z - era * 146097);
+  const uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  const uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  const uint32_t mp = (5 * doy + 2) / 153;
+  d = doy - (153 * mp + 2) / 5 + 1;
+  m = mp < 10 ? mp + 3 : mp - 9;
+  yOff = (uint8_t)((int32_t)yoe + era * 400 + (m <= 2) - 2000);
+}
+
+DateTime::DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour, uint8_t min, uint8_t sec)
+    : yOff(year >= 2000 ? year - 2000 : year), m(month), d(day), hh(hour), mm(min), ss(sec) {}
+
+uint32_t DateTime::unixtime() const {
+  return daysFromCivil(2000 + yOff, m, d) * 86400UL + hh * 3600UL + mm * 60UL + ss;
+}
+
+// RTC state: local time in ms at the last adjust() and the true time it happened at
+static bool rtcStarted = false;
+static bool rtcPowerLost = false;
+static int64_t rtcBaseMs = 0;
+static uint64_t rtcBaseTrueUs = 0;
+
+static void rtcInit() {
+  if (rtcStarted) return;
+  rtcStarted = true;
+  rtcPowerLost = simScenario.rtcLostPower;
+  rtcBaseTrueUs = simTrueMicros();
+  if (rtcPowerLost) {
+    rtcBaseMs = (int64_t)SECONDS_FROM_1970_TO_2000 * 1000LL;   // DS3231 comes up at 2000-01-01
+  } else {
+    rtcBaseMs = ((int64_t)simTrueUnixUtc() + simScenario.timezoneHours * 3600LL) * 1000LL +
+                (int64_t)(simTrueMicros() / 1000ULL % 1000ULL) + simScenario.rtcInitialErrorMs;
+  }
+}
+
+// aging offset register - each LSB slows the oscillator by about 0.1 ppm
+static int8_t rtcAging = 0;
+
+static double rtcDriftPpm() { return simScenario.rtcDriftPpm - 0.1 * rtcAging; }
+
+uint64_t simRtcMillis() {
+  rtcInit();
+  double elapsedMs = (simTrueMicros() - rtcBaseTrueUs) / 1000.0;
+  return (uint64_t)(rtcBaseMs + (int64_t)(elapsedMs * (1.0 + rtcDriftPpm() * 1e-6)));
+}
+
+// DS3231 registers written and read with Wire - only the aging offset (0x10) is modelled, the
+// others read as 0; the register pointer advances with every byte
+#define SIM_DS3231_AGING_REGISTER 0x10
+static uint8_t rtcRegister = 0;
+
+bool simRtcI2cWrite(const uint8_t *data, uint8_t length) {
+  rtcInit();
+  if (length == 0) return true;
+  rtcRegister = data[0];
+  for (uint8_t i = 1; i < length; i++, rtcRegister++) {
+    if (rtcRegister != SIM_DS3231_AGING_REGISTER || (int8_t)data[i] == rtcAging) continue;
+    rtcBaseMs = (int64_t)simRtcMillis();   // the new trim applies from now on
+    rtcBaseTrueUs = simTrueMicros();
+    rtcAging = (int8_t)data[i];
+    simLog("RTC aging offset set to %d", rtcAging);
+  }
+  return true;
+}
+
+bool simRtcI2cRead(uint8_t *data, uint8_t length) {
+  for (uint8_t i = 0; i < length; i++, rtcRegister++) {
+    data[i] = rtcRegister == SIM_DS3231_AGING_REGISTER ? (uint8_t)rtcAging : 0;
+  }
+  return true;
+}
+
+// alarm 1 - INTCN routes it to INT/SQW, A1IE enables it there, A1F latches the match until cleared
+static bool rtcIntcn = false;
+static bool rtcA1ie = false;
+static bool rtcA1f = false;
+static bool rtcA1Armed = false;     // match still to come
+static uint32_t rtcA1Epoch = 0;     // local time of the match
+
+static void rtcUpdateAlarm() {
+  if (rtcA1Armed && simRtcMillis() >= (uint64_t)rtcA1Epoch * 1000ULL) {
+    rtcA1f = true;
+    rtcA1Armed = false;
+  }
+}
+
+bool simRtcIntLow() {
+  rtcUpdateAlarm();
+  return rtcIntcn && rtcA1ie && rtcA1f;
+}
+
+uint64_t simRtcAlarmTrueMicros() {
+  if (simRtcIntLow()) return simTrueMicros();
+  if (!rtcIntcn || !rtcA1ie || !rtcA1Armed) return UINT64_MAX;
+  double elapsedMs = ((double)rtcA1Epoch * 1000.0 - (double)rtcBaseMs) / (1.0 + rtcDriftPpm() * 1e-6);
+  uint64_t us = rtcBaseTrueUs + (uint64_t)(elapsedMs * 1000.0) + 1;
+  return us > simTrueMicros() ? us : simTrueMicros();
+}
+
+bool RTC_DS3231::begin() {
+  rtcInit();
+  simAdvance(SIM_I2C_TRANSFER_US, SIM_ACTIVE);
+  return true;
+}
+
+bool RTC_DS3231::lostPower() {
+  rtcInit();
+  simAdvance(SIM_I2C_TRANSFER_US, SIM_ACTIVE);
+  return rtcPowerLost;
+}
+
+void RTC_DS3231::adjust(const DateTime &dt) {
+  rtcInit();
+  simAdvance(SIM_I2C_TRANSFER_US, SIM_ACTIVE);
+  // writing the seconds register restarts the DS3231 countdown chain
+  rtcBaseMs = (int64_t)dt.unixtime() * 1000LL;
+  rtcBaseTrueUs = simTrueMicros();
+  rtcPowerLost = false;
+  simNetworkClockSet(rtcBaseMs - simNetworkLocalMillis());
+  simLog("RTC set to %lu", (unsigned long)dt.unixtime());
+}
+
+DateTime RTC_DS3231::now() {
+  simAdvance(SIM_I2C_TRANSFER_US, SIM_ACTIVE);
+  return DateTime((uint32_t)(simRtcMillis() / 1000ULL));
+}
+
+void RTC_DS3231::writeSqwPinMode(Ds3231SqwPinMode mode) {
+  simAdvance(SIM_I2C_TRANSFER_US, SIM_ACTIVE);
+  rtcIntcn = mode == DS3231_OFF;
+}
+
+void RTC_DS3231::disable32K() { simAdvance(SIM_I2C_TRANSFER_US, SIM_ACTIVE); }
+
+bool RTC_DS3231::setAlarm1(const DateTime &dt, Ds3231Alarm1Mode mode) {
+  simAdvance(4 * SIM_I2C_TRANSFER_US, SIM_ACTIVE);
+  if (!rtcIntcn) return false;   // RTClib refuses while INT/SQW outputs the square wave
+  if (mode != DS3231_A1_Date) {
+    fprintf(stderr, "sim: only DS3231_A1_Date alarms are modelled\n");
+    throw SimEnd();
+  }
+  rtcA1Epoch = dt.unixtime();
+  rtcA1Armed = true;
+  rtcA1ie = true;
+  rtcUpdateAlarm();
+  return true;
+}
+
+void RTC_DS3231::disableAlarm(uint8_t alarmNum) {
+  simAdvance(SIM_I2C_TRANSFER_US, SIM_ACTIVE);
+  if (alarmNum == 1) rtcA1ie = false;
+}
+
+void RTC_DS3231::clearAlarm(uint8_t alarmNum) {
+  simAdvance(SIM_I2C_TRANSFER_US, SIM_ACTIVE);
+  rtcUpdateAlarm();
+  if (alarmNum == 1) rtcA1f = false;
+}
+
+bool RTC_DS3231::alarmFired(uint8_t alarmNum) {
+  simAdvance(SIM_I2C_TRANSFER_US, SIM_ACTIVE);
+  rtcUpdateAlarm();
+  return alarmNum == 1 && rtcA1f;
+}
+
+float RTC_DS3231::getTemperature() {
+  simAdvance(SIM_I2C_TRANSFER_US, SIM_ACTIVE);
+  return 21.0f;
+}
+
+// TimeLib keeps time with millis(), so it loses the time spent in power-down just like on the MCU
+static uint32_t swBaseEpoch = 0;
+static uint32_t swBaseMillis = 0;
+
+uint32_t now() { return swBaseEpoch + (millis() - swBaseMillis) / 1000UL; }
+
+void setTime(uint32_t t) {
+  swBaseEpoch = t;
+  swBaseMillis = millis();
+  simNetworkClockSet((int64_t)t * 1000LL - simNetworkLocalMillis());
+}
+
+int year() { return DateTime(now()).year(); }
+int month() { return DateTime(now()).month(); }
+int day() { return DateTime(now()).day(); }
+int hour() { return DateTime(now()).hour(); }
+int minute() { return DateTime(now()).minute(); }
+int second() { return DateTime(now()).second(); }
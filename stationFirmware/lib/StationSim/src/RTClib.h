@@ -0,0 +1,68 @@
+// DS3231 stand-in for the host-native simulation - keeps its own drifting time on top of the virtual clock
+#ifndef RTCLIB_H
+#define RTCLIB_H
+
+#include <stdint.h>
+
+class TimeSpan {
+  public:
+    TimeSpan(int32_t seconds = 0) : _seconds(seconds) {}
+    int32_t totalseconds() const { return _seconds; }
+  private:
+    int32_t _seconds;
+};
+
+class DateTime {
+  public:
+    DateTime(uint32_t t = 0);
+    DateTime(uint16_t year, uint8_t month, uint8_t day, uint8_t hour = 0, uint8_t min = 0, uint8_t sec = 0);
+    uint16_t year() const { return yOff + 2000; }
+    uint8_t month() const { return m; }
+    uint8_t day() const { return d; }
+    uint8_t hour() const { return hh; }
+    uint8_t minute() const { return mm; }
+    uint8_t second() const { return ss; }
+    uint32_t unixtime() const;
+    DateTime operator+(const TimeSpan &span) const { return DateTime(unixtime() + span.totalseconds()); }
+  private:
+    uint8_t yOff, m, d, hh, mm, ss;
+};
+
+// alarm 1 match modes and INT/SQW pin modes as in RTClib - the simulation models DS3231_A1_Date and DS3231_OFF
+enum Ds3231Alarm1Mode {
+  DS3231_A1_PerSecond = 0x0F,
+  DS3231_A1_Second = 0x0E,
+  DS3231_A1_Minute = 0x0C,
+  DS3231_A1_Hour = 0x08,
+  DS3231_A1_Date = 0x00,
+  DS3231_A1_Day = 0x10
+};
+
+enum Ds3231SqwPinMode {
+  DS3231_OFF = 0x1C,
+  DS3231_SquareWave1Hz = 0x00
+};
+
+class RTC_DS3231 {
+  public:
+    bool begin();
+    bool lostPower();
+    void adjust(const DateTime &dt);
+    DateTime now();
+    float getTemperature();
+    void writeSqwPinMode(Ds3231SqwPinMode mode);
+    void disable32K();
+    bool setAlarm1(const DateTime &dt, Ds3231Alarm1Mode mode);
+    void disableAlarm(uint8_t alarmNum);
+    void clearAlarm(uint8_t alarmNum);
+    bool alarmFired(uint8_t alarmNum);
+};
+
+// local time the simulated RTC shows right now, in milliseconds since the Unix epoch
+uint64_t simRtcMillis();
+// INT/SQW pin state - low while the alarm 1 flag is set with its interrupt enabled
+bool simRtcIntLow();
+// true time in us since power-on at which INT/SQW goes low next, UINT64_MAX if it does not
+uint64_t simRtcAlarmTrueMicros();
+
+#endif
@@ -0,0 +1,138 @@
+// HTU21D and SPS30 models - smooth daily weather plus a mean-reverting particulate random walk
+#include <math.h>
+#include <Arduino.h>
+#include "SimCore.h"
+
+#define SIM_SPS_SAMPLE_US 1000000ULL
+
+static double dayPhase() {
+  double localSeconds = fmod((double)simTrueUnixUtc() + simScenario.timezoneHours * 3600.0, 86400.0);
+  return 2.0 * M_PI * (localSeconds / 86400.0 - 0.375);   // warmest mid-afternoon
+}
+
+static double noise(double amplitude) { return amplitude * ((simRandom() % 2001) / 1000.0 - 1.0); }
+
+static float htuTemperature() { return (float)(12.0 + 6.0 * sin(dayPhase()) + noise(0.1)); }
+
+static float htuHumidity() { return (float)(65.0 - 15.0 * sin(dayPhase()) + noise(0.5)); }
+
+// HTU21D on the I2C bus in no hold master mode: a trigger command starts a conversion, reads are not
+// acknowledged until it is done, then the result comes as MSB, LSB (2 status bits) and CRC-8
+#define SIM_HTU_TEMPERATURE_US 44000ULL   // typical at 14 bit
+#define SIM_HTU_HUMIDITY_US 14000ULL      // typical at 12 bit
+static uint64_t htuReadyUs = 0;
+static uint16_t htuRaw = 0;
+static bool htuConverting = false;
+
+static uint8_t htuCrc(const uint8_t *data, uint8_t length) {
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+bool simHtuI2cWrite(const uint8_t *data, uint8_t length) {
+  if (length < 1) return true;
+  if (data[0] == 0xF3) {
+    double raw = (htuTemperature() + 46.85) * 65536.0 / 175.72;
+    htuRaw = (uint16_t)raw & 0xFFFC;
+    htuReadyUs = simTrueMicros() + SIM_HTU_TEMPERATURE_US;
+  } else if (data[0] == 0xF5) {
+    double raw = (htuHumidity() + 6.0) * 65536.0 / 125.0;
+    htuRaw = ((uint16_t)raw & 0xFFFC) | 0x02;
+    htuReadyUs = simTrueMicros() + SIM_HTU_HUMIDITY_US;
+  } else {
+    if (data[0] == 0xFE) htuConverting = false;   // soft reset - the 15 ms it takes and the user register are not modelled
+    return true;
+  }
+  htuConverting = true;
+  return true;
+}
+
+bool simHtuI2cRead(uint8_t *data, uint8_t length) {
+  if (!htuConverting || simTrueMicros() < htuReadyUs) return false;
+  uint8_t result[3] = {(uint8_t)(htuRaw >> 8), (uint8_t)htuRaw, 0};
+  result[2] = htuCrc(result, 2);
+  for (uint8_t i = 0; i < length && i < 3; i++) data[i] = result[i];
+  htuConverting = false;
+  return true;
+}
+
+// SPS30 on the I2C bus in the uint16 output format - write commands with CRC protected argument words, reads return
+// words of MSB, LSB and a CRC-8 starting from 0xFF; a sensor started in float format is not modelled
+#define SIM_SPS_START 0x0010
+#define SIM_SPS_STOP 0x0104
+#define SIM_SPS_DATA_READY 0x0202
+#define SIM_SPS_MEASUREMENT 0x0300
+static bool spsMeasuring = false;
+static uint64_t spsStartUs = 0;
+static uint64_t spsLastReadUs = 0;
+static uint16_t spsErrorsLeft = 0xFFFF;
+static double pm2p5 = 12.0;
+static uint32_t spsReads = 0;
+static uint16_t spsCommand = 0;
+
+static uint8_t spsCrc(const uint8_t *data) {
+  uint8_t crc = 0xFF;
+  for (uint8_t i = 0; i < 2; i++) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+static uint16_t spsWord(double value) { return value < 0.0 ? 0 : (value > 65535.0 ? 65535 : (uint16_t)lround(value)); }
+
+// a new sample every second while the fan runs
+static void spsMeasurement(uint16_t *words) {
+  spsLastReadUs = simTrueMicros();
+  pm2p5 += 0.2 * (12.0 - pm2p5) + noise(1.5);
+  if (simRandom() % 500 == 0) pm2p5 += 80.0;   // occasional pollution event
+  if (pm2p5 < 0.5) pm2p5 = 0.5;
+  // an insect or a drop in the inlet - one sample off, the air is not
+  double pm = simScenario.spsSpikeReads && ++spsReads % simScenario.spsSpikeReads == 0 ? pm2p5 * 5.0 : pm2p5;
+  const double factors[9] = {0.85, 1.0, 1.08, 1.12, 6.4, 7.5, 7.6, 7.62, 7.63};
+  for (uint8_t i = 0; i < 9; i++) words[i] = spsWord(pm * factors[i]);
+  words[9] = spsWord(550.0 + noise(50.0));   // typical particle size in nm
+}
+
+bool simSpsI2cWrite(const uint8_t *data, uint8_t length) {
+  if (length < 2) return true;
+  spsCommand = (uint16_t)(data[0] << 8 | data[1]);
+  if (spsCommand == SIM_SPS_START && !spsMeasuring) {
+    spsMeasuring = true;
+    spsStartUs = simTrueMicros();
+    spsLastReadUs = spsStartUs;
+    simSetFan(true);
+  } else if (spsCommand == SIM_SPS_STOP) {
+    spsMeasuring = false;
+    simSetFan(false);
+  }
+  return true;   // the fan cleaning interval and the rest are not modelled
+}
+
+bool simSpsI2cRead(uint8_t *data, uint8_t length) {
+  uint16_t words[10] = {0};
+  uint8_t count = 0;
+  if (spsCommand == SIM_SPS_DATA_READY) {
+    if (spsErrorsLeft == 0xFFFF) spsErrorsLeft = simScenario.spsErrorReads;
+    if (spsErrorsLeft > 0) {
+      spsErrorsLeft--;
+      return false;
+    }
+    words[0] = spsMeasuring && simTrueMicros() - spsLastReadUs >= SIM_SPS_SAMPLE_US;
+    count = 1;
+  } else if (spsCommand == SIM_SPS_MEASUREMENT) {
+    spsMeasurement(words);
+    count = 10;
+  } else {
+    return false;
+  }
+  for (uint8_t i = 0; i < length; i++) {
+    uint8_t word[2] = {(uint8_t)(words[i / 3 % count] >> 8), (uint8_t)words[i / 3 % count]};
+    data[i] = i % 3 < 2 ? word[i % 3] : spsCrc(word);
+  }
+  return true;
+}
@@ -0,0 +1,356 @@
+// Virtual clock, scenario script and per-cycle energy/airtime report for the host-native build
+//
+// The firmware's setup() runs once and loop() runs until the scenario runs out of virtual time.
+// Every call that takes time on the real station (delay, sleep_cpu, radio, I2C, EEPROM) advances
+// the virtual clock instead, and the time is booked against the power state it was spent in.
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "SimCore.h"
+#include "RTClib.h"
+#include "SimNetwork.h"
+
+void setup();
+void loop();
+
+SimScenario simScenario;
+
+static uint64_t trueUs = 0;       // true time since power-on
+static uint64_t awakeUs = 0;      // Timer0 time - does not run in power-down
+static uint64_t endUs = 0;
+static bool fanOn = false;
+static uint8_t txPowerDbm = 14;
+static uint32_t rngState = 1;
+static SimCycle cycle;
+static SimCycle total;
+static uint32_t cycleCount = 0;
+static FILE *uplinkLog = NULL;    // --uplinks: every uplink payload as "<port> <hex>"
+
+#define SIM_GPS_LEAP_SECONDS 18
+
+static void defaultScenario(SimScenario &s) {
+  memset(&s, 0, sizeof(s));
+  s.startUnixUtc = 1735689600UL;   // 2025-01-01 00:00:00 UTC
+  s.durationSeconds = 7UL * 86400UL;
+  s.timezoneHours = 2;
+  s.devNonceHeard = -1;
+  s.seed = 1;
+  s.current.active = 11.0f;        // Feather 32u4 at 8 MHz, radio idle
+  s.current.busyWait = 11.0f;
+  s.current.idle = 6.0f;           // CPU clock stopped, peripherals and Timer0 running
+  s.current.sleep = 0.3f;          // power-down incl. regulator and RFM95 sleep
+  s.current.tx = 11.0f + 33.0f;    // RFM95 at +14 dBm
+  s.current.txPerDb = 1.0f;
+  s.linkSnrDb = 10.0f;             // a gateway in the same town
+  s.current.rx = 11.0f + 11.5f;
+  s.current.spsFan = 60.0f;        // SPS30 in measurement mode
+}
+
+static uint8_t hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return 0xFF;
+}
+
+static bool parseHex(const char *hex, uint8_t *out, uint8_t &size) {
+  size = 0;
+  while (hex[0] && hex[1] && size < SIM_MAX_DOWNLINK) {
+    uint8_t hi = hexNibble(hex[0]), lo = hexNibble(hex[1]);
+    if (hi == 0xFF || lo == 0xFF) return false;
+    out[size++] = (hi << 4) | lo;
+    hex += 2;
+  }
+  return true;
+}
+
+// scenario script - one "key value..." per line, # starts a comment
+static bool loadScript(const char *path, SimScenario &s) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "cannot open script %s\n", path);
+    return false;
+  }
+  char line[256];
+  unsigned lineNo = 0;
+  while (fgets(line, sizeof(line), f)) {
+    lineNo++;
+    char *hash = strchr(line, '#');
+    if (hash) *hash = 0;
+    char key[32], a[128], b[32], c[128];
+    int n = sscanf(line, "%31s %127s %31s %127s", key, a, b, c);
+    if (n <= 0) continue;
+    bool ok = n >= 2;
+    if (!ok) {
+    } else if (!strcmp(key, "start_utc")) s.startUnixUtc = strtoul(a, NULL, 0);
+    else if (!strcmp(key, "duration_days")) s.durationSeconds = (uint32_t)(atof(a) * 86400.0);
+    else if (!strcmp(key, "duration_hours")) s.durationSeconds = (uint32_t)(atof(a) * 3600.0);
+    else if (!strcmp(key, "max_cycles")) s.maxCycles = strtoul(a, NULL, 0);
+    else if (!strcmp(key, "timezone_hours")) s.timezoneHours = atoi(a);
+    else if (!strcmp(key, "rtc_lost_power")) s.rtcLostPower = atoi(a) != 0;
+    else if (!strcmp(key, "rtc_error_ms")) s.rtcInitialErrorMs = atol(a);
+    else if (!strcmp(key, "rtc_drift_ppm")) s.rtcDriftPpm = atof(a);
+    else if (!strcmp(key, "wdt_error_percent")) s.wdtErrorPercent = atof(a);
+    else if (!strcmp(key, "join_failures")) s.joinFailures = atoi(a);
+    else if (!strcmp(key, "dev_nonce_heard")) s.devNonceHeard = atol(a);
+    else if (!strcmp(key, "time_req_failures")) s.timeReqFailures = atoi(a);
+    else if (!strcmp(key, "uplink_loss_percent")) s.uplinkLossPercent = atof(a);
+    else if (!strcmp(key, "gateway_down_hours")) s.gatewayDownSeconds = (uint32_t)(atof(a) * 3600.0);
+    else if (!strcmp(key, "downlink_loss_percent")) s.downlinkLossPercent = atof(a);
+    else if (!strcmp(key, "network_latency_ms")) s.networkLatencyMs = atoi(a);
+    else if (!strcmp(key, "network_jitter_ms")) s.networkJitterMs = atoi(a);
+    else if (!strcmp(key, "link_snr_db")) s.linkSnrDb = atof(a);
+    else if (!strcmp(key, "link_snr_jitter_db")) s.linkSnrJitterDb = atof(a);
+    else if (!strcmp(key, "sps_error_reads")) s.spsErrorReads = atoi(a);
+    else if (!strcmp(key, "sps_spike_reads")) s.spsSpikeReads = atoi(a);
+    else if (!strcmp(key, "power_loss_eeprom_write")) s.powerLossEepromWrite = strtoul(a, NULL, 0);
+    else if (!strcmp(key, "seed")) s.seed = strtoul(a, NULL, 0);
+    else if (!strcmp(key, "current") && n >= 3) {
+      float mA = atof(b);
+      if (!strcmp(a, "active")) s.current.active = mA;
+      else if (!strcmp(a, "busy_wait")) s.current.busyWait = mA;
+      else if (!strcmp(a, "idle")) s.current.idle = mA;
+      else if (!strcmp(a, "sleep")) s.current.sleep = mA;
+      else if (!strcmp(a, "tx")) s.current.tx = mA;
+      else if (!strcmp(a, "tx_per_db")) s.current.txPerDb = mA;
+      else if (!strcmp(a, "rx")) s.current.rx = mA;
+      else if (!strcmp(a, "sps_fan")) s.current.spsFan = mA;
+      else ok = false;
+    } else if (!strcmp(key, "downlink") && n >= 4 && s.downlinkCount < SIM_MAX_SCRIPTED_DOWNLINKS) {
+      SimDownlink &d = s.downlinks[s.downlinkCount];
+      d.afterUplink = strtoul(a, NULL, 0);
+      d.port = atoi(b);
+      ok = d.afterUplink > 0 && parseHex(c, d.data, d.size);
+      if (ok) s.downlinkCount++;
+    } else if (!strcmp(key, "downlink_at_hours") && n >= 4 && s.downlinkCount < SIM_MAX_SCRIPTED_DOWNLINKS) {
+      SimDownlink &d = s.downlinks[s.downlinkCount];
+      d.afterUplink = 0;
+      d.atSeconds = (uint32_t)(atof(a) * 3600.0);
+      d.port = atoi(b);
+      ok = parseHex(c, d.data, d.size);
+      if (ok) s.downlinkCount++;
+    } else ok = false;
+    if (!ok) {
+      fprintf(stderr, "%s:%u: cannot parse '%s'\n", path, lineNo, key);
+      fclose(f);
+      return false;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--script FILE] [--days N] [--cycles N] [--seed N] [--uplinks FILE] [--eeprom FILE] [--serial FILE | --no-serial]\n"
+          "          [--radio FILE] [--verbose]\n"
+          "Runs setup()/loop() against a virtual clock and prints one CSV line per cycle.\n"
+          "--uplinks writes every uplink payload as \"<port> <hex>\", the input format of decodePayload.\n"
+          "--eeprom starts from the EEPROM image in FILE if it exists and writes the image back at the end.\n"
+          "--serial writes the Serial output (trace lines for traceDecode) to FILE instead of stderr, --no-serial runs\n"
+          "as if no host had the serial port open.\n"
+          "--radio writes every frame, its receive window, clock setting and answered downlink of the network stand-in to FILE.\n",
+          argv0);
+}
+
+uint64_t simTrueMicros() { return trueUs; }
+
+uint32_t simTrueUnixUtc() { return simScenario.startUnixUtc + (uint32_t)(trueUs / 1000000ULL); }
+
+uint32_t simMillis() { return (uint32_t)(awakeUs / 1000ULL); }
+
+uint32_t simMicros() { return (uint32_t)awakeUs; }
+
+void simAdvance(uint64_t us, SimActivity activity) {
+  if (trueUs >= endUs) throw SimEnd();
+  trueUs += us;
+  if (activity != SIM_SLEEP) awakeUs += us;
+  cycle.us[activity] += us;
+  if (activity == SIM_TX) cycle.txDbBelowMaxUs += us * (14 - txPowerDbm);
+  if (fanOn) cycle.fanOnUs += us;
+}
+
+void simSetFan(bool on) { fanOn = on; }
+void simSetTxPower(uint8_t dbm) { txPowerDbm = dbm < 14 ? dbm : 14; }
+bool simFanOn() { return fanOn; }
+void simCountUplink() { cycle.uplinks++; }
+void simCountDownlink() { cycle.downlinks++; }
+void simCountEepromWrite() { cycle.eepromWrites++; }
+void simCountWdtWakeup() { cycle.wdtWakeups++; }
+void simCountRtcWakeup() { cycle.rtcWakeups++; }
+
+int64_t simNetworkLocalMillis() {
+  return ((int64_t)simScenario.startUnixUtc + SIM_GPS_LEAP_SECONDS + simScenario.timezoneHours * 3600LL) * 1000LL +
+         (int64_t)(trueUs / 1000ULL);
+}
+
+void simRecordUplink(uint8_t port, const uint8_t *payload, uint8_t length) {
+  if (!uplinkLog) return;
+  fprintf(uplinkLog, "%u ", port);
+  for (uint8_t i = 0; i < length; i++) fprintf(uplinkLog, "%02x", payload[i]);
+  fputc('\n', uplinkLog);
+}
+
+uint32_t simRandom() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+
+static void formatLocal(uint64_t localMs, char *out, size_t size) {
+  time_t t = (time_t)(localMs / 1000ULL);
+  struct tm tm;
+  gmtime_r(&t, &tm);
+  strftime(out, size, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+void simLog(const char *fmt, ...) {
+  if (!simScenario.verbose) return;
+  char stamp[32];
+  formatLocal((uint64_t)simTrueUnixUtc() * 1000ULL + simScenario.timezoneHours * 3600000LL, stamp, sizeof(stamp));
+  fprintf(stderr, "[%s] ", stamp);
+  va_list ap;
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+  va_end(ap);
+  fputc('\n', stderr);
+}
+
+uint32_t simLoRaAirtimeMicros(uint8_t sf, uint16_t bwKHz, uint8_t phyPayloadLength, bool crc) {
+  const uint32_t symbolUs = ((uint32_t)1 << sf) * 1000UL / bwKHz;
+  const int lowDataRateOptimize = (sf >= 11 && bwKHz == 125) ? 1 : 0;
+  int numerator = 8 * phyPayloadLength - 4 * sf + 28 + (crc ? 16 : 0);   // explicit header
+  int denominator = 4 * (sf - 2 * lowDataRateOptimize);
+  int payloadSymbols = 8;
+  if (numerator > 0) payloadSymbols += ((numerator + denominator - 1) / denominator) * 5;  // CR 4/5
+  return (uint32_t)((8 * 4 + 17) * symbolUs / 4) + payloadSymbols * symbolUs;   // 8 + 4.25 preamble symbols
+}
+
+static double cycleCharge_mAh(const SimCycle &c) {
+  const SimCurrents &i = simScenario.current;
+  double uAs = c.us[SIM_ACTIVE] * i.active + c.us[SIM_BUSY_WAIT] * i.busyWait + c.us[SIM_IDLE] * i.idle +
+               c.us[SIM_SLEEP] * i.sleep +
+               c.us[SIM_TX] * i.tx - c.txDbBelowMaxUs * i.txPerDb + c.us[SIM_RX] * i.rx + c.fanOnUs * i.spsFan;
+  return uAs / 3.6e9;
+}
+
+static void beginCycle() {
+  memset(&cycle, 0, sizeof(cycle));
+  cycle.startUs = trueUs;
+}
+
+static void endCycle(const char *label) {
+  char stamp[32];
+  formatLocal((uint64_t)simScenario.startUnixUtc * 1000ULL + cycle.startUs / 1000ULL + simScenario.timezoneHours * 3600000LL,
+              stamp, sizeof(stamp));
+  uint64_t awake = cycle.us[SIM_ACTIVE] + cycle.us[SIM_BUSY_WAIT] + cycle.us[SIM_IDLE] + cycle.us[SIM_TX] + cycle.us[SIM_RX];
+  int64_t rtcErrorMs = (int64_t)simRtcMillis() - simNetworkLocalMillis();
+  printf("%s,%s,%.3f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%u,%u,%u,%u,%u,%lld,%.5f\n", label, stamp,
+         (trueUs - cycle.startUs) / 1e6, awake / 1e3, cycle.us[SIM_BUSY_WAIT] / 1e3, cycle.us[SIM_IDLE] / 1e3,
+         cycle.us[SIM_TX] / 1e3, cycle.us[SIM_RX] / 1e3, cycle.us[SIM_SLEEP] / 1e3, cycle.fanOnUs / 1e3, cycle.uplinks, cycle.downlinks,
+         cycle.eepromWrites, cycle.wdtWakeups, cycle.rtcWakeups, (long long)rtcErrorMs, cycleCharge_mAh(cycle));
+
+  for (uint8_t a = 0; a < SIM_ACTIVITY_COUNT; a++) total.us[a] += cycle.us[a];
+  total.fanOnUs += cycle.fanOnUs;
+  total.txDbBelowMaxUs += cycle.txDbBelowMaxUs;
+  total.uplinks += cycle.uplinks;
+  total.downlinks += cycle.downlinks;
+  total.eepromWrites += cycle.eepromWrites;
+  total.wdtWakeups += cycle.wdtWakeups;
+  total.rtcWakeups += cycle.rtcWakeups;
+}
+
+static void printSummary() {
+  double days = trueUs / 86400e6;
+  if (days <= 0) return;
+  uint64_t awake = total.us[SIM_ACTIVE] + total.us[SIM_BUSY_WAIT] + total.us[SIM_IDLE] + total.us[SIM_TX] + total.us[SIM_RX];
+  fprintf(stderr, "\nsimulated %.2f days, %u loop() cycles\n", days, cycleCount);
+  fprintf(stderr, "  awake      %10.1f s/day (%.2f %%)\n", awake / 1e6 / days, 100.0 * awake / trueUs);
+  fprintf(stderr, "  busy-wait  %10.1f s/day\n", total.us[SIM_BUSY_WAIT] / 1e6 / days);
+  fprintf(stderr, "  idle       %10.1f s/day\n", total.us[SIM_IDLE] / 1e6 / days);
+  fprintf(stderr, "  airtime    %10.1f s/day TX, %.1f s/day RX\n", total.us[SIM_TX] / 1e6 / days,
+          total.us[SIM_RX] / 1e6 / days);
+  fprintf(stderr, "  SPS30 fan  %10.1f s/day\n", total.fanOnUs / 1e6 / days);
+  fprintf(stderr, "  uplinks    %10.1f /day, downlinks %u, EEPROM writes %u\n", total.uplinks / days, total.downlinks,
+          total.eepromWrites);
+  fprintf(stderr, "  charge     %10.2f mAh/day\n", cycleCharge_mAh(total) / days);
+  simNetworkSummary();
+}
+
+int main(int argc, char **argv) {
+  defaultScenario(simScenario);
+  const char *script = NULL, *days = NULL, *cycles = NULL, *seed = NULL, *uplinks = NULL, *eeprom = NULL,
+             *serial = NULL, *radio = NULL;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--verbose")) simScenario.verbose = true;
+    else if (hasValue && !strcmp(argv[i], "--script")) script = argv[++i];
+    else if (hasValue && !strcmp(argv[i], "--days")) days = argv[++i];
+    else if (hasValue && !strcmp(argv[i], "--cycles")) cycles = argv[++i];
+    else if (hasValue && !strcmp(argv[i], "--seed")) seed = argv[++i];
+    else if (hasValue && !strcmp(argv[i], "--uplinks")) uplinks = argv[++i];
+    else if (hasValue && !strcmp(argv[i], "--eeprom")) eeprom = argv[++i];
+    else if (hasValue && !strcmp(argv[i], "--serial")) serial = argv[++i];
+    else if (hasValue && !strcmp(argv[i], "--radio")) radio = argv[++i];
+    else if (!strcmp(argv[i], "--no-serial")) simSerialOut = NULL;
+    else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (script && !loadScript(script, simScenario)) return 2;
+  // command line overrides the script
+  if (days) simScenario.durationSeconds = (uint32_t)(atof(days) * 86400.0);
+  if (cycles) simScenario.maxCycles = strtoul(cycles, NULL, 0);
+  if (seed) simScenario.seed = strtoul(seed, NULL, 0);
+  rngState = simScenario.seed ? simScenario.seed : 1;
+  simNetworkBegin(simScenario.seed);
+  endUs = (uint64_t)simScenario.durationSeconds * 1000000ULL;
+  if (uplinks && !(uplinkLog = fopen(uplinks, "w"))) {
+    perror(uplinks);
+    return 1;
+  }
+  if (radio && !simNetworkOpenLog(radio)) {
+    perror(radio);
+    return 1;
+  }
+  if (serial && !(simSerialOut = fopen(serial, "w"))) {
+    perror(serial);
+    return 1;
+  }
+  if (eeprom && !simEepromLoad(eeprom)) {
+    fprintf(stderr, "cannot read EEPROM image %s\n", eeprom);
+    return 1;
+  }
+
+  printf("cycle,start_local,wall_s,awake_ms,busy_wait_ms,idle_ms,tx_ms,rx_ms,sleep_ms,fan_on_ms,uplinks,downlinks,"
+         "eeprom_writes,wdt_wakeups,rtc_wakeups,rtc_error_ms,charge_mAh\n");
+  beginCycle();
+  try {
+    setup();
+    endCycle("setup");
+    for (;;) {
+      if (simScenario.maxCycles && cycleCount >= simScenario.maxCycles) break;
+      beginCycle();
+      loop();
+      cycleCount++;
+      char label[16];
+      snprintf(label, sizeof(label), "%u", cycleCount);
+      endCycle(label);
+    }
+  } catch (SimEnd &) {
+    endCycle("end");
+  }
+  printSummary();
+  if (uplinkLog) fclose(uplinkLog);
+  simNetworkCloseLog();
+  if (simSerialOut && simSerialOut != stderr) fclose(simSerialOut);
+  if (eeprom && !simEepromSave(eeprom)) {
+    perror(eeprom);
+    return 1;
+  }
+  return 0;
+}
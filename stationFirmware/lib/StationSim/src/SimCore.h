@@ -0,0 +1,128 @@
+// Virtual clock, scenario and energy accounting for the host-native build of the station firmware
+#ifndef SIM_CORE_H
+#define SIM_CORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// What the station is doing while virtual time passes - one bucket per power state in the report
+enum SimActivity : uint8_t {
+  SIM_ACTIVE = 0,   // CPU running - firmware code, I2C transfers, EEPROM writes
+  SIM_BUSY_WAIT,    // CPU spinning inside delay()
+  SIM_IDLE,         // CPU in idle sleep, Timer0 (millis) running
+  SIM_SLEEP,        // MCU in power-down, Timer0 (millis) stopped
+  SIM_TX,           // radio transmitting
+  SIM_RX,           // radio listening in the RX1/RX2 windows
+  SIM_ACTIVITY_COUNT
+};
+
+// Supply current of the whole station per state (mA) - used for the mAh estimate
+struct SimCurrents {
+  float active;
+  float busyWait;
+  float idle;
+  float sleep;
+  float tx;        // at +14 dBm
+  float txPerDb;   // less per dB of TX power below that
+  float rx;
+  float spsFan;     // added on top while the SPS30 is measuring
+};
+
+#define SIM_MAX_DOWNLINK 51
+#define SIM_MAX_SCRIPTED_DOWNLINKS 64
+
+struct SimDownlink {
+  uint32_t afterUplink;   // deliver in the RX window of this uplink (1 = first uplink after power-on), 0 = by time
+  uint32_t atSeconds;     // with afterUplink 0: queued at the network this long after power-on
+  uint8_t  port;
+  uint8_t  size;
+  uint8_t  data[SIM_MAX_DOWNLINK];
+};
+
+struct SimScenario {
+  uint32_t startUnixUtc;      // true UTC time at power-on
+  uint32_t durationSeconds;   // stop the run after this much virtual time
+  uint32_t maxCycles;         // stop after this many loop() calls, 0 = unlimited
+  int8_t   timezoneHours;     // has to match TIMEZONE_OFFSET_HOURS for the RTC error column
+  bool     rtcLostPower;      // RTC reports lost power on the first boot
+  int32_t  rtcInitialErrorMs; // RTC offset against true local time at power-on
+  float    rtcDriftPpm;       // positive = RTC runs fast
+  float    wdtErrorPercent;   // WDT oscillator deviation from the nominal period, positive = slow
+  uint16_t joinFailures;      // join requests that get no JoinAccept
+  int32_t  devNonceHeard;     // last DevNonce the network heard before power-on, join requests need a higher one - -1 = none
+  uint16_t timeReqFailures;   // DeviceTimeReq that get no DeviceTimeAns
+  float    uplinkLossPercent;   // uplinks and join requests no gateway hears
+  uint32_t gatewayDownSeconds;  // no gateway hears anything this long after power-on
+  float    downlinkLossPercent; // answers the station does not receive - the network counts them as sent
+  uint16_t networkLatencyMs;    // network server answer after the end of the uplink - RX1 is missed from the RX1 delay on
+  uint16_t networkJitterMs;     // uniform extra latency up to this
+  float    linkSnrDb;           // SNR of a frame sent at 14 dBm, at the gateway and at the station
+  float    linkSnrJitterDb;     // uniform fading of each frame, +- this
+  uint16_t spsErrorReads;     // SPS30 data ready reads that fail
+  uint16_t spsSpikeReads;     // every n-th SPS30 measurement is a single sample spike of 5x, 0 = none
+  uint32_t powerLossEepromWrite; // power fails instead of this EEPROM write (1 = first), 0 = never
+  uint32_t seed;
+  bool     verbose;
+  SimCurrents current;
+  uint8_t  downlinkCount;
+  SimDownlink downlinks[SIM_MAX_SCRIPTED_DOWNLINKS];
+};
+
+// Totals for one report line (setup() or one loop() call)
+struct SimCycle {
+  uint64_t startUs;
+  uint64_t us[SIM_ACTIVITY_COUNT];
+  uint64_t fanOnUs;
+  uint64_t txDbBelowMaxUs;  // TX time weighted by the dB below +14 dBm
+  uint16_t uplinks;
+  uint16_t downlinks;
+  uint16_t eepromWrites;
+  uint16_t wdtWakeups;
+  uint16_t rtcWakeups;
+};
+
+extern SimScenario simScenario;
+// Serial output - stderr unless --serial FILE, NULL with --no-serial (no host has the port open)
+extern FILE *simSerialOut;
+
+// thrown from inside firmware calls once the scenario has run out of virtual time
+struct SimEnd {};
+
+// virtual time
+uint64_t simTrueMicros();                 // true time since power-on
+uint32_t simTrueUnixUtc();                // true UTC epoch
+uint32_t simMillis();                     // Timer0 based, frozen while sleeping
+uint32_t simMicros();
+void simAdvance(uint64_t us, SimActivity activity);
+
+// device hooks
+void simSetFan(bool on);
+void simSetTxPower(uint8_t dbm);
+bool simFanOn();
+void simCountUplink();
+void simCountDownlink();
+void simCountEepromWrite();
+// EEPROM image kept across runs - a run that starts from the image of the last one is a power cycle
+bool simEepromLoad(const char *path);
+bool simEepromSave(const char *path);
+void simCountWdtWakeup();
+void simCountRtcWakeup();
+// I2C transfers on the simulated bus - false if no device acknowledges the address
+bool simI2cWrite(uint8_t address, const uint8_t *data, uint8_t length);
+bool simI2cRead(uint8_t address, uint8_t *data, uint8_t length);
+bool simHtuI2cWrite(const uint8_t *data, uint8_t length);
+bool simHtuI2cRead(uint8_t *data, uint8_t length);
+bool simSpsI2cWrite(const uint8_t *data, uint8_t length);
+bool simSpsI2cRead(uint8_t *data, uint8_t length);
+bool simRtcI2cWrite(const uint8_t *data, uint8_t length);
+bool simRtcI2cRead(uint8_t *data, uint8_t length);
+void simRecordUplink(uint8_t port, const uint8_t *payload, uint8_t length);
+int64_t simNetworkLocalMillis();          // network time in the station's time zone - what a synced clock shows
+void simLog(const char *fmt, ...);
+uint32_t simRandom();
+
+// airtime of a LoRa frame in microseconds (EU868, CR 4/5, explicit header, 8 symbol preamble) - downlinks have no CRC
+uint32_t simLoRaAirtimeMicros(uint8_t spreadingFactor, uint16_t bandwidthKHz, uint8_t phyPayloadLength, bool crc = true);
+
+#endif
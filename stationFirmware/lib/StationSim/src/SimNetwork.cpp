@@ -0,0 +1,320 @@
+// Network server stand-in: gateway and LoRaWAN 1.0.x class A network server of TTN in EU868
+//
+// Answers join requests, DeviceTimeReq with the GPS time of the end of the uplink, and delivers queued downlinks
+// one per uplink, like TTN. A downlink is queued from its uplink number or from a time after power-on, so a
+// config change the operator schedules waits for the next uplink the network hears. The answer leaves the
+// network server networkLatencyMs (+ jitter) after the end of the uplink: in time for RX1 below the RX1 delay,
+// for RX2 below one second more, otherwise the window is missed - a downlink stays queued, a DeviceTimeAns or
+// JoinAccept is gone. Lost uplinks are never heard, lost downlinks count as sent. Loss uses its own random
+// generator, so changing it leaves the sensor noise alone.
+//
+// The link has an SNR of linkSnrDb (+- linkSnrJitterDb per frame) for a frame sent at 14 dBm, both ways. A frame
+// below the demodulation floor of its data rate is not heard, the station's TX power below 14 dBm takes off as much.
+// LinkCheckAns report the margin of the uplink above the floor, as TTN does with one gateway.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SimNetwork.h"
+
+#define SIM_GPS_TO_UNIX_OFFSET  315964800UL
+#define SIM_GPS_LEAP_SECONDS    18
+#define SIM_RX2_DELAY_MS        1000UL   // after RX1
+#define SIM_RX2_DATA_RATE       3        // SF9BW125
+#define SIM_GATEWAY_POWER_DBM   14
+#define SIM_NOISE_FLOOR_DBM     -117     // 125 kHz, 6 dB noise figure
+
+enum DownlinkState : uint8_t { DOWNLINK_WAITING = 0, DOWNLINK_DELIVERED, DOWNLINK_LOST, DOWNLINK_ANSWERED };
+
+struct DownlinkStatus {
+  DownlinkState state;
+  bool queued;
+  uint64_t queuedUs;      // became due - its time, or its uplink
+  uint64_t deliveredUs;
+};
+
+static uint32_t rngState = 1;
+static FILE *radioLog = NULL;
+static uint16_t joinRequests = 0;
+static uint16_t timeRequests = 0;
+static bool devNonceHeard = false;
+static uint16_t lastDevNonce = 0;
+static DownlinkStatus downlinks[SIM_MAX_SCRIPTED_DOWNLINKS];
+
+// benchmark figures
+static uint64_t joinedUs = 0;
+static uint16_t joinRequestsToJoin = 0;
+static uint16_t devNonceRejects = 0;
+static uint32_t framesSent = 0, framesHeard = 0, answersRx2 = 0, answersLate = 0, answersLost = 0;
+static uint32_t clockSets = 0;
+static double clockErrorAbsSumMs = 0;
+static int64_t clockErrorMaxMs = 0;
+static uint32_t configAnswered = 0;
+static uint32_t linkChecks = 0, linkChecksAnswered = 0, framesBelowFloor = 0;
+static double linkMarginSumDb = 0;
+static double configLatencySumS = 0, configLatencyMaxS = 0;
+
+static double randomUnit() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState / 4294967296.0;
+}
+
+static bool chance(float percent) { return percent > 0 && randomUnit() * 100.0 < percent; }
+
+// SNR of a frame sent at 14 dBm - the fading of this frame
+static double linkSnrDb() {
+  double snr = simScenario.linkSnrDb;
+  if (simScenario.linkSnrJitterDb > 0) snr += (2.0 * randomUnit() - 1.0) * simScenario.linkSnrJitterDb;
+  return snr;
+}
+
+// lowest SNR the gateway and the station demodulate at a data rate (SX1276: SF7 -7.5 dB ... SF12 -20 dB)
+static double snrFloorDb(uint8_t dataRate) {
+  uint8_t sf = dataRate >= 5 ? 7 : 12 - dataRate;
+  return -7.5 - 2.5 * (sf - 7);
+}
+
+// no gateway hears the frame - it is down, the frame is lost on the air or below the floor; snrDb is its SNR
+static bool notHeard(uint8_t dataRate, uint8_t txPowerDbm, double &snrDb) {
+  snrDb = linkSnrDb() - (SIM_GATEWAY_POWER_DBM - txPowerDbm);
+  if (simTrueMicros() < simScenario.gatewayDownSeconds * 1000000ULL || chance(simScenario.uplinkLossPercent)) return true;
+  if (snrDb < snrFloorDb(dataRate)) {
+    framesBelowFloor++;
+    return true;
+  }
+  return false;
+}
+
+static double seconds(uint64_t us) { return us / 1e6; }
+
+void simNetworkBegin(uint32_t seed) {
+  rngState = (seed ? seed : 1) ^ 0x9E3779B9UL;
+  memset(downlinks, 0, sizeof(downlinks));
+  devNonceHeard = simScenario.devNonceHeard >= 0;
+  lastDevNonce = devNonceHeard ? (uint16_t)simScenario.devNonceHeard : 0;
+}
+
+bool simNetworkOpenLog(const char *path) {
+  radioLog = fopen(path, "w");
+  if (radioLog) fprintf(radioLog, "time_s,event,fport,length,window,rx_s,value,detail\n");
+  return radioLog != NULL;
+}
+
+void simNetworkCloseLog() {
+  if (radioLog) fclose(radioLog);
+  radioLog = NULL;
+}
+
+static void logEvent(const char *event, int port, int length, int window, double rxS, double value, const char *detail) {
+  if (!radioLog) return;
+  fprintf(radioLog, "%.3f,%s,", seconds(simTrueMicros()), event);
+  if (port >= 0) fprintf(radioLog, "%d", port);
+  fputc(',', radioLog);
+  if (length >= 0) fprintf(radioLog, "%d", length);
+  fprintf(radioLog, ",%d,", window);
+  if (window) fprintf(radioLog, "%.3f", rxS);
+  fputc(',', radioLog);
+  if (value == value) fprintf(radioLog, "%.3f", value);   // NaN = none
+  fprintf(radioLog, ",\"%s\"\n", detail);
+}
+
+// window the answer to a frame ending now makes, from the latency of the network server
+static uint8_t answerWindow(uint32_t rx1DelayMs, double &latencyMs) {
+  latencyMs = simScenario.networkLatencyMs + randomUnit() * simScenario.networkJitterMs;
+  if (latencyMs < rx1DelayMs) return 1;
+  if (latencyMs < rx1DelayMs + SIM_RX2_DELAY_MS) return 2;
+  answersLate++;
+  return 0;
+}
+
+static double windowOpensS(uint8_t window, uint32_t rx1DelayMs) {
+  return seconds(simTrueMicros()) + rx1DelayMs / 1000.0 + (window == 2 ? SIM_RX2_DELAY_MS / 1000.0 : 0);
+}
+
+// the station gets the answer, or the radio path loses it - RX1 on the uplink data rate, RX2 on SF9
+static bool delivered(uint8_t &window, uint8_t dataRate, SimNetworkAnswer &answer) {
+  if (window == 0) return false;
+  double snr = linkSnrDb();
+  if (chance(simScenario.downlinkLossPercent) || snr < snrFloorDb(window == 2 ? SIM_RX2_DATA_RATE : dataRate)) {
+    answersLost++;
+    window = 0;
+    return false;
+  }
+  answer.downlinkSnr = (int8_t)floor(snr);
+  answer.downlinkRssi = (int16_t)floor(SIM_NOISE_FLOOR_DBM + snr);
+  if (window == 2) answersRx2++;
+  return true;
+}
+
+SimNetworkAnswer simNetworkJoinRequest(uint16_t devNonce, uint8_t dataRate, uint8_t txPowerDbm, uint32_t rx1DelayMs) {
+  SimNetworkAnswer answer = {};
+  joinRequests++;
+  framesSent++;
+  double snr;
+  if (notHeard(dataRate, txPowerDbm, snr)) {
+    logEvent("join_request", -1, -1, 0, 0, NAN, "not heard");
+    return answer;
+  }
+  framesHeard++;
+  bool reused = devNonceHeard && devNonce <= lastDevNonce;
+  if (!reused) {
+    lastDevNonce = devNonce;
+    devNonceHeard = true;
+  }
+  if (reused || joinRequests <= simScenario.joinFailures) {
+    devNonceRejects += reused;
+    logEvent("join_request", -1, -1, 0, 0, devNonce, reused ? "DevNonce reused" : "rejected");
+    return answer;
+  }
+  double latencyMs;
+  answer.window = answerWindow(rx1DelayMs, latencyMs);
+  double rxS = windowOpensS(answer.window, rx1DelayMs);
+  uint8_t sentIn = answer.window;
+  bool received = delivered(answer.window, dataRate, answer);
+  logEvent("join_request", -1, -1, sentIn, rxS, latencyMs,
+           received ? "JoinAccept" : (sentIn ? "JoinAccept lost" : "JoinAccept late"));
+  if (received && joinedUs == 0) {
+    joinedUs = (uint64_t)(rxS * 1e6);
+    joinRequestsToJoin = joinRequests;
+  }
+  return answer;
+}
+
+// the uplink is the response a downlink asks for - a settings report, a config ack, a trace dump or a time request
+static bool answersDownlink(const SimDownlink &d, uint8_t port, const uint8_t *payload, uint8_t length, bool timeRequest) {
+  switch (d.port) {
+    case 8: return timeRequest;                                                            // forced time sync
+    case 11: return (port == 1 && length == 27) || (port == 5 && length > 0 && (payload[0] & 0x80)); // config ack
+    case 12: return port == 8;                                                             // trace dump
+    default: return port == 4;                                                             // settings report
+  }
+}
+
+SimNetworkAnswer simNetworkUplink(uint32_t uplinkNumber, uint8_t port, const uint8_t *payload, uint8_t length,
+                                  bool timeRequest, bool linkCheckRequest, uint8_t dataRate, uint8_t txPowerDbm,
+                                  uint32_t rx1DelayMs) {
+  SimNetworkAnswer answer = {};
+  framesSent++;
+  for (uint8_t i = 0; i < simScenario.downlinkCount; i++) {
+    const SimDownlink &d = simScenario.downlinks[i];
+    bool due = d.afterUplink ? uplinkNumber >= d.afterUplink : simTrueMicros() >= d.atSeconds * 1000000ULL;
+    if (due && !downlinks[i].queued) {
+      downlinks[i].queued = true;
+      downlinks[i].queuedUs = d.afterUplink ? simTrueMicros() : d.atSeconds * 1000000ULL;
+    }
+  }
+  if (timeRequest) {
+    timeRequests++;
+  }
+  linkChecks += linkCheckRequest;
+  double snr;
+  if (notHeard(dataRate, txPowerDbm, snr)) {
+    logEvent("uplink", port, length, 0, 0, NAN, "not heard");
+    return answer;
+  }
+  framesHeard++;
+  double margin = floor(snr - snrFloorDb(dataRate));
+  if (linkCheckRequest) {
+    char detail[32];
+    snprintf(detail, sizeof(detail), "SF%u %u dBm", dataRate >= 5 ? 7 : 12 - dataRate, txPowerDbm);
+    logEvent("link_check", -1, -1, 0, 0, margin, detail);
+  }
+
+  for (uint8_t i = 0; i < simScenario.downlinkCount; i++) {
+    DownlinkStatus &s = downlinks[i];
+    if (s.state == DOWNLINK_DELIVERED && answersDownlink(simScenario.downlinks[i], port, payload, length, timeRequest)) {
+      s.state = DOWNLINK_ANSWERED;
+      double latencyS = seconds(simTrueMicros() - s.queuedUs);
+      configAnswered++;
+      configLatencySumS += latencyS;
+      if (latencyS > configLatencyMaxS) configLatencyMaxS = latencyS;
+      char detail[96];
+      snprintf(detail, sizeof(detail), "queued at %.3f s, delivered at %.3f s", seconds(s.queuedUs), seconds(s.deliveredUs));
+      logEvent("config_answered", simScenario.downlinks[i].port, -1, 0, 0, latencyS, detail);
+    }
+  }
+
+  int8_t next = -1;   // oldest queued downlink - the network sends one per uplink
+  for (uint8_t i = 0; i < simScenario.downlinkCount && next < 0; i++) {
+    if (downlinks[i].state == DOWNLINK_WAITING && downlinks[i].queued) next = i;
+  }
+  bool timeAnswered = timeRequest && timeRequests > simScenario.timeReqFailures;
+  if (!timeAnswered && !linkCheckRequest && next < 0) {
+    logEvent("uplink", port, length, 0, 0, NAN, timeRequest ? "DeviceTimeReq unanswered" : "");
+    return answer;
+  }
+
+  double latencyMs;
+  answer.window = answerWindow(rx1DelayMs, latencyMs);
+  double rxS = windowOpensS(answer.window, rx1DelayMs);
+  uint8_t sentIn = answer.window;
+  char detail[64];
+  snprintf(detail, sizeof(detail), "%s%s%s", timeAnswered ? "DeviceTimeAns" : "",
+           linkCheckRequest ? (timeAnswered ? "+LinkCheckAns" : "LinkCheckAns") : "",
+           next >= 0 ? (timeAnswered || linkCheckRequest ? "+downlink" : "downlink") : "");
+  if (sentIn == 0) {
+    strncat(detail, " late", sizeof(detail) - strlen(detail) - 1);   // a downlink stays queued
+    logEvent("uplink", port, length, 0, 0, latencyMs, detail);
+    return answer;
+  }
+  if (next >= 0) {
+    downlinks[next].state = DOWNLINK_DELIVERED;   // sent - whether it arrives or not
+    downlinks[next].deliveredUs = (uint64_t)(rxS * 1e6);
+  }
+  if (!delivered(answer.window, dataRate, answer)) {
+    if (next >= 0) downlinks[next].state = DOWNLINK_LOST;
+    strncat(detail, " lost", sizeof(detail) - strlen(detail) - 1);
+    logEvent("uplink", port, length, sentIn, rxS, latencyMs, detail);
+    return answer;
+  }
+  logEvent("uplink", port, length, sentIn, rxS, latencyMs, detail);
+  answer.timeAnswered = timeAnswered;
+  answer.gpsAtTxEndUs = ((uint64_t)simScenario.startUnixUtc - SIM_GPS_TO_UNIX_OFFSET + SIM_GPS_LEAP_SECONDS) * 1000000ULL + simTrueMicros();
+  answer.downlink = next >= 0 ? &simScenario.downlinks[next] : NULL;
+  if (linkCheckRequest) {
+    answer.linkCheckAnswered = true;
+    answer.margin = (uint8_t)(margin < 0 ? 0 : (margin > 254 ? 254 : margin));
+    answer.gateways = 1;
+    linkChecksAnswered++;
+    linkMarginSumDb += answer.margin;
+  }
+  return answer;
+}
+
+void simNetworkClockSet(int64_t errorMs) {
+  clockSets++;
+  int64_t magnitude = errorMs < 0 ? -errorMs : errorMs;
+  clockErrorAbsSumMs += magnitude;
+  if (magnitude > clockErrorMaxMs) clockErrorMaxMs = magnitude;
+  logEvent("clock_set", -1, -1, 0, 0, (double)errorMs, "");
+}
+
+void simNetworkSummary() {
+  uint32_t lost = 0, unanswered = 0;
+  for (uint8_t i = 0; i < simScenario.downlinkCount; i++) {
+    lost += downlinks[i].state == DOWNLINK_LOST;
+    unanswered += downlinks[i].state == DOWNLINK_DELIVERED || downlinks[i].state == DOWNLINK_WAITING;
+  }
+  if (joinedUs) fprintf(stderr, "  network    joined after %.1f s, %u join requests\n", seconds(joinedUs), joinRequestsToJoin);
+  else fprintf(stderr, "  network    not joined, %u join requests\n", joinRequests);
+  if (devNonceRejects) fprintf(stderr, "             %u join requests rejected for a reused DevNonce\n", devNonceRejects);
+  fprintf(stderr, "             %u of %u frames heard, answers %u in RX2, %u late, %u lost\n", framesHeard, framesSent,
+          answersRx2, answersLate, answersLost);
+  if (framesBelowFloor) fprintf(stderr, "             %u frames below the demodulation floor\n", framesBelowFloor);
+  if (linkChecks) {
+    fprintf(stderr, "             %u of %u link checks answered", linkChecksAnswered, linkChecks);
+    if (linkChecksAnswered) fprintf(stderr, ", margin %.1f dB mean", linkMarginSumDb / linkChecksAnswered);
+    fputc('\n', stderr);
+  }
+  if (clockSets) {
+    fprintf(stderr, "             %u clock settings, error %.1f ms mean, %lld ms max\n", clockSets,
+            clockErrorAbsSumMs / clockSets, (long long)clockErrorMaxMs);
+  }
+  if (simScenario.downlinkCount) {
+    fprintf(stderr, "             %u downlinks answered", configAnswered);
+    if (configAnswered) fprintf(stderr, " after %.1f s mean, %.1f s max", configLatencySumS / configAnswered, configLatencyMaxS);
+    fprintf(stderr, ", %u lost, %u not answered\n", lost, unanswered);
+  }
+}
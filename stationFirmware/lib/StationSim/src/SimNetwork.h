@@ -0,0 +1,38 @@
+// Network server stand-in for the host-native build - what the gateways and the network server answer to the
+// frames of the simulated radio
+#ifndef SIM_NETWORK_H
+#define SIM_NETWORK_H
+
+#include <stdint.h>
+#include "SimCore.h"
+
+// answer to a frame that has just ended on the air
+struct SimNetworkAnswer {
+  uint8_t window;               // receive window it arrives in - 1 = RX1, 2 = RX2, 0 = none
+  bool timeAnswered;            // carries a DeviceTimeAns
+  uint64_t gpsAtTxEndUs;        // GPS time at the end of the uplink, as the DeviceTimeAns dates it
+  const SimDownlink *downlink;  // application downlink, NULL = none
+  bool linkCheckAnswered;       // carries a LinkCheckAns
+  uint8_t margin;               // LinkCheckAns - dB of the uplink above the demodulation floor
+  uint8_t gateways;
+  int8_t downlinkSnr;           // signal of the answer at the station
+  int16_t downlinkRssi;
+};
+
+void simNetworkBegin(uint32_t seed);
+// --radio: one CSV line per frame, clock setting and answered config change
+bool simNetworkOpenLog(const char *path);
+void simNetworkCloseLog();
+
+// join request - window carries the JoinAccept, a DevNonce not above the last one heard gets none (LoRaWAN 1.0.4)
+SimNetworkAnswer simNetworkJoinRequest(uint16_t devNonce, uint8_t dataRate, uint8_t txPowerDbm, uint32_t rx1DelayMs);
+// uplink number uplinkNumber since power-on (counted by the station, heard or not) at dataRate and txPowerDbm
+SimNetworkAnswer simNetworkUplink(uint32_t uplinkNumber, uint8_t port, const uint8_t *payload, uint8_t length,
+                                  bool timeRequest, bool linkCheckRequest, uint8_t dataRate, uint8_t txPowerDbm,
+                                  uint32_t rx1DelayMs);
+// the station set its clock to errorMs from network time
+void simNetworkClockSet(int64_t errorMs);
+// join time, clock accuracy and config latency to stderr
+void simNetworkSummary();
+
+#endif
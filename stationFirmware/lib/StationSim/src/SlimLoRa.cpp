@@ -0,0 +1,169 @@
+// SlimLoRa stand-in: radio timing on the virtual clock, the network behind it is SimNetwork
+//
+// Timing follows LoRaWAN 1.0.x class A in EU868 on TTN: RX1 one second (join: five seconds)
+// after the end of the uplink on the uplink data rate, RX2 one second later on SF9BW125.
+// The session lives in the simulated EEPROM (byte 0 = joined marker), so clearing the
+// SlimLoRa EEPROM area drops the session just like on the station - and resets the DevNonce with it.
+#include <stdio.h>
+#include <Arduino.h>
+#include <SlimLoRa.h>
+#include "SimCore.h"
+#include "SimNetwork.h"
+
+#define SIM_SESSION_MARKER_ADDR 0
+#define SIM_SESSION_MARKER      0x01
+#define SIM_FCNT_ADDR           3
+#define SIM_DEVNONCE_ADDR       5
+
+#define SIM_RX1_DELAY_MS        1000UL
+#define SIM_JOIN_RX1_DELAY_MS   5000UL
+#define SIM_RX_TIMEOUT_SYMBOLS  8
+#define SIM_RX2_DATA_RATE       SF9BW125
+
+#define SIM_LORAWAN_OVERHEAD    13    // MHDR + DevAddr + FCtrl + FCnt + FPort + MIC
+#define SIM_JOIN_REQUEST_LENGTH 23
+#define SIM_JOIN_ACCEPT_LENGTH  17
+#define SIM_DEVICE_TIME_ANS_LENGTH 6
+#define SIM_LINK_CHECK_ANS_LENGTH  3
+
+static uint16_t joinAttempts = 0;
+static uint32_t uplinkCount = 0;
+static bool joinedThisBoot = false;
+
+static uint8_t spreadingFactor(uint8_t dr) { return dr >= SF7BW125 ? 7 : 12 - dr; }
+static uint16_t bandwidthKHz(uint8_t dr) { return dr == SF7BW250 ? 250 : 125; }
+
+static uint32_t airtimeUs(uint8_t dr, uint8_t phyLength, bool crc = true) {
+  return simLoRaAirtimeMicros(spreadingFactor(dr), bandwidthKHz(dr), phyLength, crc);
+}
+
+static uint32_t symbolUs(uint8_t dr) { return ((uint32_t)1 << spreadingFactor(dr)) * 1000UL / bandwidthKHz(dr); }
+
+// listen in one receive window, returns after the frame or the symbol timeout
+static void receiveWindow(uint8_t dr, uint8_t phyLength) {
+  uint32_t us = phyLength ? airtimeUs(dr, phyLength, false) : SIM_RX_TIMEOUT_SYMBOLS * symbolUs(dr);
+  simAdvance(us, SIM_RX);
+}
+
+// RX1 and - if nothing arrived - RX2 after a frame that has just ended; window 1 or 2 brings downLength bytes
+static void receiveWindows(uint8_t dr, uint32_t rx1DelayMs, uint8_t window, uint8_t downLength) {
+  simAdvance(rx1DelayMs * 1000ULL, SIM_BUSY_WAIT);
+  if (window == 1) {
+    receiveWindow(dr, downLength);
+    simCountDownlink();
+    return;
+  }
+  receiveWindow(dr, 0);
+  uint64_t rx1Us = SIM_RX_TIMEOUT_SYMBOLS * (uint64_t)symbolUs(dr);
+  simAdvance(1000000ULL - rx1Us, SIM_BUSY_WAIT);
+  receiveWindow(SIM_RX2_DATA_RATE, window == 2 ? downLength : 0);
+  if (window == 2) {
+    simCountDownlink();
+  }
+}
+
+SlimLoRa::SlimLoRa(uint8_t)
+    : LoRaWANreceived(0), TimeLinkCheck(0), epoch(0), fracSecond(0), LinkMargin(0), LinkGateways(0), packetSnr(0),
+      packetRssi(0), downPort(0), downlinkSize(0), data_rate_(SF7BW125), tx_power_(14) {
+  memset(downlinkData, 0, sizeof(downlinkData));
+}
+
+void SlimLoRa::Begin(void) {
+  simAdvance(2000, SIM_ACTIVE);
+  joinedThisBoot = GetHasJoined();
+}
+
+void SlimLoRa::Join() {
+  joinAttempts++;
+  uint16_t devNonce = GetDevNonce() == 0xFFFF ? 0 : GetDevNonce() + 1;   // LoRaWAN 1.0.4 counter
+  SetDevNonce(devNonce);
+  simSetTxPower(tx_power_);
+  simAdvance(airtimeUs(data_rate_, SIM_JOIN_REQUEST_LENGTH), SIM_TX);
+  simCountUplink();
+  SimNetworkAnswer answer = simNetworkJoinRequest(devNonce, data_rate_, tx_power_, SIM_JOIN_RX1_DELAY_MS);
+  receiveWindows(data_rate_, SIM_JOIN_RX1_DELAY_MS, answer.window, SIM_JOIN_ACCEPT_LENGTH);
+  simLog("join request %u, DevNonce %u %s", joinAttempts, devNonce, answer.window ? "accepted" : "unanswered");
+  if (answer.window) {
+    EEPROM.write(SIM_SESSION_MARKER_ADDR, SIM_SESSION_MARKER);
+    joinedThisBoot = true;
+  }
+}
+
+bool SlimLoRa::HasJoined(void) { return joinedThisBoot; }
+
+bool SlimLoRa::GetHasJoined() { return EEPROM.read(SIM_SESSION_MARKER_ADDR) == SIM_SESSION_MARKER; }
+
+uint16_t SlimLoRa::GetDevNonce() { return EEPROM.read(SIM_DEVNONCE_ADDR) | EEPROM.read(SIM_DEVNONCE_ADDR + 1) << 8; }
+
+void SlimLoRa::SetDevNonce(uint16_t dev_nonce) {
+  EEPROM.update(SIM_DEVNONCE_ADDR, (uint8_t)dev_nonce);
+  EEPROM.update(SIM_DEVNONCE_ADDR + 1, (uint8_t)(dev_nonce >> 8));
+}
+
+void SlimLoRa::SetDataRate(uint8_t dr) { data_rate_ = dr; }
+
+uint8_t SlimLoRa::GetDataRate() { return data_rate_; }
+
+void SlimLoRa::SetPower(uint8_t power) { tx_power_ = power; }
+
+void SlimLoRa::SendData(uint8_t fport, uint8_t *payload, uint8_t payload_length) {
+  downlinkSize = 0;
+  if (!joinedThisBoot) {
+    simLog("uplink on port %u dropped - not joined", fport);
+    return;
+  }
+  uplinkCount++;
+  simRecordUplink(fport, payload, payload_length);
+  bool timeRequested = TimeLinkCheck & 0x01;
+  bool linkCheckRequested = TimeLinkCheck & 0x02;
+  uint8_t fOptsLength = timeRequested + linkCheckRequested;   // DeviceTimeReq, LinkCheckReq - one byte each
+  TimeLinkCheck = 0;
+  uint8_t upLength = SIM_LORAWAN_OVERHEAD + fOptsLength + payload_length;
+  simSetTxPower(tx_power_);
+  simAdvance(airtimeUs(data_rate_, upLength), SIM_TX);
+  simCountUplink();
+  SimNetworkAnswer answer = simNetworkUplink(uplinkCount, fport, payload, payload_length, timeRequested, linkCheckRequested,
+                                             data_rate_, tx_power_, SIM_RX1_DELAY_MS);
+  const SimDownlink *scripted = answer.downlink;
+  uint8_t downLength = 0;
+  if (answer.window) {
+    downLength = SIM_LORAWAN_OVERHEAD - 1 + (answer.timeAnswered ? SIM_DEVICE_TIME_ANS_LENGTH : 0) +
+                 (answer.linkCheckAnswered ? SIM_LINK_CHECK_ANS_LENGTH : 0);
+    if (scripted) downLength += 1 + scripted->size;
+  }
+  // RX2 answers come on SF9 - the DeviceTimeAns dates the end of the uplink either way
+  receiveWindows(data_rate_, SIM_RX1_DELAY_MS, answer.window, downLength);
+  EEPROM.update(SIM_FCNT_ADDR, (uint8_t)uplinkCount);
+  EEPROM.update(SIM_FCNT_ADDR + 1, (uint8_t)(uplinkCount >> 8));
+
+  simLog("uplink %lu on port %u, %u bytes, SF%u %u dBm%s%s%s%s", (unsigned long)uplinkCount, fport, payload_length,
+         spreadingFactor(data_rate_), tx_power_,
+         timeRequested ? (answer.timeAnswered ? ", DeviceTimeAns" : ", DeviceTimeReq unanswered") : "",
+         linkCheckRequested ? (answer.linkCheckAnswered ? ", LinkCheckAns" : ", LinkCheckReq unanswered") : "",
+         scripted ? ", downlink" : "", answer.window == 2 ? " in RX2" : "");
+
+  if (answer.window) {
+    packetSnr = answer.downlinkSnr;
+    packetRssi = answer.downlinkRssi;
+  }
+  if (answer.linkCheckAnswered) {
+    LinkMargin = answer.margin;
+    LinkGateways = answer.gateways;
+    LoRaWANreceived |= 0x20;
+  }
+
+  if (answer.timeAnswered) {
+    uint64_t gpsUs = answer.gpsAtTxEndUs;
+#ifdef EPOCH_RX2_WINDOW_OFFSET
+    gpsUs += SIM_RX1_DELAY_MS * 1000ULL;   // assumed: SlimLoRa moves the timestamp to the receive window
+#endif
+    epoch = (uint32_t)(gpsUs / 1000000ULL);
+    fracSecond = (uint8_t)((gpsUs % 1000000ULL) * 256ULL / 1000000ULL);
+    LoRaWANreceived |= 0x40;
+  }
+  if (scripted) {
+    downPort = scripted->port;
+    downlinkSize = scripted->size;
+    memcpy(downlinkData, scripted->data, scripted->size);
+  }
+}
@@ -0,0 +1,57 @@
+// SlimLoRa (v0.7.5 API subset) stand-in for the host-native simulation - frames go to a scripted network
+#ifndef SLIMLORA_H
+#define SLIMLORA_H
+
+#include <stdint.h>
+#include <EEPROM.h>
+
+// EU868 data rates
+#define SF12BW125   0x00
+#define SF11BW125   0x01
+#define SF10BW125   0x02
+#define SF9BW125    0x03
+#define SF8BW125    0x04
+#define SF7BW125    0x05
+#define SF7BW250    0x06
+
+#define EEPROM_END  152 // SlimLoRa session storage occupies EEPROM 0-151
+
+#define LORAWAN_FOPTS_MAX_SIZE 15
+
+class SlimLoRa {
+  public:
+    SlimLoRa(uint8_t pin_nss);
+    void Begin(void);
+    void Join();
+    bool HasJoined(void);
+    bool GetHasJoined();
+    void SendData(uint8_t fport, uint8_t *payload, uint8_t payload_length);
+    void SetDataRate(uint8_t dr);
+    uint8_t GetDataRate();
+    void SetPower(uint8_t power);
+
+    // SLIM_DEBUG_VARS / EPOCH_RX2_WINDOW_OFFSET
+    uint8_t  LoRaWANreceived;   // 0x40 = DeviceTimeAns, 0x20 = LinkCheckAns (assumed)
+    uint8_t  TimeLinkCheck;     // 0x01 = DeviceTimeReq, 0x02 = LinkCheckReq (assumed) with the next uplink
+    uint32_t epoch;
+    uint8_t  fracSecond;
+
+    // assumed: the LinkCheckAns and the signal of the last downlink as the SX1276 measured it
+    uint8_t  LinkMargin;        // dB above the demodulation floor at the gateway
+    uint8_t  LinkGateways;
+    int8_t   packetSnr;         // dB
+    int16_t  packetRssi;        // dBm
+
+    uint8_t  downPort;
+    uint8_t  downlinkSize;
+    uint8_t  downlinkData[51];
+
+  private:
+    // DevNonce of the last join request in the session area, 0xFFFF when it is erased - the library keeps it itself
+    uint16_t GetDevNonce();
+    void SetDevNonce(uint16_t dev_nonce);
+    uint8_t data_rate_;
+    uint8_t tx_power_;
+};
+
+#endif
@@ -0,0 +1,16 @@
+// Software clock (TimeLib) for the host-native simulation - counts millis(), so it stops while the MCU sleeps
+#ifndef TIMELIB_H
+#define TIMELIB_H
+
+#include <stdint.h>
+
+uint32_t now();
+void setTime(uint32_t t);
+int year();
+int month();
+int day();
+int hour();
+int minute();
+int second();
+
+#endif
@@ -0,0 +1,57 @@
+// I2C bus at 100 kHz - every transfer takes the time of its bytes, unknown addresses are not acknowledged
+#include <Wire.h>
+#include "SimCore.h"
+
+#define SIM_I2C_BYTE_US 90UL   // 9 clocks per byte
+#define SIM_HTU21D_ADDRESS 0x40
+#define SIM_DS3231_ADDRESS 0x68
+#define SIM_SPS30_ADDRESS 0x69
+
+TwoWire Wire;
+
+bool simI2cWrite(uint8_t address, const uint8_t *data, uint8_t length) {
+  simAdvance((length + 1) * SIM_I2C_BYTE_US, SIM_ACTIVE);
+  if (address == SIM_DS3231_ADDRESS) return simRtcI2cWrite(data, length);
+  if (address == SIM_SPS30_ADDRESS) return simSpsI2cWrite(data, length);
+  return address == SIM_HTU21D_ADDRESS && simHtuI2cWrite(data, length);
+}
+
+bool simI2cRead(uint8_t address, uint8_t *data, uint8_t length) {
+  simAdvance((length + 1) * SIM_I2C_BYTE_US, SIM_ACTIVE);
+  if (address == SIM_DS3231_ADDRESS) return simRtcI2cRead(data, length);
+  if (address == SIM_SPS30_ADDRESS) return simSpsI2cRead(data, length);
+  return address == SIM_HTU21D_ADDRESS && simHtuI2cRead(data, length);
+}
+
+void TwoWire::beginTransmission(uint8_t to) {
+  address = to;
+  txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+  if (txLength >= SIM_WIRE_BUFFER) return 0;
+  txBuffer[txLength++] = value;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t length) {
+  size_t n = 0;
+  while (n < length && write(data[n])) n++;
+  return n;
+}
+
+uint8_t TwoWire::endTransmission(bool) {
+  if (!enabled) return 4;
+  return simI2cWrite(address, txBuffer, txLength) ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t from, uint8_t quantity, bool) {
+  if (quantity > SIM_WIRE_BUFFER) quantity = SIM_WIRE_BUFFER;
+  rxIndex = 0;
+  rxLength = enabled && simI2cRead(from, rxBuffer, quantity) ? quantity : 0;
+  return rxLength;
+}
+
+int TwoWire::available() { return rxLength - rxIndex; }
+
+int TwoWire::read() { return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1; }
@@ -0,0 +1,34 @@
+// Arduino Wire (TwoWire) for the host-native simulation - transfers go to the device models via simI2cWrite/Read
+#ifndef WIRE_H
+#define WIRE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SIM_WIRE_BUFFER 32
+
+class TwoWire {
+  public:
+    void begin() { enabled = true; }
+    void setClock(uint32_t) {}
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t value);
+    size_t write(const uint8_t *data, size_t length);
+    uint8_t endTransmission(bool sendStop = true);   // 0 = ok, 2 = address NACK, 4 = bus not begun
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+    int available();
+    int read();
+
+  private:
+    bool enabled = false;   // transfers before begin() fail like on an uninitialized TWI
+    uint8_t address = 0;
+    uint8_t txLength = 0;
+    uint8_t rxLength = 0;
+    uint8_t rxIndex = 0;
+    uint8_t txBuffer[SIM_WIRE_BUFFER];
+    uint8_t rxBuffer[SIM_WIRE_BUFFER];
+};
+
+extern TwoWire Wire;
+
+#endif
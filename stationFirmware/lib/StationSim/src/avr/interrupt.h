@@ -0,0 +1,12 @@
+// Interrupt control for the host-native simulation - vectors are ordinary functions called by the simulator
+#ifndef AVR_INTERRUPT_H
+#define AVR_INTERRUPT_H
+
+#include "io.h"
+
+#define ISR(vector) extern "C" void vector(void); extern "C" void vector(void)
+
+inline void cli() {}
+inline void sei() {}
+
+#endif
@@ -0,0 +1,22 @@
+// ATmega32u4 registers the firmware touches, backed by plain variables on the host
+#ifndef AVR_IO_H
+#define AVR_IO_H
+
+#include <stdint.h>
+
+extern volatile uint8_t MCUSR;
+extern volatile uint8_t WDTCSR;
+
+// MCUSR
+#define WDRF 3
+// WDTCSR
+#define WDIF 7
+#define WDIE 6
+#define WDP3 5
+#define WDCE 4
+#define WDE  3
+#define WDP2 2
+#define WDP1 1
+#define WDP0 0
+
+#endif
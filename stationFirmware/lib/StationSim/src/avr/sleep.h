@@ -0,0 +1,15 @@
+// Sleep modes for the host-native simulation - sleep_cpu() hands control to the simulator until a wake-up source fires
+#ifndef AVR_SLEEP_H
+#define AVR_SLEEP_H
+
+#include <stdint.h>
+
+#define SLEEP_MODE_IDLE      0
+#define SLEEP_MODE_PWR_DOWN  2
+
+void set_sleep_mode(uint8_t mode);
+void sleep_enable();
+void sleep_disable();
+void sleep_cpu();
+
+#endif
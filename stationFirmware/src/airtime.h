@@ -0,0 +1,61 @@
+#ifndef AIRTIME_H
+#define AIRTIME_H
+
+#include <stdint.h>
+
+// LoRa time on air (Semtech AN1200.13) of EU868 frames: coding rate 4/5, explicit header, payload CRC on
+// uplinks only, 8 preamble symbols, low data rate optimization at SF11 and SF12 on 125 kHz.
+// All functions are constexpr, so fixed frames are checked at compile time and cost no flash.
+#define LORAWAN_FRAME_OVERHEAD      13 // MHDR + DevAddr + FCtrl + FCnt + FPort + MIC
+#define LORAWAN_JOIN_REQUEST_LENGTH 23
+
+constexpr uint32_t loraSymbolMicros(uint8_t sf, uint16_t bwKHz) {
+  return ((uint32_t)1 << sf) * 1000UL / bwKHz;
+}
+
+constexpr int16_t loraPayloadBits(uint8_t sf, uint8_t phyLength, bool crc = true) {
+  return 8 * (int16_t)phyLength - 4 * sf + 28 + (crc ? 16 : 0);
+}
+
+constexpr int16_t loraBitsPerBlock(uint8_t sf, uint16_t bwKHz) {
+  return 4 * (sf - ((sf >= 11 && bwKHz == 125) ? 2 : 0));
+}
+
+constexpr uint16_t loraPayloadSymbols(uint8_t sf, uint16_t bwKHz, uint8_t phyLength, bool crc = true) {
+  return 8 + (loraPayloadBits(sf, phyLength, crc) > 0
+                  ? (loraPayloadBits(sf, phyLength, crc) + loraBitsPerBlock(sf, bwKHz) - 1) / loraBitsPerBlock(sf, bwKHz) * 5
+                  : 0);
+}
+
+// whole frame including the 12.25 symbol preamble
+constexpr uint32_t loraAirtimeMicros(uint8_t sf, uint16_t bwKHz, uint8_t phyLength, bool crc = true) {
+  return 49 * loraSymbolMicros(sf, bwKHz) / 4 + loraPayloadSymbols(sf, bwKHz, phyLength, crc) * loraSymbolMicros(sf, bwKHz);
+}
+
+// EU868 data rate index as in SlimLoRa: 0 = SF12BW125 ... 5 = SF7BW125, 6 = SF7BW250
+constexpr uint8_t dataRateSpreadingFactor(uint8_t dataRate) {
+  return dataRate >= 5 ? 7 : 12 - dataRate;
+}
+
+constexpr uint16_t dataRateBandwidthKHz(uint8_t dataRate) {
+  return dataRate == 6 ? 250 : 125;
+}
+
+// uplink with payloadLength application bytes and fOptsLength bytes of piggybacked MAC commands
+constexpr uint32_t uplinkAirtimeMicros(uint8_t dataRate, uint8_t payloadLength, uint8_t fOptsLength = 0) {
+  return loraAirtimeMicros(dataRateSpreadingFactor(dataRate), dataRateBandwidthKHz(dataRate),
+                           LORAWAN_FRAME_OVERHEAD + fOptsLength + payloadLength);
+}
+
+// downlink in RX1 at the uplink data rate with fOptsLength bytes of MAC commands and payloadLength
+// application bytes (0 = no FPort either)
+constexpr uint32_t downlinkAirtimeMicros(uint8_t dataRate, uint8_t payloadLength, uint8_t fOptsLength) {
+  return loraAirtimeMicros(dataRateSpreadingFactor(dataRate), dataRateBandwidthKHz(dataRate),
+                           LORAWAN_FRAME_OVERHEAD - 1 + fOptsLength + (payloadLength ? 1 + payloadLength : 0), false);
+}
+
+constexpr uint32_t joinAirtimeMicros(uint8_t dataRate) {
+  return loraAirtimeMicros(dataRateSpreadingFactor(dataRate), dataRateBandwidthKHz(dataRate), LORAWAN_JOIN_REQUEST_LENGTH);
+}
+
+#endif
@@ -1,8 +1,9 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
-#define FIRMWARE_CONFIG_VERSION 1 //go back to 0 if more than 254 (255 -> 0xff is cleared state) change every time you want new configuration to be used and saved to EEPROM!!!
+#define FIRMWARE_CONFIG_VERSION 1 //go back to 0 if more than 254 (255 -> 0xff is cleared state) change every time you want the config.h values to replace the settings saved in EEPROM - new settings in a firmware update do not need it
 #define DEBUG 0
+#define TRACE_BUFFER_SIZE 96 // bytes of RAM for tokenized trace events (trace.h), dumped over serial and by downlink port 12 - 0 = off
 
 //IMPORTANT!!! Enable lora.LoRaWANreceived parameter for lora.timeLinkCheck 
 //for enabling uncoment #define SLIM_DEBUG_VARS in SlimLoRa.h or use buildflag -DSLIM_DEBUG_VARS
@@ -15,6 +16,12 @@
 // Set data rate (LoRa SF + BW combination) – maps to SlimLoRa.h macro
 #define DATA_RATE SF10BW125  //SF7BW125, SF9BW125, SF10BW125, SF11BW125, SF12BW125 when SF12BW125 have max range, but lowest data rate
 
+// Airtime limits - every uplink is accounted, one that would break them waits or is deferred
+#define DUTY_CYCLE_PERCENT             1   // EU868 g1 sub-band - after each uplink the band stays silent for 99x its airtime
+#define AIRTIME_BUDGET_SECONDS_PER_DAY 30  // TTN fair use policy - uplink airtime in a rolling 24 hours
+#define AIRTIME_MAX_WAIT_SECONDS       120 // wait this long at most for the duty cycle, defer the uplink if it needs longer
+#define AIRTIME_CHECK_CONFIG           1   // 1 = do not compile if SEND_INTERVAL_MINUTES at DATA_RATE breaks the limits
+
 //Timekeeping
 const uint32_t GPS_TO_UNIX_OFFSET = 315964800UL;
 #define TIMEZONE_OFFSET_HOURS   2  // UTC+2 central european time
@@ -23,23 +30,52 @@ const uint32_t GPS_TO_UNIX_OFFSET = 315964800UL;
 
 #if USE_HW_RTC
   #define RTC_TYPE RTC_DS3231
+  #define RTC_ALARM_WAKEUP 1 // 1 = deep sleep until a DS3231 alarm, 0 = deep sleep in watchdog timed chunks
+  #define RTC_INT_PIN      1 // DS3231 INT/SQW (open drain, internal pull-up) - INT3; pin 7 is the RFM95 DIO0, 2 and 3 are I2C
+  #define WDT_CALIBRATION_MIN_SECONDS 60   // watchdog sleeps this long or longer re-measure the watchdog period against the RTC
+  #define WDT_TAIL_MILLIS             1000 // watchdog sleeps end this early and wait for the RTC second in 16 ms steps
+  #define RTC_AGING_CORRECTION        1    // 1 = trim the DS3231 aging offset by the drift measured between time syncs
+  #define RTC_SYNC_MAX_ERROR_MILLIS   250  // resync before the measured drift can move the RTC this far from network time
+  #define RTC_RESYNC_MAX_DAYS         30   // longest resync interval the drift measurement may stretch to
   #if DEBUG == 1
     #define SET_RTC_FROM_SERIAL 0 // 1 = set RTC from serial input
     #define TEST_RTC_VS_LORA_TIME 0 // 1 = test RTC vs LoRa time
   #endif
 #endif
 
+#if DEBUG == 1
+  #define BENCHMARK_SFLT16 0 // 1 = measure f2sflt16() cycles on the MCU at startup and print them
+#endif
+
 // Over-the-Air Configurable Settings - change FIRMWARE_CONFIG_VERSION before flashing!!!!!
-#define SEND_INTERVAL_MINUTES               60 // define send interval in minutes !!!keep in multiples of 5 -> 5, 10, 30, 60 !!!
+#define SEND_INTERVAL_MINUTES               60 // define send interval in minutes, multiples of 5 - any length, slots are multiples of it since the Unix epoch
 #define SPS_CLEAN_INTERVAL_DAYS             7  // in days - cleaning interval for the fan
 #define SPS_STABILIZATION_PREREADOUT_DELAY  5  // time in minutes for measurement to start, before data readout if sps30StopAfterReadout is true 
 #define SPS_STOP_AFTER_READOUT              1  // Stop measurement after data readout. If false, it will start sps30StabilizationPreReadoutDelay minutes before the next sendIntervalMinutes slot
 #define REALTIME_RESYNC_INTERVAL_DAYS       7  // in days - time resynchronisation interval for the real time
 #define OVERRIDE_TIME_SYNCHRONIZATION       0  // 0 = send data synchronized with time, 1 = send data based just on time interval 
+#define TIME_SYNC_FREE_RUN_HOURS            72 // failed time syncs are retried in the background - slots stay on the clock this long, then data is sent by interval until a retry gets through
 #define ALLOW_DEEP_SLEEP                    0  // 1 = allow deep sleep, 0 = do not allow deep sleep
-
-
-// Over-the-Air Configurable Settings BACKUP EEPROM ADDRESS
+#define SAMPLES_PER_FRAME                   1  // readings per uplink - 1 = one port 1 uplink per reading, more = delta compressed frames on port 5
+#define DELTA_HEARTBEAT_SLOTS               0  // send on delta - 0 = send every reading, n = send only readings that moved past a threshold, and at least every n-th
+#define DELTA_THRESHOLD_TEMP                5  // send on delta thresholds - 0.1 units (5 = 0.5 degC), 0x80 | n = n % of the value sent last, 0 = field not watched
+#define DELTA_THRESHOLD_HUM                 30 // 3 %RH
+#define DELTA_THRESHOLD_MC_1P0              0
+#define DELTA_THRESHOLD_MC_2P5              (0x80 | 20) // 20 %
+#define DELTA_THRESHOLD_MC_4P0              0
+#define DELTA_THRESHOLD_MC_10P0             (0x80 | 20)
+#define SLOT_OFFSET_SECONDS                 0xFFFF // uplinks of a slot wait this long after the measurement, 0xFFFF = an offset hashed from the DevEUI into the window below
+#define SLOT_OFFSET_WINDOW_SECONDS          300    // spreads a fleet's uplinks over this long after the slot instead of all in its first second, 0 = send at the slot
+#define LINK_ADAPTATION                     0         // 1 = link adaptation below - needs a SlimLoRa that sends LinkCheckReq and exposes LinkMargin, LinkGateways, packetSnr and packetRssi, which 0.7.5 does not
+#define LINK_CHECK_INTERVAL                 6         // a link check rides on every n-th uplink - a LinkCheckReq whose margin moves data rate and TX power within the limits below, a DeviceTimeReq without LINK_ADAPTATION - its answer confirms the stored readings, 0 = none (DATA_RATE at LINK_MAX_POWER_DBM, readings confirmed by time syncs only)
+#define LINK_MIN_DATA_RATE                  DATA_RATE // slowest data rate, and the one fallen back to when link checks go unanswered - below DATA_RATE the AIRTIME_CHECK_CONFIG checks and MULTI_SAMPLE_MAX_LENGTH do not hold, the airtime limits defer uplinks instead
+#define LINK_MAX_DATA_RATE                  SF7BW125  // fastest data rate
+#define LINK_MIN_POWER_DBM                  2         // TX power range in 2 dB steps, 14 = EU868 limit
+#define LINK_MAX_POWER_DBM                  14
+#define LINK_MARGIN_TARGET_DB               10        // keep this much SNR above the demodulation floor of the data rate
+
+
+// Over-the-Air Configurable Settings BACKUP EEPROM ADDRESS - fixed block of firmware before the config log, migrated once
 #define EEPROM_FIRMWARE_CONFIG_VERSION 200 // EEPROM backup block starting from 200 (because SlimLoRa uses 0-151 v0.7.5 so to safly avoid collision)) end at 208 (8 bytes for backup + firmware version)
 #define EEPROM_SEND_INTERVAL 201 // sendIntervalMinutes backup it is unit16_t, so 2 bytes!
 #define EEPROM_SPS_CLEAN_INTERVAL 203 // spsCleanIntervalDays backup
@@ -49,11 +85,57 @@ const uint32_t GPS_TO_UNIX_OFFSET = 315964800UL;
 #define EEPROM_OVERRIDE_TIME_SYNCHRONIZATION 207 // overrideTimeSynchronization backup
 #define EEPROM_ALLOW_DEEP_SLEEP 208 // allowDeepSleep backup
 #define EEPROM_DEVEUI   209 // DevEUI storage to know if the session is changed - 8 bytes!
+#define EEPROM_CONFIG_LOG_START 224 // config log - 4 CRC protected records of 32 bytes, written in turn
+#define EEPROM_CONFIG_LOG_END   352
+#define EEPROM_TELEMETRY_START 352 // telemetry checkpoint - one CRC protected record of 44 bytes
+#define EEPROM_TELEMETRY_END   396
+#define EEPROM_JOIN_STATE_START 396 // join state - join requests unanswered in a row, CRC protected (398-399 free)
+#define EEPROM_JOIN_STATE_END   398
+#define EEPROM_STORE_START 400  // store-and-forward ring buffer up to the end of the EEPROM (1 KB on the 32u4)
+#define EEPROM_STORE_END   1024
+
+// Store and forward - readings are kept until the network confirmed it is reachable, and resent if not
+#define STORE_AND_FORWARD             1  // 1 = keep every reading in a ring buffer and resend unconfirmed ones on port 2
+#define STORE_USE_FRAM                0  // 1 = keep the ring buffer on external I2C FRAM instead of the free EEPROM
+#define STORE_DRAIN_PER_SLOT          2  // max number of stored readings resent after one regular uplink while the last link check was answered
+#define STORE_JOIN_ATTEMPTS_IN_SETUP  4  // join attempts in setup() before measuring starts unjoined - loop() goes on at the slots the backoff allows
+
+#if STORE_USE_FRAM
+  #define FRAM_I2C_ADDRESS   0x50 // MB85RC64 and compatible
+  #define FRAM_STORE_START   0
+  #define FRAM_STORE_END     8192
+#endif
+
+// Join backoff - randomized exponential delay between join requests, never below the LoRaWAN join duty cycle
+// (1 % in the first hour of joining, 0.1 % in the next 10 hours, 0.01 % after that)
+#define JOIN_BACKOFF_MIN_SECONDS  20    // the first request after power-up comes within this, the delay doubles with every unanswered one
+#define JOIN_BACKOFF_MAX_SECONDS  21600 // upper limit of the delay (6 h)
+
+// Link adaptation - limits and margin target above, downlink port 16
+#define LINK_ADR_HYSTERESIS_DB  3 // a faster step needs this much margin beyond the target and the 3 dB the step costs
+#define LINK_ADR_CONFIRM_CHECKS 2 // link checks in a row with margin to spare before stepping faster
+#define LINK_ADR_MAX_MISSES     3 // unanswered link checks in a row before falling back to LINK_MIN_DATA_RATE at the max power
+
+// Multi-sample frames - the first reading of a frame is sent as is, the next ones as differences to the one before
+#define MULTI_SAMPLE_MAX_COUNT   15 // upper limit for samplesPerFrame
+#define MULTI_SAMPLE_MAX_LENGTH  51 // max application payload at DATA_RATE - 51 for SF10-SF12, 115 for SF9, 222 for SF7 and SF8
+#define MULTI_SAMPLE_DROP_BITS   0  // 0-7 mantissa bits dropped from the readings after the first - 0 = values exactly as on port 1
 
 
 
 #define SPS30_DEFAULT_STABILIZATION_TIME 3 // in minutes - time for the SPS30 to stabilize before data readout
-#define SENSORS_MEASUREMENT_DELAY 135 // about a time to readout all used sensors in milliseconds (SPS30, HTU21D)
+#define SENSORS_MEASUREMENT_DELAY 80 // about a time to readout all used sensors in milliseconds (HTU21D conversions, SPS30 read alongside)
+#define HTU21D_TIMEOUT_MILLIS 250 // give up on the HTU21D after this long - temperature and humidity are sent as 0
+#define SPS30_TIMEOUT_MILLIS 3000 // give up waiting for SPS30 data after this long - the PM values are sent as 0
+
+// Oversampling - both sensors are read throughout the SPS30 stabilization before a slot, the reading sent is their mean
+#define OVERSAMPLE_PERIOD_SECONDS 10 // read the sensors this often while the SPS30 stabilizes - 0 = one reading at the slot
+#define OVERSAMPLE_SETTLE_SECONDS 30 // SPS30 samples this soon after its start are left out
+#define OVERSAMPLE_STATS_UPLINK   0  // 1 = min, max and standard deviation of temperature, humidity and PM mass on port 6 after every reading
+
+// Diagnostics - where the time and the charge go: sleep, idle, SPS30, radio and retry counters kept across resets
+#define DIAGNOSTICS_INTERVAL_DAYS  7  // send the counters on port 7 every n days - 0 = only when asked by downlink 1 on port 15
+#define TELEMETRY_CHECKPOINT_HOURS 24 // save the counters to EEPROM this often - a reset loses at most this much
 
 // LoRaWAN settings - set the keys registred for the device 
 #if LORAWAN_OTAA_ENABLED
@@ -92,4 +174,14 @@ const uint8_t DevAddr[4] = { 0x00, 0x00, 0x00, 0x00 };
   #define DBG_FLUSH()
   #define DBG_PRINT_CURRENT_TIME()
   #define DBG_PRINT_RTC_TIME()
+#endif
+
+#if TRACE_BUFFER_SIZE
+  #define TRACE0(event) traceEvent(TRACE_##event, 0, 0, 0);
+  #define TRACE1(event, a) traceEvent(TRACE_##event, 1, (int32_t)(a), 0);
+  #define TRACE2(event, a, b) traceEvent(TRACE_##event, 2, (int32_t)(a), (int32_t)(b));
+#else
+  #define TRACE0(event)
+  #define TRACE1(event, a)
+  #define TRACE2(event, a, b)
 #endif
\ No newline at end of file
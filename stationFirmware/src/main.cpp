@@ -2,82 +2,501 @@
 #include <Arduino.h>
 #include <RTClib.h> 
 #include "config.h"
+#include "sflt16.h"
+#include "payloadSchema.h"
+#include "trace.h"
+#include "multiSample.h"
+#include "airtime.h"
+#include "slotOffset.h"
 #include <SlimLoRa.h>
-#include <Adafruit_HTU21DF.h>
-#include <sps30.h>
 #include <TimeLib.h> 
 #include <avr/sleep.h>
 #include <avr/wdt.h>
 #include <avr/interrupt.h>
+#include <Wire.h>
 
 // Over-the-Air Configurable Settings - change FIRMWARE_CONFIG_VERSION before flashing!!!!!
-uint16_t sendIntervalMinutes = SEND_INTERVAL_MINUTES;                         // define send interval in minutes !!!keep in multiples of 5 -> 5, 10, 30, 60 !!!
+uint16_t sendIntervalMinutes = SEND_INTERVAL_MINUTES;                         // define send interval in minutes, multiples of 5 - slots are multiples of it since the Unix epoch
 uint8_t spsCleanIntervalDays = SPS_CLEAN_INTERVAL_DAYS;                       // in days - cleaning interval for the fan
 uint8_t spsStabilizationPreReadoutDelay = SPS_STABILIZATION_PREREADOUT_DELAY; // time in minutes for measurement to start, before data readout if sps30StopAfterReadout is true 
 uint8_t spsStopAfterReadout = SPS_STOP_AFTER_READOUT;                         // Stop measurement after data readout. If false, it will start sps30StabilizationPreReadoutDelay minutes before the next sendIntervalMinutes slot
 uint8_t realTimeResyncIntervalDays = REALTIME_RESYNC_INTERVAL_DAYS;           // in days - time resynchronisation interval for the real time
 uint8_t overrideTimeSynchronization = OVERRIDE_TIME_SYNCHRONIZATION;          // 0 = send daty synchronized with time, 1 = send data based just on time interval 
 uint8_t allowDeepSleep = USE_HW_RTC ? ALLOW_DEEP_SLEEP : 0 ;                  // IF there is no USE_HW_RTC, the deep sleep is not allowed.
+uint8_t samplesPerFrame = SAMPLES_PER_FRAME;                                  // readings per uplink - more than 1 sends delta compressed frames on port 5
+#define DELTA_FIELDS 6                                                        // temp, hum and the PM mass concentrations - the first fields of a reading
+#define DELTA_RELATIVE 0x80                                                   // threshold in percent of the value sent last
+#define DELTA_RELATIVE_MIN_CHANGE 100                                         // in thousandths - a relative threshold is at least 0.1 units
+uint8_t deltaHeartbeatSlots = DELTA_HEARTBEAT_SLOTS;                          // send on delta - 0 = off, n = a reading goes out at least every n-th slot
+uint8_t deltaThresholds[DELTA_FIELDS] = {DELTA_THRESHOLD_TEMP, DELTA_THRESHOLD_HUM, DELTA_THRESHOLD_MC_1P0,
+                                         DELTA_THRESHOLD_MC_2P5, DELTA_THRESHOLD_MC_4P0, DELTA_THRESHOLD_MC_10P0}; // 0.1 units or DELTA_RELATIVE | percent, 0 = not watched
+#define SLOT_OFFSET_FROM_DEVEUI 0xFFFF
+uint16_t slotOffsetSeconds = SLOT_OFFSET_SECONDS;                             // uplinks wait this long after the slot, SLOT_OFFSET_FROM_DEVEUI = hashed into SLOT_OFFSET_WINDOW_SECONDS
+uint8_t linkCheckInterval = LINK_CHECK_INTERVAL;                              // link check with every n-th uplink, 0 = none (DATA_RATE at linkMaxPowerDbm)
+uint8_t linkMinDataRate = LINK_MIN_DATA_RATE;                                 // data rate and TX power the link adaptation moves between
+uint8_t linkMaxDataRate = LINK_MAX_DATA_RATE;
+uint8_t linkMinPowerDbm = LINK_MIN_POWER_DBM;
+uint8_t linkMaxPowerDbm = LINK_MAX_POWER_DBM;
+uint8_t linkMarginTargetDb = LINK_MARGIN_TARGET_DB;                           // SNR kept above the demodulation floor
 
 #if USE_HW_RTC
   RTC_TYPE rtc;   // RTC object - define based on used module
 #endif
 
-#if DEBUG
-uint32_t joinTime, RX2End;
+// join state - kept across resets, so a station that keeps resetting keeps backing off; SlimLoRa keeps the DevNonce
+// in its session area itself, which only a new DevEUI erases
+struct JoinState {
+  uint8_t failures;                // join requests unanswered in a row, saturates at 255
+  uint8_t crc;                     // CRC-8 of the bytes before
+};
+static_assert(sizeof(JoinState) == EEPROM_JOIN_STATE_END - EEPROM_JOIN_STATE_START, "join state has to fill its EEPROM range");
+JoinState joinState;
+uint32_t joinStartEpoch = 0;       // power-on - join time and join duty cycle count from here
+uint32_t joinNextEpoch = 0;        // next join request not before this
+uint32_t joinSeconds = 0;          // the last join took this long since power-on, 0 = none since power-on
+void joinLoad();
+bool joinIfDue();
+uint32_t joinWaitSeconds();
+uint32_t joinBackoffLimitSeconds(uint8_t failures);
+uint32_t joinDutyCycleSeconds(uint32_t airtimeMicros, uint32_t joiningSeconds);
+
+// config batch downlink - acknowledged by the config hash and a status appended to the next data uplink
+#define CONFIG_BATCH_FPORT 11
+#define CONFIG_ACK_LENGTH 2
+#define CONFIG_ACK_REJECTED 0x80   // status bit 7 - nothing applied, bits 0-6 are the index of the bad entry
+bool configAckPending = false;
+uint8_t configAckStatus = 0;       // settings applied, or CONFIG_ACK_REJECTED | entry
+
+// send on delta - a reading within the thresholds of the last one sent is measured but not sent
+#define DELTA_FPORT 13             // setting - heartbeat and thresholds
+uint8_t deltaSkipped = 0;          // slots in a row whose reading was not sent
+int32_t deltaLastSent[DELTA_FIELDS] = {SFLT16_NONE, SFLT16_NONE, SFLT16_NONE, SFLT16_NONE, SFLT16_NONE, SFLT16_NONE};
+
+#define SLOT_OFFSET_FPORT 14       // setting - seconds the uplinks wait after the slot
+uint16_t slotOffset();
+
+// link adaptation - LinkCheckAns margins move the data rate and TX power both ways, the SNR and RSSI of downlinks
+// only towards a safer link
+#define LINK_ADR_FPORT 16          // setting - link check interval, data rate and TX power limits, margin target
+#define LINK_ADR_SETTINGS 6
+#define LINK_ADR_STEP_DB 3         // margin a data rate or TX power step costs at most
+#if LINK_ADAPTATION
+  #define LINK_CHECK_REQUEST 0x02  // lora.TimeLinkCheck bit of a LinkCheckReq - 0x01 is the DeviceTimeReq
+  #define LINK_CHECK_ANSWERED 0x20 // lora.LoRaWANreceived bit of a LinkCheckAns - 0x40 is the DeviceTimeAns
+  #define LINK_CHECK_RETRIES LINK_ADR_MAX_MISSES // unanswered checks asked again with the next uplink - up to the fallback
+#else
+  #define LINK_CHECK_REQUEST 0x01  // the link check is a DeviceTimeReq - its answer proves the link just as well
+  #define LINK_CHECK_ANSWERED 0x40
+  #define LINK_CHECK_RETRIES 1
+#endif
+#define LINK_CHECK_ANS_LENGTH 3    // CID, margin and gateway count in the FOpts of the downlink
+#define LINK_MARGIN_NONE 0xFF
+#define LINK_GATEWAY_POWER_DBM 14  // downlinks are assumed to be sent at this power - RX1 in EU868
+static_assert(LINK_MIN_DATA_RATE <= LINK_MAX_DATA_RATE && LINK_MAX_DATA_RATE <= SF7BW250, "link adaptation data rates out of order");
+static_assert(LINK_MIN_POWER_DBM >= 2 && LINK_MIN_POWER_DBM <= LINK_MAX_POWER_DBM && LINK_MAX_POWER_DBM <= 14 &&
+              LINK_MIN_POWER_DBM % 2 == 0 && LINK_MAX_POWER_DBM % 2 == 0, "link adaptation TX power is 2-14 dBm in 2 dB steps");
+uint8_t linkDataRate = DATA_RATE;  // in use
+uint8_t linkPowerDbm = LINK_MAX_POWER_DBM;
+uint8_t linkUplinksSinceCheck = 0;
+uint8_t linkMisses = 0;            // link checks unanswered in a row
+uint8_t linkRequests = 0;          // lora.TimeLinkCheck of the last uplink - a DeviceTimeReq or LinkCheckReq answered proves the link
+uint8_t linkGoodChecks = 0;        // link checks in a row with margin to spare for a faster step
+int16_t linkSpareDb = 0;           // least margin above the target of those
+uint8_t linkMarginDb = LINK_MARGIN_NONE; // of the last LinkCheckAns
+void linkStart();
+void linkApply();
+void linkChecked(bool answered);
+#if LINK_ADAPTATION
+void linkAdapt(bool answered);
+int16_t linkDownlinkMarginDb();
+void linkStepSlower();
+void linkStepFaster(uint8_t steps);
+#endif
+void linkFallback();
+uint8_t linkPowerStep(uint8_t dbm);
+bool deltaChanged(const Port1Fields &reading);
+
+// trace ring buffer - records of trace.h, the oldest are overwritten when it is full
+#define TRACE_FPORT 8              // trace dump uplink
+#define TRACE_REQUEST_FPORT 12     // downlink 1 asks for a trace dump
+#if TRACE_BUFFER_SIZE
+uint8_t traceBuffer[TRACE_BUFFER_SIZE];
+uint8_t traceHead = 0;             // next byte written
+uint8_t traceTail = 0;             // first byte of the oldest record
+uint8_t traceDropped = 0;          // records overwritten since the last dump
+static_assert(TRACE_BUFFER_SIZE > TRACE_RECORD_MAX_LENGTH && TRACE_BUFFER_SIZE < 256, "trace buffer has to hold a record and be indexed by a byte");
 #endif
 
+// telemetry - running totals of where the time goes and of the retries since counting started, checkpointed to EEPROM
+#define DIAGNOSTICS_FPORT 7           // diagnostics uplink - the totals below
+#define DIAGNOSTICS_REQUEST_FPORT 15  // downlink 1 asks for a diagnostics uplink
+#define TELEMETRY_POWER_DOWN  0       // deepSleepMillis(), watchdog and RTC alarm sleeps
+#define TELEMETRY_IDLE        1       // idleMillis() - CPU idle, Timer0 running; the sensor waits are in here as well
+#define TELEMETRY_SPS_FAN     2       // SPS30 measuring
+#define TELEMETRY_SPS_WAIT    3       // readouts waiting for SPS30 data ready
+#define TELEMETRY_RADIO       4       // in SendData() and Join() - airtime, receive windows and the waits between
+#define TELEMETRY_TX          5       // uplink airtime
+#define TELEMETRY_TIMES       6
+#define TELEMETRY_UPLINKS            0
+#define TELEMETRY_JOIN_REQUESTS      1
+#define TELEMETRY_TIME_SYNC_FAILURES 2   // each one is retried later
+#define TELEMETRY_SPS_TIMEOUTS       3
+#define TELEMETRY_POWER_ONS          4   // setup() runs - resets and brownouts
+#define TELEMETRY_COUNTS             5
+struct Telemetry {
+  uint32_t sinceEpoch;                 // counting started - moved on by the time lost to resets, 0 = the clock was not known yet
+  uint32_t savedEpoch;                 // checkpoint time
+  uint32_t seconds[TELEMETRY_TIMES];
+  uint16_t counts[TELEMETRY_COUNTS];   // saturate at 0xFFFF
+  uint8_t reserved;
+  uint8_t crc;                         // CRC-8 of the bytes before
+};
+static_assert(sizeof(Telemetry) == EEPROM_TELEMETRY_END - EEPROM_TELEMETRY_START, "telemetry checkpoint has to fill its EEPROM range");
+static_assert(PORT7_LENGTH <= MULTI_SAMPLE_MAX_LENGTH, "diagnostics exceed the payload limit at DATA_RATE");
+Telemetry telemetry;
+uint16_t telemetryCarryMillis[TELEMETRY_TIMES]; // below a whole second - not saved
+uint32_t telemetrySavedEpoch = 0;               // last checkpoint, 0 = none since power-on
+uint32_t diagnosticsSentEpoch = 0;              // last diagnostics uplink, 0 = none since power-on
+bool diagnosticsPending = false;                // asked for or due, deferred by the airtime limits
+bool telemetryClockKnown = false;               // the clock has been known since power-on
+bool spsMeasuring = false;
+uint32_t spsFanSinceEpoch = 0;                  // fan time counted up to here
+uint32_t spsWaitStartMillis = 0;
+void telemetryLoad();
+void telemetryClock(uint32_t nowEpoch);
+void telemetrySave();
+void telemetryAddMillis(uint8_t time, uint32_t ms);
+void telemetryCount(uint8_t counter);
+void telemetryUpdate();
+void diagnosticsSendByUplink();
+void spsStart();
+void spsStop();
+void spsFanCount();
+
 // main payload variables
-uint8_t payload[25];                  // payload array for data to be sent
-uint8_t payload_length = sizeof(payload); 
+#define PAYLOAD_LENGTH PORT1_LENGTH // layouts in payloadSchema.h
+uint8_t payload[PAYLOAD_LENGTH + CONFIG_ACK_LENGTH]; // payload array for data to be sent - room for a config ack
+uint8_t payload_length = PAYLOAD_LENGTH; 
 uint8_t fport = 1;                   // fport for the data to be sent
 uint32_t waitAfterJoin = 30;         // in seconds
 
+// multi-sample frame collected over several slots - see multiSample.h for the format
+#define MULTI_SAMPLE_FPORT 5
+uint8_t multiSampleFrame[MULTI_SAMPLE_MAX_LENGTH];
+uint8_t multiSampleLength = 0;                               // 0 = no frame started
+uint8_t multiSamplePrevious[MULTI_SAMPLE_KEYFRAME_LENGTH];   // last reading in the frame as the decoder will get it
+uint16_t multiSampleInterval = 0;                            // send interval the frame was started with
+static_assert(MULTI_SAMPLE_MAX_COUNT <= 15 && MULTI_SAMPLE_DROP_BITS <= MULTI_SAMPLE_MAX_DROP_BITS, "frame header has 4 bits for the count and 3 for the dropped bits");
+static_assert(MULTI_SAMPLE_MAX_LENGTH >= 4 + MULTI_SAMPLE_KEYFRAME_LENGTH, "keyframe has to fit into the frame");
+static_assert(MULTI_SAMPLE_KEYFRAME_LENGTH == MEASUREMENT_LENGTH, "multi-sample frames delta code the sflt16 fields of a reading");
+
 
 //initialize LoRaWAN object - pin 8 is used for the RFM95 module
 SlimLoRa lora = SlimLoRa(8);
 
 //sensor variables
-static Adafruit_HTU21DF htu = Adafruit_HTU21DF();
-float temp = NAN;
-float hum = NAN;
-sps30_measurement sps30_data;
-struct sps30_measurement m;
-uint16_t data_ready;
-int16_t ret;
+#define HTU21D_NONE INT16_MIN   // no value
+int16_t temp = HTU21D_NONE;   // 0.01 degC
+int16_t hum = HTU21D_NONE;    // 0.01 %RH
+// SPS30 measured values in its uint16 output format - ug/m3, #/cm3 and nm, the order the sensor sends them in
+struct Sps30Values {
+  uint16_t mc_1p0;
+  uint16_t mc_2p5;
+  uint16_t mc_4p0;
+  uint16_t mc_10p0;
+  uint16_t nc_0p5;
+  uint16_t nc_1p0;
+  uint16_t nc_2p5;
+  uint16_t nc_4p0;
+  uint16_t nc_10p0;
+  uint16_t typical_particle_size;
+};
+Sps30Values m;
+bool spsValid = false;        // m holds a measurement
+
+// cooperative tasks - the sensor readout runs as non-blocking steps, the CPU idles while none is due
+// a step returns the milliseconds until it wants to run again or TASK_DONE; a task still running at
+// its deadline is ended by its expire function, so a stuck sensor costs one timeout instead of the station
+#define TASK_DONE    0xFFFF
+#define TASK_HTU21D  0
+#define TASK_SPS30   1
+#define TASK_COUNT   2
+typedef uint16_t (*TaskStep)();
+struct Task {
+  TaskStep step;
+  void (*expire)();
+  uint32_t dueMillis;
+  uint32_t deadlineMillis;
+  bool running;
+};
+uint16_t htuStep();
+void htuExpire();
+uint16_t sps30Step();
+void sps30Expire();
+Task tasks[TASK_COUNT] = {
+  {htuStep, htuExpire, 0, 0, false},
+  {sps30Step, sps30Expire, 0, 0, false},
+};
+void taskStart(uint8_t id, uint16_t timeoutMillis);
+void runTasks();
+void idleMillis(uint32_t ms);
+
+// HTU21D in no hold master mode - it does not acknowledge reads until the conversion is done
+#define HTU21D_I2C_ADDRESS          0x40
+#define HTU21D_TRIGGER_TEMPERATURE  0xF3
+#define HTU21D_TRIGGER_HUMIDITY     0xF5
+#define HTU21D_SOFT_RESET           0xFE // takes up to 15 ms
+#define HTU21D_TEMPERATURE_MILLIS   50  // max. conversion time at 14 bit
+#define HTU21D_HUMIDITY_MILLIS      16  // max. conversion time at 12 bit
+#define HTU21D_POLL_MILLIS          2
+uint8_t htuState = 0;
+bool htuCommand(uint8_t command);
+uint8_t htuRead(uint16_t &raw);
+
+// SPS30 on I2C in the uint16 output format - a command is 2 bytes MSB first, every data word is followed by a CRC-8
+// starting from 0xFF, so a measurement is 30 bytes and fits the 32 byte Wire buffer
+#define SPS30_I2C_ADDRESS           0x69
+#define SPS30_START_MEASUREMENT     0x0010
+#define SPS30_STOP_MEASUREMENT      0x0104
+#define SPS30_READ_DATA_READY       0x0202
+#define SPS30_READ_MEASUREMENT      0x0300
+#define SPS30_AUTO_CLEANING         0x8004
+#define SPS30_START_FAN_CLEANING    0x5607
+#define SPS30_FAN_CLEANING_SECONDS  10         // the fan at full speed - stopping the measurement ends it
+#define SPS30_OUTPUT_UINT16         0x0500     // start argument - integer output instead of IEEE-754 floats
+#define SPS30_COMMAND_MILLIS        20         // max. execution time of the write commands
+#define SPS30_POLL_MILLIS           100
+#define SPS30_MEASUREMENT_WORDS     (sizeof(Sps30Values) / 2)
+static_assert(sizeof(Sps30Values) == 20, "the SPS30 sends 10 words in the uint16 output format");
+bool spsCommand(uint16_t command, const uint16_t *args, uint8_t count);
+uint8_t spsRead(uint16_t command, uint16_t *words, uint8_t count);
+void spsSetCleaningInterval(uint8_t days);
+uint32_t spsCleaningEpoch(uint32_t slotEpoch);
+void spsFanCleaning(uint32_t slotEpoch);
+void readSensors();
+void sensorReading(Port1Fields &reading);
+
+#if OVERSAMPLE_PERIOD_SECONDS
+// streaming statistics of the samples taken before a slot - fixed point codes, the sums are taken of the
+// deviations from the first sample so they stay small whatever the level
+struct FieldStats {
+  int16_t first;
+  int16_t min;
+  int16_t max;
+  int32_t sum;           // of the deviations from first
+  uint32_t sumSquares;   // of the deviations from first, saturates
+  uint8_t count;
+};
+#define OVERSAMPLE_FIELDS     (MEASUREMENT_LENGTH / SCHEMA_SIZE_SFLT16)  // all fields of a reading, MEASUREMENT_FIELDS order
+#define OVERSAMPLE_HTU_FIELDS 2                                          // temperature and humidity come first
+#define STATS_FPORT 6
+FieldStats oversample[OVERSAMPLE_FIELDS];
+// codes per unit of each field, the ranges fit an int16_t: 0.01 degC and %RH like the HTU21D conversion, 0.1 ug/m3 and
+// #/cm3 up to 3000 - the SPS30 gives whole units, the mean of several samples has a decimal -, 1 nm particle size
+const uint16_t oversampleUnits[OVERSAMPLE_FIELDS] = {100, 100, 10, 10, 10, 10, 10, 10, 10, 10, 10, 1000};
+void oversampleUntilSlot();
+void oversampleAdd(const Port1Fields &reading, uint8_t fields);
+void oversampleMean(Port1Fields &reading);
+void sendOversampleStats(uint32_t epoch);
+uint16_t isqrt(uint32_t value);
+#endif
 
 //slot variables
 uint32_t nextSlotEpoch = 0;   
+
+// recurring jobs on the clock - each cycle works out when each one is due and the station sleeps until the earliest.
+// The cycle starts with the SPS30 or the slot, the time sync and the settings report are made in between or ride on it
+#define JOB_SPS_START        0  // the SPS30 starts spsStabilizationPreReadoutDelay minutes before the slot
+#define JOB_SLOT             1  // the sensors are read at the slot, the uplinks follow at the slot offset
+#define JOB_TIME_SYNC        2  // a time sync retry
+#define JOB_SETTINGS_REPORT  3  // a settings report deferred by the airtime limits, once they allow it
+#define JOB_FAN_CLEANING     4  // SPS30 fan cleaning after the readout of a slot, every spsCleanIntervalDays
+#define JOB_COUNT            5
+#define JOB_NONE             0xFFFFFFFFUL
+#define JOB_SLOT_MARGIN_SECONDS 60 // a job due closer to the cycle than this rides on the slot
+uint32_t jobEpoch[JOB_COUNT];   // when each job is due next, JOB_NONE = not scheduled
+uint32_t spsCleanedEpoch = 0;   // slot of the last fan cleaning, 0 = none since power-on
 uint32_t lastSyncEpoch = 0;
-uint32_t lastSentSlot = 0;
+uint32_t timeAnswerMillis = 0;   // when SendData() returned with the last DeviceTimeAns
+uint8_t timeAnswerDataRate = DATA_RATE; // of that uplink and its RX1 downlink - the link adaptation may have moved on since
+#define DEVICE_TIME_ANS_LENGTH 6 // CID, GPS seconds and fraction in the FOpts of the downlink
 
-//time resync intervals in minutes
+#if USE_HW_RTC
+// RTC drift model - the offset found at each time sync over the time since the RTC was set by the one before
+#define RTC_DRIFT_UNKNOWN       ((int16_t)0x8000)
+#define RTC_DRIFT_FLOOR         20     // 0.2 ppm - temperature changes keep even a trimmed DS3231 from doing better
+#define RTC_DRIFT_MIN_SECONDS   21600UL // shorter spans give no useful drift - a sync is good to a few ms
+#define RTC_AGING_STEP          10     // the DS3231 aging offset trims about 0.1 ppm per LSB
+#define DS3231_I2C_ADDRESS      0x68
+#define DS3231_AGING_OFFSET     0x10
+bool rtcSetByNetwork = false;           // lastSyncEpoch is the second the RTC was set to network time
+int16_t rtcDrift = RTC_DRIFT_UNKNOWN;   // in 0.01 ppm, + = RTC fast
+int8_t rtcAging = 0;                    // DS3231 aging offset as last read or written
+uint8_t rtcResyncDays = 0;              // resync interval chosen from the drift, 0 = realTimeResyncIntervalDays
+uint32_t rtcWaitForSecond();
+void rtcDriftUpdate(int32_t rtcAheadSeconds, uint32_t networkMillis, uint32_t networkEpoch);
+#if RTC_AGING_CORRECTION
+int8_t rtcReadAging();
+void rtcWriteAging(int8_t aging);
+#endif
+#endif
+
+//airtime accounting - EU868 duty cycle and the fair use budget refilled continuously over 24 hours
+#define AIRTIME_BUDGET_MICROS (AIRTIME_BUDGET_SECONDS_PER_DAY * 1000000UL)
+#define AIRTIME_REFILL_MICROS_PER_SECOND (AIRTIME_BUDGET_MICROS / 86400UL)
+uint32_t airtimeBudgetMicros = AIRTIME_BUDGET_MICROS; // airtime left in the rolling budget
+uint32_t airtimeRefillEpoch = 0;                      // budget refilled up to this time
+uint32_t dutyCycleFreeEpoch = 0;                      // the band may be used again from this time
+bool settingsReportPending = false;                   // report deferred by the airtime limits
+#define SETTINGS_REPORT_LENGTH PORT4_LENGTH
+#if OVERSAMPLE_PERIOD_SECONDS && OVERSAMPLE_STATS_UPLINK
+  #define STATS_AIRTIME_MICROS uplinkAirtimeMicros(DATA_RATE, PORT6_LENGTH) // follows every data uplink
+  static_assert(PORT6_LENGTH <= MULTI_SAMPLE_MAX_LENGTH, "statistics frame exceeds the payload limit at DATA_RATE");
+#else
+  #define STATS_AIRTIME_MICROS 0
+#endif
+#if AIRTIME_CHECK_CONFIG
+// data uplink with a piggybacked DeviceTimeReq and LinkCheckReq, plus a settings report and a time request every day
+static_assert((uplinkAirtimeMicros(DATA_RATE, PAYLOAD_LENGTH, 2) + STATS_AIRTIME_MICROS) * (100 / DUTY_CYCLE_PERCENT) <= SEND_INTERVAL_MINUTES * 60000000ULL,
+              "SEND_INTERVAL_MINUTES is too short for the duty cycle at DATA_RATE");
+static_assert(SAMPLES_PER_FRAME > 1 ||
+              (uint64_t)(uplinkAirtimeMicros(DATA_RATE, PAYLOAD_LENGTH, 2) + STATS_AIRTIME_MICROS) * (1440 / SEND_INTERVAL_MINUTES) +
+              uplinkAirtimeMicros(DATA_RATE, SETTINGS_REPORT_LENGTH) + uplinkAirtimeMicros(DATA_RATE, 1, 1) <= AIRTIME_BUDGET_MICROS,
+              "SEND_INTERVAL_MINUTES at DATA_RATE exceeds AIRTIME_BUDGET_SECONDS_PER_DAY - use a longer interval, a faster data rate or SAMPLES_PER_FRAME");
+#endif
+
+#if STORE_AND_FORWARD
+//store-and-forward ring buffer - record: sequence, status, epoch (4 bytes), port 1 data (24 bytes)
+#if STORE_USE_FRAM
+  #define STORE_START FRAM_STORE_START
+  #define STORE_END FRAM_STORE_END
+#else
+  #define STORE_START EEPROM_STORE_START
+  #define STORE_END EEPROM_STORE_END
+#endif
+#define STORE_DATA_LENGTH MEASUREMENT_LENGTH
+#define STORE_RECORD_SIZE (6 + STORE_DATA_LENGTH)
+#define STORE_CAPACITY ((STORE_END - STORE_START) / STORE_RECORD_SIZE)
+#define STORE_NONE 0xFFFF            // no slot
+static_assert(PORT2_temp == 4 && PORT2_LENGTH == 4 + STORE_DATA_LENGTH, "resent readings are the stored epoch and data");
+#define STORE_SEQ_EMPTY 0xFF         // sequence of a slot never written or being rewritten
+#define STORE_STATUS_PENDING 0xFF    // not confirmed by the network yet
+#define STORE_STATUS_CONFIRMED 0x00
+#define STORE_FPORT 2                // resent readings: epoch (4 bytes) + port 1 data
+static_assert(STORE_CAPACITY % 255 != 0, "ring buffer capacity must not be a multiple of the sequence range");
+uint16_t storeNewest = STORE_NONE;   // slot of the newest record
+uint16_t storeSentFrom = STORE_NONE; // first record sent since the last answered link check
+uint16_t storeResentFrom = STORE_NONE; // records resent since then - confirmed by the next answered link check
+uint16_t storeResentTo = STORE_NONE;
+bool storeLinkDown = true;           // until a link check is answered - no resends
+bool timeSyncPending = false;        // time sync postponed until the station has joined
+#endif
+
+//time resync intervals in minutes - a failed sync is retried in the background, slots go on with the clock as it is
 uint16_t syncFailedResyncIntervalsInMinutes[8] = {0,5, 30, 60, 120, 300, 720, 1440}; 
+uint8_t syncFailedCount = 0;          // failed attempts since the last sync, the next one waits syncFailedResyncIntervalsInMinutes[syncFailedCount]
+uint32_t syncFailedSinceEpoch = 0;    // first failed attempt since the last sync
+uint32_t syncRetryEpoch = 0;          // next attempt is due from this time, 0 = none
+bool timeSyncFreeRunning = false;     // overrideTimeSynchronization set by failed syncs - cleared by the next sync
+
+//config log - every save goes to the next record, data first and the CRC last, so a save torn by a power loss
+//leaves the record before it as the newest valid one
+#define CONFIG_SCHEMA 1              // record layout - records of another layout are not loaded
+#define CONFIG_RECORD_SIZE 32
+#define CONFIG_LOG_RECORDS ((EEPROM_CONFIG_LOG_END - EEPROM_CONFIG_LOG_START) / CONFIG_RECORD_SIZE)
+#define CONFIG_NONE 0xFF
+struct ConfigRecord {
+  uint8_t schema;                    // 0xFF = never written
+  uint8_t version;                   // FIRMWARE_CONFIG_VERSION that wrote it - another one starts from the config.h values
+  uint16_t sendIntervalMinutes;
+  uint8_t sequence;                  // +1 per save, the newest valid record wins
+  uint8_t spsCleanIntervalDays;
+  uint8_t spsStabilizationPreReadoutDelay;
+  uint8_t spsStopAfterReadout;
+  uint8_t realTimeResyncIntervalDays;
+  uint8_t overrideTimeSynchronization;
+  uint8_t allowDeepSleep;
+  uint8_t samplesPerFrame;
+  uint8_t deltaHeartbeatSlots;
+  uint8_t deltaThresholds[DELTA_FIELDS];
+  uint8_t slotOffsetSeconds[2];      // LSB first
+  uint8_t linkAdr[LINK_ADR_SETTINGS]; // as the port 16 downlink
+  uint8_t reserved[4];               // 0xFF
+  uint8_t crc;                       // CRC-8 of the bytes before
+};
+static_assert(sizeof(ConfigRecord) == CONFIG_RECORD_SIZE, "config record has to fill its slot");
+static_assert(CONFIG_LOG_RECORDS >= 2 && CONFIG_LOG_RECORDS < 128, "config log needs a record to fall back on and comparable sequence numbers");
+uint8_t configSlot = CONFIG_NONE;    // record of the newest save
+uint8_t configSequence = 0;
 
 //EEPROM Storage functions
 void clearSessionEEPROM(); 
 void loadConfigFromEEPROM();
+void loadLegacyConfig();
 void saveConfigToEEPROM();
 void manageSessionKeyChange();
+uint8_t crc8(const uint8_t *data, uint8_t length, uint8_t crc = 0);
+
+#if STORE_AND_FORWARD
+//store-and-forward functions
+void storeInit();
+uint16_t storeAppend(uint32_t epoch, const uint8_t *data);
+uint16_t storeNextResend();
+void storeConfirm(uint16_t fromSlot, uint16_t toSlot);
+void storeLinkChecked(bool answered);
+void storeDrain();
+#endif
+bool isJoined();
+void sendReading(uint32_t epoch);
+bool transmitReadings(uint8_t port, uint8_t *data, uint8_t length);
+bool sendMultiSampleFrame();
+void dropMultiSampleFrame();
+
+//airtime accounting - every uplink and join goes through these
+bool sendUplink(uint8_t port, uint8_t *data, uint8_t length);
+void joinNetwork();
+uint32_t airtimeWaitSeconds(uint32_t airtimeMicros);
+void airtimeCharge(uint32_t airtimeMicros);
+void airtimeRefill();
+void waitMillis(uint32_t ms);
 
 //OTA config and report functions
 void processDownlink();
+#if TRACE_BUFFER_SIZE
+void traceEvent(uint8_t event, uint8_t args, int32_t a, int32_t b);
+uint8_t traceRecordLength(uint8_t at);
+uint8_t traceDump(uint8_t *out, uint8_t maxLength, uint8_t &tail);
+void traceFlushSerial();
+void traceSendByUplink();
+#endif
+uint8_t settingLength(uint8_t tag);
+bool applySetting(uint8_t tag, const uint8_t *value);
+void applyConfigBatch(const uint8_t *data, uint8_t length);
+uint8_t configHash();
 void reportSettingsByUplink();
 
-//uplink formatters
-void saveToPayload(float data, uint8_t *payload, int position);
-void saveToPayload(sps30_measurement &data, uint8_t *payload, int position);
-uint16_t f2sflt16(float f);
-
 //time
 void synchronizeTime();
+void setNetworkTime(uint32_t gpsEpoch);
+void timeSyncFailed();
+bool timeSyncDue();
+void timeSyncAnswer();
 uint32_t getTimeRequestTimestamp();
 void printDateTime(int y, int mo, int d, int h, int mi, int s);
 void waitUntilNextSlot();
+uint32_t slotAfter(uint32_t epoch);
+void jobSchedule(uint32_t nowEpoch, uint8_t ran);
+uint8_t jobEarliest();
+void sleepUntilClock(uint32_t nowEpoch, uint32_t wakeEpoch);
 void checkForTimeResync();
+uint8_t resyncIntervalDays();
+uint32_t getCurrentEpoch();
 #if DEBUG
 void printCurrentTime();
 #endif
+#if BENCHMARK_SFLT16
+void benchmarkSflt16();
+#endif
 
 // deepSleep
 volatile bool watchdogFired = false;
@@ -86,16 +505,47 @@ ISR(WDT_vect) {
 }
 void deepSleepMillis(uint32_t milliseconds);
 void setupWatchdog(uint8_t timeout);
+void watchdogSleep(uint8_t timeout);
+uint8_t watchdogBucket();
+uint32_t watchdogBaseNanos();
+#if USE_HW_RTC
+void sleepUntilEpoch(uint32_t epoch);
+void watchdogSleepUntil(uint32_t epoch);
+uint32_t watchdogScale(uint32_t baseNanos, int32_t deviationMillis, uint32_t plannedMillis);
+uint32_t watchdogWaitForRtcSecond(uint16_t &polls);
+#endif
+#if RTC_ALARM_WAKEUP
+volatile bool rtcAlarmFired = false;
+void rtcAlarmISR();
+void rtcAlarmSetup();
+bool rtcAlarmSleepUntil(uint32_t epoch);
+#endif
+
+// watchdog calibration - the 16 ms base period (2K cycles of the 128 kHz oscillator, +-10 %) measured against the RTC
+// per 8 degC bucket of the HTU21D temperature, the longer periods are powers of two of it
+// in ns - a 1 us step would be 60 ppm, 0.2 s per hour of sleep
+#define WDT_NOMINAL_BASE_NANOS   16000000UL
+#define WDT_TEMPERATURE_BUCKETS  8    // -16 degC ... 48 degC
+#define WDT_POLL_OVERHEAD_MICROS 700  // wake-up and RTC read after each base period while waiting for an RTC second
+uint32_t wdtBaseNanos[WDT_TEMPERATURE_BUCKETS] = {0};  // 0 = not measured yet
+int16_t wakeErrorMillis = 0;                           // largest error of a calibrated watchdog sleep this cycle, + = late
 
 void setup(){
   #if DEBUG
     Serial.begin(9600);
-    while (!Serial); // don't start unless we have serial connection
-    DBG_PRINTLN("Starting");
+    for (uint16_t i = 0; !Serial && i < 1000; i++) { // wait up to 10 s for a host, then start without one
+      delay(10);
+    }
+  #endif
+  Wire.begin(); // before any I2C transfer - HTU21D, SPS30, RTC and FRAM share the bus
+  TRACE1(BOOT, FIRMWARE_CONFIG_VERSION)
+  #if BENCHMARK_SFLT16
+    benchmarkSflt16();
   #endif
     manageSessionKeyChange();
 
     loadConfigFromEEPROM();
+    telemetryLoad();
     
     #if DEBUG
     pinMode(LED_BUILTIN, OUTPUT);
@@ -107,59 +557,54 @@ void setup(){
     digitalWrite(LED_BUILTIN, HIGH);
     */
 
-    htu.begin();
-    DBG_PRINTLN(F("HTU21D sensor initialized."));
-    delay(1000);
+    if (!htuCommand(HTU21D_SOFT_RESET)) {
+      TRACE1(HTU_ERROR, 1)
+    }
+    idleMillis(1000);
+  #if USE_HW_RTC
+    if (!rtc.begin()){
+      TRACE0(RTC_MISSING)
+    #if TRACE_BUFFER_SIZE
+      traceFlushSerial();
+    #endif
+      while (1)
+        ;
+    }
+    #if RTC_ALARM_WAKEUP
+      rtcAlarmSetup();
+    #endif
+    if (!rtc.lostPower()) {
+      telemetryClock(getCurrentEpoch()); // the clock runs - otherwise from the first time sync
+    }
+  #endif
 
     lora.Begin();
-    lora.Join(); // Join the network;
-    lora.SetPower(14);
-    lora.SetDataRate(DATA_RATE); 
-
-    DBG_PRINTLN(lora.GetHasJoined() ? "OK" : "NO");
-    
-    uint8_t joinCounter = 0;
+    linkStart();
+  #if STORE_AND_FORWARD
+    storeInit();
+  #endif
   #if LORAWAN_OTAA_ENABLED
-  #if LORAWAN_KEEP_SESSION
-    while (!lora.GetHasJoined())
-    {
-  #else
-    while (!lora.HasJoined())
-    {
-  #endif // LORAWAN_KEEPSESSION
-      DBG_PRINTLN(F("\nJoining..."));
-      #if DEBUG
-        joinTime = millis() / 1000;
-      #endif
-      joinCounter++;
-      lora.Begin();
-      lora.Join();
-      if (joinCounter > 10){
-        clearSessionEEPROM();
-        joinCounter = 0;
-      }
-  #if DEBUG
-      RX2End = millis() / 1000;
-      DBG_PRINTLN(F("\nJoin effort finished."));
-      DBG_PRINT(F("\nRx2End after: "));
-      DBG_PRINT(RX2End - joinTime);
-  #endif
-      if (lora.HasJoined()){
-        DBG_PRINTLN(F("\nJoined Sending packet in half minute."));
-        delay(waitAfterJoin * 1000);
+    joinLoad(); // the join backoff runs on the clock - the RTC has begun, it ticks even if it lost the time
+  #if STORE_AND_FORWARD
+    uint8_t joinAttemptsInSetup = 0;
+  #endif
+    do { // a kept session gets one join request for a fresh one - without one, joining goes on with the backoff
+      waitMillis(joinWaitSeconds() * 1000);
+      if (joinIfDue()) {
+        waitMillis(waitAfterJoin * 1000);
         break;
       }
-      delay(5 * 1000);
-    }
+    #if STORE_AND_FORWARD
+      if (!isJoined() && ++joinAttemptsInSetup >= STORE_JOIN_ATTEMPTS_IN_SETUP){
+        TRACE0(JOIN_GIVEN_UP)
+        break; // loop() goes on joining at the slots the backoff allows, readings wait in the store
+      }
+    #endif
+    } while (!isJoined());
   #endif // LORAWAN_OTAA_ENABLED
   #if USE_HW_RTC
-    if (!rtc.begin()){
-      DBG_PRINTLN("Couldn't find RTC");
-      while (1)
-        ;
-    }
     if (rtc.lostPower()){
-      DBG_PRINTLN("RTC lost power, setting time...");
+      TRACE0(RTC_LOST_POWER)
       #if SET_RTC_FROM_SERIAL
       DBG_PRINTLN("Enter date and time (YYYY MM DD HH mm ss): ");
       DBG_PRINTLN("Example: 2023 10 01 12 00 00");
@@ -187,6 +632,11 @@ void setup(){
         digitalWrite(LED_BUILTIN, LOW);
       }
     #else
+    #if STORE_AND_FORWARD
+    if (!isJoined()){
+      timeSyncPending = true; // synchronize as soon as loop() gets the station joined
+    }else
+    #endif
     synchronizeTime();
     #endif
     
@@ -200,520 +650,1727 @@ void setup(){
     DBG_PRINTLN(F("\nRTC time synchronized."));
     DBG_PRINT_CURRENT_TIME();
     DBG_PRINT_RTC_TIME();
+  #endif
+  #if STORE_AND_FORWARD
+    if (!isJoined()){
+      timeSyncPending = true;
+    }else
   #endif
     synchronizeTime();
   #endif
   DBG_PRINT_CURRENT_TIME();
-  sps30_start_measurement();
-  sps30_set_fan_auto_cleaning_interval_days(spsCleanIntervalDays);
-  DBG_PRINTLN(F("SPS30 fan auto cleaning interval set."));
+  spsStart();
+  spsSetCleaningInterval(0); // off - the fan cleaning is a job of the station, timed after a readout
   
 
 }
 
   void loop() {
 
+    wakeErrorMillis = 0;
     waitUntilNextSlot(); // Wait until the next slot to send data
 
+    if (settingsReportPending) { // deferred by the airtime limits and not made in between
+      reportSettingsByUplink();
+    }
+
 
     if(spsStopAfterReadout == 1){ // Start measurement to szabilize sps if spsStopAfterReadout power save mode flag is set
-      sps30_start_measurement();
-      DBG_PRINT(F("SPS30 measurement started."));
+      spsStart();
     }
-  
+    TRACE1(SLOT, nextSlotEpoch)
+  #if OVERSAMPLE_PERIOD_SECONDS
+    oversampleUntilSlot();
+  #endif
+  #if USE_HW_RTC
+    if (allowDeepSleep == 1 && overrideTimeSynchronization == 0) {
+      sleepUntilEpoch(nextSlotEpoch - 1);                // the SPS30 keeps measuring while the MCU sleeps
+      deepSleepMillis(1000 - SENSORS_MEASUREMENT_DELAY); // readout ends with the slot
+    }
+    else
+  #endif
+    {
     #if USE_HW_RTC  
-      uint32_t waitTime = millis() + ((nextSlotEpoch - rtc.now().unixtime()) * 1000);
+      int32_t waitTime = (int32_t)(nextSlotEpoch - rtc.now().unixtime()) * 1000;
     #else
 
-      uint32_t waitTime = millis() +  ((nextSlotEpoch - now()) * 1000);
+      int32_t waitTime = (int32_t)(nextSlotEpoch - now()) * 1000;
     #endif
 
     DBG_PRINT_CURRENT_TIME();
-    DBG_PRINT(F("nextSlotEpoch: "));DBG_PRINTLN(nextSlotEpoch);
-    DBG_PRINT(F("waitTime: "));DBG_PRINTLN(waitTime);
 
+    if (waitTime > SENSORS_MEASUREMENT_DELAY) {
+      idleMillis(waitTime - SENSORS_MEASUREMENT_DELAY);
+    }
+    }
+
+    readSensors();
+    Port1Fields reading;
+    sensorReading(reading);
+  #if OVERSAMPLE_PERIOD_SECONDS
+    oversampleAdd(reading, OVERSAMPLE_FIELDS);
+    oversampleMean(reading);
+  #endif
+    reading.wake_error_ms = (int8_t)(wakeErrorMillis > 1270 ? 127 : (wakeErrorMillis < -1270 ? -127 : wakeErrorMillis / 10)); // in 10 ms
+    encodePort1(reading, payload);
+    uint32_t readingEpoch = overrideTimeSynchronization ? getCurrentEpoch() : nextSlotEpoch;
+    if (spsCleaningEpoch(readingEpoch) <= readingEpoch) {
+      spsFanCleaning(readingEpoch); // after the readout, no reading is taken with the fan at full speed
+    }
 
-   while (millis() <= (waitTime - SENSORS_MEASUREMENT_DELAY)) 
-   {
-    delay(100);
-   }
-   
-    temp = htu.readTemperature();
-    hum = htu.readHumidity();
-    
-    do
-        {
-            ret = sps30_read_data_ready(&data_ready);
-            if (ret < 0)
-            {
-              DBG_PRINTLN(F("SPS30 measure error"));
-              DBG_PRINTLN(ret);
-            }
-            else if (data_ready) break;
-            DBG_PRINT(F("SPS30 data not ready..."));
-            delay(100);
-        } while (1);
-
-        ret = sps30_read_measurement(&m);
-
-        saveToPayload(temp, payload, 0); // Save teperature to payload at [0] and [1]
-        saveToPayload(hum, payload, 2);  // Save humidity to payload at [2] and [3]
-        saveToPayload(m, payload, 4);    // Save SPS data to payload at [4] - [23]
-
-    DBG_PRINT(("sending:"));DBG_PRINT_CURRENT_TIME();
-    lora.SendData(fport, payload, payload_length); // Send data to LoRaWAN network
-    DBG_PRINT(F("\nLoRaWAN packet send."));
-    processDownlink();                            // Check and process downlink data
     if(!overrideTimeSynchronization){
-      checkForTimeResync();
+      checkForTimeResync(); // a due sync rides on the data uplink
+    }
+    DBG_PRINT_CURRENT_TIME();
+    bool spsStopped = false;
+    if (!overrideTimeSynchronization && slotOffset() > 0) { // measured at the slot, sent at the station's offset after it
+      if (spsStopAfterReadout == 1) {
+        spsStop(); // the fan does not run through the offset
+        spsStopped = true;
+      }
+      sleepUntilClock(getCurrentEpoch(), nextSlotEpoch + slotOffset());
+    }
+    bool readingSent = deltaChanged(reading);
+    if (readingSent) {
+      deltaSkipped = 0;
+      sendReading(readingEpoch);                  // Send data to LoRaWAN network
+    } else {
+      deltaSkipped++;
+      TRACE1(READING_UNCHANGED, deltaSkipped)
+    }
+    processDownlink();                            // Check and process downlink data
+    if (timeSyncDue() && isJoined()) {
+      synchronizeTime(); // no data uplink this slot, or it was deferred
     }
 
-  if(spsStopAfterReadout == 1){// Stop measurement to save power if flag is set
-    sps30_stop_measurement(); 
-    DBG_PRINT(F("SPS30 measurement stopped."));
+  if(spsStopAfterReadout == 1 && !spsStopped){// Stop measurement to save power if flag is set
+    spsStop();
    }
+  #if OVERSAMPLE_PERIOD_SECONDS && OVERSAMPLE_STATS_UPLINK
+    if (readingSent && isJoined()) {
+      sendOversampleStats(readingEpoch); // after the fan stopped - it may wait for the duty cycle
+    }
+  #endif
+    telemetryUpdate();
+  #if TRACE_BUFFER_SIZE
+    traceFlushSerial(); // before the station sleeps until the next slot
+  #endif
 
   }
 
-  // save 16 bit float to 8 bit payload array 
-  void saveToPayload(float data, uint8_t *payload, int position)
-  {
-    uint16_t payloadTmp = f2sflt16(data / 100);
-    byte low = lowByte(payloadTmp);
-    byte high = highByte(payloadTmp);
-
-    payload[position] = low;
-    payload[position + 1] = high;
-
+// send on delta - true if the reading goes out: a watched field moved past its threshold from the reading sent last,
+// a sensor failed or came back, or the heartbeat is due. Multi-sample frames date readings by their position, they
+// take every reading. A reading that goes out becomes the one to compare with. A relative threshold of a value sent
+// last near 0 (PM in clean air) would be 0 and send every reading, so it asks for DELTA_RELATIVE_MIN_CHANGE at least.
+bool deltaChanged(const Port1Fields &reading) {
+  const int32_t values[DELTA_FIELDS] = {reading.temp, reading.hum, reading.mc_1p0, reading.mc_2p5, reading.mc_4p0, reading.mc_10p0};
+  bool changed = deltaHeartbeatSlots == 0 || samplesPerFrame > 1 || deltaSkipped + 1 >= deltaHeartbeatSlots;
+  for (uint8_t i = 0; i < DELTA_FIELDS && !changed; i++) {
+    uint8_t threshold = deltaThresholds[i] & ~DELTA_RELATIVE;
+    if (threshold == 0) {
+      continue;
+    }
+    if (values[i] == SFLT16_NONE || deltaLastSent[i] == SFLT16_NONE) {
+      changed = values[i] != deltaLastSent[i];
+      continue;
+    }
+    uint32_t change = labs(values[i] - deltaLastSent[i]);   // in thousandths
+    if (deltaThresholds[i] & DELTA_RELATIVE) {
+      changed = change >= DELTA_RELATIVE_MIN_CHANGE && change >= (uint32_t)labs(deltaLastSent[i]) * threshold / 100; // below 2^32 - 1000 ug/m3 * 127 %
+    } else {
+      changed = change >= threshold * 100UL;
+    }
   }
-// assemble payload part for sps30 data
-void saveToPayload(sps30_measurement &data, uint8_t *payload, int position)
-{
-    saveToPayload(data.mc_1p0, payload, position);
-    saveToPayload(data.mc_2p5, payload, position + 2);
-    saveToPayload(data.mc_4p0, payload, position + 4);
-    saveToPayload(data.mc_10p0, payload, position + 6);
-    saveToPayload(data.nc_0p5, payload, position + 8);
-    saveToPayload(data.nc_1p0, payload, position + 10);
-    saveToPayload(data.nc_2p5, payload, position + 12);
-    saveToPayload(data.nc_4p0, payload, position + 14);
-    saveToPayload(data.nc_10p0, payload, position + 16);
-    saveToPayload(data.typical_particle_size, payload, position + 18);
-}
-//formatting float to 16 bit unsigned int for LoRaWAN payload
-uint16_t f2sflt16(float f) {
-  if (f <= -1.0f)
-      return 0xFFFF;  // Overflow for negative values outside the range.
-  else if (f >= 1.0f)
-      return 0x7FFF;  // Overflow for positive values outside the range.
-  else {
-      int iExp;
-      float normalValue;
-      uint16_t sign = 0;
-      // Normalization: frexpf returns the normalized value and the exponent.
-      normalValue = frexpf(f, &iExp);
-      // Check for negative sign
-      if (normalValue < 0) {
-          sign = 0x8000;  
-          normalValue = -normalValue;
-      }
-      // Adjust the exponent to match the range expected by the format (biased by 15)
-      iExp += 15;
-      if (iExp < 0) iExp = 0;  
-      // Compute the fractional part (mantissa) and handle rounding
-      uint16_t outputFraction = (uint16_t)(ldexpf(normalValue, 11) + 0.5f);
-      if (outputFraction >= (1 << 11)) {
-          outputFraction = 1 << 10;  // If fraction exceeds 11 bits, saturate it
-          iExp++;  // Increase the exponent to compensate
-      }
-      // Check for overflow of the exponent, saturate at max value (exponent=31)
-      if (iExp > 15)
-          return 0x7FFF | sign;
-      // Combine sign, exponent, and mantissa into a 16-bit value
-      return (uint16_t)(sign | (iExp << 11) | outputFraction);
+  if (changed) {
+    memcpy(deltaLastSent, values, sizeof(deltaLastSent));
   }
+  return changed;
 }
-
-#if DEBUG
-//just print time
-void printCurrentTime() {
-  #if USE_HW_RTC
-    DateTime now = rtc.now();
-    DBG_PRINT("RTC date/time: ");
-    printDateTime(now.year(), now.month(), now.day(), now.hour(), now.minute(), now.second());
-  #else 
-  //if (currentUnixEpoch == 0) {
-    if (now() == 0) {
-      DBG_PRINTLN("GPS epoch not set yet."); // time n0t synchronized
-      return;
-    }
-    //setTime(currentUnixEpoch); // Přepočítá podle TimeLib
-    DBG_PRINT("GPS date/time: ");
-    printDateTime(year(), month(), day(), hour(), minute(), second());
-  #endif
+// seconds the uplinks of a slot wait after it - kept below half the send interval, so the next slot is not delayed
+uint16_t slotOffset() {
+  uint16_t offset = slotOffsetSeconds;
+  if (offset == SLOT_OFFSET_FROM_DEVEUI) {
+    offset = slotOffsetFromDevEUI(DevEUI, SLOT_OFFSET_WINDOW_SECONDS);
+  }
+  uint32_t limit = sendIntervalMinutes * 30UL;
+  return offset < limit ? offset : offset % limit;
 }
-// print time format
-void printDateTime(int y, int mo, int d, int h, int mi, int s) {
-  DBG_PRINT(y); DBG_PRINT("-");
-  if (mo < 10) DBG_PRINT("0");
-  DBG_PRINT(mo); DBG_PRINT("-");
-  if (d < 10) DBG_PRINT("0");
-  DBG_PRINT(d); DBG_PRINT(" ");
-  if (h < 10) DBG_PRINT("0");
-  DBG_PRINT(h); DBG_PRINT(":");
-  if (mi < 10) DBG_PRINT("0");
-  DBG_PRINT(mi); DBG_PRINT(":");
-  if (s < 10) DBG_PRINT("0");
-  DBG_PRINTLN(s);
+// data rate and TX power after power-on and new limits - DATA_RATE within the limits at the max power
+void linkStart() {
+  linkDataRate = DATA_RATE < linkMinDataRate ? linkMinDataRate : (DATA_RATE > linkMaxDataRate ? linkMaxDataRate : DATA_RATE);
+  linkPowerDbm = linkMaxPowerDbm;
+  linkUplinksSinceCheck = 0;
+  linkMisses = 0;
+  linkGoodChecks = 0;
+  linkApply();
 }
-#endif 
-// Time synchronization - if it fails, it will try to resync in the specified intervals
-void synchronizeTime() {
-  DBG_PRINTLN("Synchronizing time...");
-  uint32_t gpsEpoch = 0; // Request time synchronization from the network
-  for (int i = 0; i < 8; i++) {
-    delay(((unsigned long)syncFailedResyncIntervalsInMinutes[i]) * 60 * 1000); // Wait for the specified time interval
-    gpsEpoch = getTimeRequestTimestamp(); // Retry time synchronization
-    DBG_PRINT("GPS epoch: ");DBG_PRINTLN(gpsEpoch);
-    if (gpsEpoch != 0) break;
+void linkApply() {
+  lora.SetDataRate(linkDataRate);
+  lora.SetPower(linkPowerDbm);
+  TRACE2(LINK_ADR, linkDataRate, linkPowerDbm)
+}
+// after an uplink with a link check or a DeviceTimeReq - a miss is asked again with the next uplink up to
+// LINK_CHECK_RETRIES times, after that the checks keep to the interval until one is answered
+void linkChecked(bool answered) {
+  linkUplinksSinceCheck = 0;
+  if (answered) {
+    linkMisses = 0;
+    return;
   }
-  if (gpsEpoch == 0) {
-    DBG_PRINTLN("Failed to synchronize time.");
-    overrideTimeSynchronization = 1; // Set flag to turn off time synchronization
-    reportSettingsByUplink(); // Report settings to the network
+  if (linkMisses >= LINK_CHECK_RETRIES) {
     return;
-  }   
-
-  #if USE_HW_RTC
-    DateTime now(gpsEpoch + GPS_TO_UNIX_OFFSET + (TIMEZONE_OFFSET_HOURS * 3600)); // lora epoch is GPS epoch -> has to be converted to unix epoch + timezone offset
-    rtc.adjust(now);
-    lastSyncEpoch = rtc.now().unixtime();
-    DBG_PRINT_CURRENT_TIME();
-    DBG_PRINT("GPS epoch: ");
-    DBG_PRINTLN(gpsEpoch);
-    DBG_PRINT("fracSecond ms: ");
-    DBG_PRINTLN(lora.fracSecond);
-    #if TEST_RTC_VS_LORA_TIME
-      DBG_PRINT("RTC sync after: ");
-      DBG_PRINT_RTC_TIME();
-      DBG_PRINTLN(gpsEpoch);
-      unsigned long startMillis = millis();
-      while (Serial.available() < 12 && millis() - startMillis < 20000) {
-
-      digitalWrite(LED_BUILTIN, HIGH);  // LED on
-      delay(50);
-      digitalWrite(LED_BUILTIN, LOW);   // LED off
-      delay(50);
-      }
-      if (Serial.available() >= 12) {
-        int year = Serial.parseInt();
-        int month = Serial.parseInt();
-        int day = Serial.parseInt();
-        int hour = Serial.parseInt();
-        int minute = Serial.parseInt();
-        int second = Serial.parseInt();
-
-        DBG_PRINT("Serial Time: ");
-        printDateTime(year, month, day, hour, minute, second);
-        DBG_PRINT_RTC_TIME();
-      }
-    #endif
-  #else 
-    setTime((gpsEpoch + GPS_TO_UNIX_OFFSET + (TIMEZONE_OFFSET_HOURS * 3600))); // Set the time 
-    lastSyncEpoch = now(); 
+  }
+  if (linkCheckInterval > 0) {
+    linkUplinksSinceCheck = linkCheckInterval - 1;
+  }
+  #if LINK_ADAPTATION
+    if (linkMisses + 1 == LINK_ADR_MAX_MISSES) {
+      linkFallback(); // and one more check at the slowest data rate
+    }
   #endif
-
-  return;
+  linkMisses++;
 }
-// proceeds MAC DeviceTimeReq and returns LoRaWAN timestamp in GPS epoch format
-uint32_t getTimeRequestTimestamp() {
-  uint32_t ret = 0;
-  lora.epoch = 0;
-  lora.LoRaWANreceived = 0;
-  lora.TimeLinkCheck = 1; // Request time synchronization
-  uint8_t emptyPayload[1] = {0}; // Empty payload for the request
-
-  DBG_PRINTLN("Sending request...");
-
-  lora.SendData(3, emptyPayload, 1); // Send the request port 3 has no formater setup 
-
-  DBG_PRINT("Time request sent");
-  DBG_PRINT("LoRaWAN flags: ");
-  DBG_PRINTLN_HEX(lora.LoRaWANreceived);
-
-  if ((lora.LoRaWANreceived & 0x40) == 0x40) {
-      ret = lora.epoch;
+#if LINK_ADAPTATION
+// after every uplink - answered: it carried a LinkCheckReq and the LinkCheckAns came
+void linkAdapt(bool answered) {
+  if (!answered && lora.downlinkSize == 0) {
+    return;
   }
-
-  DBG_PRINT("GPS epoch: ");
-  DBG_PRINTLN(lora.epoch);
-  DBG_PRINT_CURRENT_TIME();
-  DBG_PRINT("RAW epoch from network: ");
-  DBG_PRINTLN(lora.epoch);
-
-  return ret;
-}
-// check if the time resync is schadduled for now - if the last sync was more than realTimeResyncIntervalDays days ago
-void checkForTimeResync() {
-  uint32_t currentEpoch;
-  #if USE_HW_RTC
-    DateTime now = rtc.now();
-    currentEpoch = now.unixtime(); // aktuální čas v epoch
-  #else
-    currentEpoch = now(); 
-  #endif
-  if(lastSyncEpoch == 0){
-    lastSyncEpoch = currentEpoch - (realTimeResyncIntervalDays * 86400UL)/3; // set last sync to 3 days ago if it is not set yet or was lost due to power off
+  int16_t margin = linkDownlinkMarginDb();
+  if (answered) {
+    linkMarginDb = lora.LinkMargin;
+    TRACE2(LINK_CHECK, lora.LinkMargin, lora.LinkGateways)
+    if (lora.LinkMargin < margin) {
+      margin = lora.LinkMargin;
+    }
   }
-  if ((currentEpoch - lastSyncEpoch) >= (realTimeResyncIntervalDays * 86400UL)) {
-    synchronizeTime(); // Synchronize time if the interval has passed
+  int16_t spare = margin - linkMarginTargetDb;
+  if (spare < 0) {
+    linkGoodChecks = 0;
+    linkStepSlower();
+  } else if (answered && spare >= LINK_ADR_STEP_DB + LINK_ADR_HYSTERESIS_DB) {
+    if (linkGoodChecks == 0 || spare < linkSpareDb) {
+      linkSpareDb = spare;
+    }
+    if (++linkGoodChecks >= LINK_ADR_CONFIRM_CHECKS) {
+      linkGoodChecks = 0;
+      linkStepFaster((linkSpareDb - LINK_ADR_HYSTERESIS_DB) / LINK_ADR_STEP_DB);
+    }
+  } else if (answered) {
+    linkGoodChecks = 0;
   }
 }
-// clear EEPROM SlimLoRa session data - for change of the session keys or for testing
-void clearSessionEEPROM() {
-  DBG_PRINTLN(F("Clearing session EEPROM..."));
-  for (uint16_t addr = 0; addr < EEPROM_END; addr++) {
-      EEPROM.write(addr, 0xFF);  // Nastaví všechny byty na 0xFF, což je vymazaný stav
-  }
+// uplink margin estimated from the downlink just received - the path back at our TX power, the worse of SNR above the
+// demodulation floor and RSSI above the sensitivity of the data rate (SX1276, 125 kHz: SF12 -20 dB / -137 dBm,
+// 2.5 dB / 3 dB more per step to SF7, rounded up)
+int16_t linkDownlinkMarginDb() {
+  uint8_t sfSteps = 12 - dataRateSpreadingFactor(linkDataRate);
+  int16_t snrFloorDb = -20 + (sfSteps * 5 + 1) / 2;
+  int16_t sensitivityDbm = -137 + 3 * sfSteps - (linkDataRate == SF7BW250 ? 3 : 0);
+  int16_t power = LINK_GATEWAY_POWER_DBM - linkPowerDbm;
+  int16_t snrMargin = lora.packetSnr - power - snrFloorDb;
+  int16_t rssiMargin = lora.packetRssi - power - sensitivityDbm;
+  return snrMargin < rssiMargin ? snrMargin : rssiMargin;
 }
-// Read configuration from EEPROM - save config settings to eeprom if config version changes 
-void loadConfigFromEEPROM() {
-  if (EEPROM.read(EEPROM_FIRMWARE_CONFIG_VERSION) != FIRMWARE_CONFIG_VERSION) { 
-    saveConfigToEEPROM(); // backup configuration to EEPROM if the EEPROM is empty or the version is different
+// more margin - the TX power first, the data rate once it is at the max
+void linkStepSlower() {
+  if (linkPowerDbm < linkMaxPowerDbm) {
+    linkPowerDbm += 2;
+  } else if (linkDataRate > linkMinDataRate) {
+    linkDataRate--;
+  } else {
     return;
-  }else{
-    DBG_PRINTLN("EEPROM backup found, reading...");
-    sendIntervalMinutes = EEPROM.read(EEPROM_SEND_INTERVAL) | (EEPROM.read(EEPROM_SEND_INTERVAL+1) << 8);
-    spsCleanIntervalDays = EEPROM.read(EEPROM_SPS_CLEAN_INTERVAL); 
-    spsStabilizationPreReadoutDelay = EEPROM.read(EEPROM_SPS_STABILIZATION_PRE_READOUT_DELAY);
-    spsStopAfterReadout = EEPROM.read(EEPROM_SPS_STOP_AFTER_READOUT); 
-    realTimeResyncIntervalDays = EEPROM.read(EEPROM_REAL_TIME_RESYNC_INTERVAL); 
-    overrideTimeSynchronization = EEPROM.read(EEPROM_OVERRIDE_TIME_SYNCHRONIZATION); 
-    allowDeepSleep = EEPROM.read(EEPROM_ALLOW_DEEP_SLEEP); 
-    DBG_PRINT(F("EEPROM backup loaded"));
-  }
-  return;
-}
-// Save configuration to EEPROM - for keeping OTA configurable settings after power off
-void saveConfigToEEPROM() {
-    DBG_PRINTLN("Backing up configuration to EEPROM...");
-    EEPROM.write(EEPROM_FIRMWARE_CONFIG_VERSION, FIRMWARE_CONFIG_VERSION); 
-    EEPROM.write(EEPROM_SEND_INTERVAL, (sendIntervalMinutes & 0xFF)); 
-    EEPROM.write(EEPROM_SEND_INTERVAL + 1, ((sendIntervalMinutes >> 8) & 0xFF)); 
-    EEPROM.write(EEPROM_SPS_CLEAN_INTERVAL, spsCleanIntervalDays); 
-    EEPROM.write(EEPROM_SPS_STABILIZATION_PRE_READOUT_DELAY, spsStabilizationPreReadoutDelay); 
-    EEPROM.write(EEPROM_SPS_STOP_AFTER_READOUT, spsStopAfterReadout); 
-    EEPROM.write(EEPROM_REAL_TIME_RESYNC_INTERVAL, realTimeResyncIntervalDays); 
-    EEPROM.write(EEPROM_OVERRIDE_TIME_SYNCHRONIZATION, overrideTimeSynchronization); 
-    EEPROM.write(EEPROM_ALLOW_DEEP_SLEEP, allowDeepSleep); 
-  return;
+  }
+  linkApply();
 }
-void manageSessionKeyChange() {
-  for (uint8_t i = 0; i < 8; i++)
-  {
-    DBG_PRINT(F(" config: ")); DBG_PRINT_HEX(DevEUI[i]);DBG_PRINT(F(" EEPROM: ")); 
-    DBG_PRINT_HEX(EEPROM.read(EEPROM_DEVEUI + i)); 
-    if (EEPROM.read(EEPROM_DEVEUI + i) != DevEUI[i]) {
-      DBG_PRINTLN(F(" Session key changed, clearing EEPROM session."));
-      clearSessionEEPROM(); // Clear EEPROM if the session keys are different
-      for (uint8_t j = 0; j < 8; j++)
-      {
-        EEPROM.write(EEPROM_DEVEUI + j, DevEUI[j]); // Save the new DevEUI to EEPROM
-      }
-      return;
+// less airtime and charge - the data rate first, the TX power once it is at the max data rate
+void linkStepFaster(uint8_t steps) {
+  uint8_t dataRate = linkDataRate, power = linkPowerDbm;
+  for (; steps > 0; steps--) {
+    if (linkDataRate < linkMaxDataRate) {
+      linkDataRate++;
+    } else if (linkPowerDbm > linkMinPowerDbm) {
+      linkPowerDbm -= 2;
     }
-    
   }
-  DBG_PRINTLN(F(" Session keys checked."));
-  return;
+  if (linkDataRate != dataRate || linkPowerDbm != power) {
+    linkApply();
+  }
 }
-// control the time slotting - wait for the next time slot to send data
-void waitUntilNextSlot() {
-  uint32_t nowEpoch;
-  if(overrideTimeSynchronization == 0){
-    #if USE_HW_RTC
-      DateTime now = rtc.now();
-      nowEpoch = now.unixtime();
-    #else
-      if (now() == 0) {
-        DBG_PRINTLN(F("Time not synchronized, resyncing..."));
+#endif // LINK_ADAPTATION
+// link checks or join requests unanswered too often - the slowest data rate at the max power
+void linkFallback() {
+  linkGoodChecks = 0;
+  if (linkDataRate == linkMinDataRate && linkPowerDbm == linkMaxPowerDbm) {
+    return;
+  }
+  TRACE2(LINK_FALLBACK, linkDataRate, linkPowerDbm)
+  linkDataRate = linkMinDataRate;
+  linkPowerDbm = linkMaxPowerDbm;
+  linkApply();
+}
+// EU868 TX power of a setting - 2-14 dBm in 2 dB steps
+uint8_t linkPowerStep(uint8_t dbm) {
+  return dbm < 2 ? 2 : (dbm > 14 ? 14 : dbm & ~1);
+}
+// true if the station has a LoRaWAN session
+bool isJoined() {
+  #if LORAWAN_OTAA_ENABLED && LORAWAN_KEEP_SESSION
+    return lora.GetHasJoined();
+  #elif LORAWAN_OTAA_ENABLED
+    return lora.HasJoined();
+  #else
+    return true;
+  #endif
+}
+// send the reading in payload - with store and forward it is kept until the network is known to be reachable
+void sendReading(uint32_t epoch) {
+  #if STORE_AND_FORWARD
+    if (!isJoined()) {
+      joinIfDue();
+      if (!isJoined()) {
+        storeAppend(epoch, payload); // reading stays in the store
+        storeLinkDown = true;
+        storeResentFrom = storeResentTo = STORE_NONE;
+        dropMultiSampleFrame();      // readings sent or resent since the last confirmation or collected for the next frame are resent later
+        return;
+      }
+      if (timeSyncPending) {
+        timeSyncPending = false;
         synchronizeTime();
       }
-      nowEpoch = now(); 
-    #endif
-
-  
-    uint32_t currentSlot = (nowEpoch / 60) / sendIntervalMinutes;
-    nextSlotEpoch = (currentSlot * sendIntervalMinutes * 60) + (sendIntervalMinutes * 60);
-    if (currentSlot == lastSentSlot) {
-      currentSlot = currentSlot + sendIntervalMinutes * 60;
     }
-
-    lastSentSlot = currentSlot; 
-
-    uint8_t currentMinute = (nowEpoch / 60) % 60;
-    uint8_t currentSecond = nowEpoch % 60;
-
-    uint8_t remainder = currentMinute % sendIntervalMinutes;
-    uint8_t waitMinutes = (remainder == 0 && currentSecond == 0) ? 0 : sendIntervalMinutes - remainder;
-    uint16_t waitSeconds = (waitMinutes * 60) - currentSecond;
-    if(spsStopAfterReadout == 1){
-      if (waitSeconds >= spsStabilizationPreReadoutDelay * 60 ) { 
-        waitSeconds = (waitSeconds - spsStabilizationPreReadoutDelay * 60); 
-      }
-      else{
-        return; 
-      }
+  #else
+    (void)epoch;
+  #endif
+    // a started frame goes out first if the reading does not fit in or the frame would not describe it
+    bool frameClosed = multiSampleLength > 0 && (multiSampleCount(multiSampleFrame) >= MULTI_SAMPLE_MAX_COUNT ||
+        sendIntervalMinutes != multiSampleInterval ||
+        multiSampleLength + multiSampleDeltaLength(multiSampleFrame, multiSamplePrevious, payload) > MULTI_SAMPLE_MAX_LENGTH);
+    if (frameClosed && !sendMultiSampleFrame()) {
+      dropMultiSampleFrame(); // airtime limits held the frame back for too long
     }
-    DBG_PRINT(F("waiting for next slot: "));
-    DBG_PRINT(waitSeconds);
-    DBG_PRINTLN(F(" seconds."));
-
-    if (waitSeconds > 0){
-      if (allowDeepSleep == 1)
-      {
-        deepSleepMillis((waitSeconds * 1000UL));
-      }else{
-        delay(waitSeconds * 1000UL);
+  #if STORE_AND_FORWARD
+    uint16_t slot = storeAppend(epoch, payload);
+    if (storeSentFrom == STORE_NONE) {
+      storeSentFrom = slot;
+    }
+  #endif
+    if (samplesPerFrame <= 1 && multiSampleLength == 0) {
+      if (transmitReadings(fport, payload, payload_length)) {
+        return;
+      }
+      TRACE0(READING_MERGED)
+    }
+    // collect the reading - a frame held back by the airtime limits takes it as well
+    if (multiSampleLength == 0) {
+      multiSampleInterval = sendIntervalMinutes;
+      multiSampleLength = multiSampleStart(multiSampleFrame, multiSampleInterval, MULTI_SAMPLE_DROP_BITS, payload);
+      memcpy(multiSamplePrevious, payload, MULTI_SAMPLE_KEYFRAME_LENGTH);
+    } else {
+      multiSampleLength = multiSampleAppend(multiSampleFrame, multiSampleLength, multiSamplePrevious, payload);
+    }
+    if (multiSampleCount(multiSampleFrame) >= samplesPerFrame) {
+      sendMultiSampleFrame();
+    }
+}
+bool sendMultiSampleFrame() {
+  TRACE1(FRAME_SENT, multiSampleCount(multiSampleFrame))
+  if (!transmitReadings(MULTI_SAMPLE_FPORT, multiSampleFrame, multiSampleLength)) {
+    return false;
+  }
+  multiSampleLength = 0;
+  return true;
+}
+// forget the collected readings - with store and forward they stay pending and are resent on port 2
+void dropMultiSampleFrame() {
+  multiSampleLength = 0;
+  #if STORE_AND_FORWARD
+    storeSentFrom = STORE_NONE; // readings sent since the last confirmation are resent as well
+  #endif
+}
+// uplink of all readings collected since the last uplink - with store and forward they are confirmed by the next
+// answered link check, a confirmed link resends some stored readings after it
+// false if the airtime limits deferred it
+bool transmitReadings(uint8_t port, uint8_t *data, uint8_t length) {
+    if (timeSyncDue()) { // a due time sync rides on the uplink as well
+      lora.epoch = 0;
+      lora.LoRaWANreceived = 0;
+      lora.TimeLinkCheck = 1;
+    }
+    // a pending config ack rides along - data has room for it up to MULTI_SAMPLE_MAX_LENGTH, otherwise it waits
+    bool ack = configAckPending && length + CONFIG_ACK_LENGTH <= MULTI_SAMPLE_MAX_LENGTH;
+    if (ack) {
+      data[length] = configHash();
+      data[length + 1] = configAckStatus;
+      if (port == MULTI_SAMPLE_FPORT) {
+        data[0] |= MULTI_SAMPLE_CONFIG_ACK;
+      }
+    }
+    bool sent = sendUplink(port, data, ack ? length + CONFIG_ACK_LENGTH : length);
+    if (port == MULTI_SAMPLE_FPORT) {
+      data[0] &= ~MULTI_SAMPLE_CONFIG_ACK; // a deferred frame may grow before it goes out
+    }
+    if (!sent) {
+      return false;
+    }
+    if (ack) {
+      configAckPending = false;
+    }
+    if ((linkRequests & 0x01) && syncRetryEpoch != 0) {
+      timeSyncAnswer(); // first - the answer is dated from the return of SendData()
+    }
+  #if STORE_AND_FORWARD
+    if (!storeLinkDown) {
+      storeDrain();
+    }
+  #endif
+    return true;
+}
+// uplink within the airtime limits - waits up to AIRTIME_MAX_WAIT_SECONDS for the duty cycle, false if deferred
+bool sendUplink(uint8_t port, uint8_t *data, uint8_t length) {
+  #if STORE_AND_FORWARD || LINK_ADAPTATION
+    // one link check every linkCheckInterval-th uplink - a deferred one goes with the next uplink
+    if (linkCheckInterval && ++linkUplinksSinceCheck >= linkCheckInterval) {
+      lora.LoRaWANreceived &= ~LINK_CHECK_ANSWERED;
+      lora.TimeLinkCheck |= LINK_CHECK_REQUEST;
+    }
+  #endif
+  uint8_t requests = lora.TimeLinkCheck; // SendData() clears it
+  uint8_t fOptsLength = (requests & 0x01) + ((requests & 0x02) ? 1 : 0); // DeviceTimeReq and LinkCheckReq, one byte each
+  uint32_t airtime = uplinkAirtimeMicros(linkDataRate, length, fOptsLength);
+  uint32_t wait;
+  while ((wait = airtimeWaitSeconds(airtime)) > 0) {
+    if (wait > AIRTIME_MAX_WAIT_SECONDS) {
+      TRACE1(UPLINK_DEFERRED, port)
+      lora.TimeLinkCheck = 0;
+      return false;
+    }
+    TRACE1(DUTY_CYCLE_WAIT, wait)
+    waitMillis(wait * 1000UL);
+  }
+  TRACE2(UPLINK, port, length)
+  uint32_t radioMillis = millis();
+  lora.SendData(port, data, length);
+  timeAnswerMillis = millis(); // SendData() returns once RX1 or RX2 is over
+  timeAnswerDataRate = linkDataRate;
+  telemetryAddMillis(TELEMETRY_RADIO, timeAnswerMillis - radioMillis);
+  telemetryCount(TELEMETRY_UPLINKS);
+  airtimeCharge(airtime);
+  linkRequests = requests;
+  if (requests) {
+    bool answered = ((requests & 0x01) && (lora.LoRaWANreceived & 0x40)) || ((requests & 0x02) && (lora.LoRaWANreceived & 0x20));
+    linkChecked(answered);
+  #if STORE_AND_FORWARD
+    storeLinkChecked(answered);
+  #endif
+  }
+  #if LINK_ADAPTATION
+    linkAdapt((requests & LINK_CHECK_REQUEST) && (lora.LoRaWANreceived & LINK_CHECK_ANSWERED));
+  #endif
+  return true;
+}
+// join request - never deferred, but it counts against the limits like any uplink
+void joinNetwork() {
+  uint32_t radioMillis = millis();
+  lora.Join();
+  telemetryAddMillis(TELEMETRY_RADIO, millis() - radioMillis);
+  telemetryCount(TELEMETRY_JOIN_REQUESTS);
+  airtimeCharge(joinAirtimeMicros(linkDataRate));
+}
+// join state from EEPROM - the first join request comes at a random time within the backoff reached, so stations
+// powered up together do not join together
+void joinLoad() {
+  EEPROM.get(EEPROM_JOIN_STATE_START, joinState);
+  if (crc8((uint8_t *)&joinState, sizeof(JoinState) - 1) != joinState.crc) {
+    joinState.failures = 0;
+  }
+  joinStartEpoch = getCurrentEpoch();
+  randomSeed(((uint32_t)slotOffsetFromDevEUI(DevEUI, 0xFFFF) << 16) ^ joinStartEpoch); // differs per station and per power-up
+  joinNextEpoch = joinStartEpoch + random(joinBackoffLimitSeconds(joinState.failures) + 1);
+}
+// join request if the backoff has run out - true if it got the station joined
+bool joinIfDue() {
+  uint32_t epoch = getCurrentEpoch();
+  if ((int32_t)(epoch - joinNextEpoch) < 0) {
+    return false;
+  }
+  TRACE1(JOIN_ATTEMPT, joinState.failures + 1)
+  lora.Begin();
+  joinNetwork();
+  epoch = getCurrentEpoch();
+  bool joined = lora.HasJoined();
+  if (joined) {
+    joinSeconds = epoch - joinStartEpoch;
+    TRACE2(JOINED, joinSeconds, joinState.failures + 1)
+    joinState.failures = 0;
+  } else {
+    if (joinState.failures < 0xFF) {
+      joinState.failures++;
+    }
+    uint32_t limit = joinBackoffLimitSeconds(joinState.failures);
+    uint32_t wait = limit / 2 + random(limit / 2 + 1);
+    uint32_t dutyCycle = joinDutyCycleSeconds(joinAirtimeMicros(linkDataRate), epoch - joinStartEpoch);
+    if (wait < dutyCycle) {
+      wait = dutyCycle;
+    }
+    joinNextEpoch = epoch + wait;
+    TRACE1(JOIN_BACKOFF, wait)
+    if (joinState.failures >= LINK_ADR_MAX_MISSES) {
+      linkFallback(); // the next join requests go out at the slowest data rate
+    }
+  }
+  joinState.crc = crc8((uint8_t *)&joinState, sizeof(JoinState) - 1);
+  EEPROM.put(EEPROM_JOIN_STATE_START, joinState);
+  return joined;
+}
+// seconds until the backoff allows the next join request
+uint32_t joinWaitSeconds() {
+  int32_t wait = (int32_t)(joinNextEpoch - getCurrentEpoch());
+  return wait > 0 ? wait : 0;
+}
+// upper limit of the random delay after the failures-th unanswered join request in a row - doubles from JOIN_BACKOFF_MIN_SECONDS
+uint32_t joinBackoffLimitSeconds(uint8_t failures) {
+  uint32_t limit = JOIN_BACKOFF_MIN_SECONDS;
+  for (uint8_t i = 1; i < failures && limit < JOIN_BACKOFF_MAX_SECONDS; i++) {
+    limit <<= 1;
+  }
+  return limit < JOIN_BACKOFF_MAX_SECONDS ? limit : JOIN_BACKOFF_MAX_SECONDS;
+}
+// silence after a join request the LoRaWAN join duty cycle asks for, from the time spent joining since power-up
+uint32_t joinDutyCycleSeconds(uint32_t airtimeMicros, uint32_t joiningSeconds) {
+  uint16_t silence = joiningSeconds < 3600UL ? 99 : (joiningSeconds < 11 * 3600UL ? 999 : 9999); // 1 %, 0.1 %, 0.01 %
+  return ((airtimeMicros / 1000) * silence + 999) / 1000;
+}
+// seconds until an uplink of airtimeMicros is within the duty cycle and the rolling budget
+uint32_t airtimeWaitSeconds(uint32_t airtimeMicros) {
+  airtimeRefill();
+  uint32_t wait = dutyCycleFreeEpoch > airtimeRefillEpoch ? dutyCycleFreeEpoch - airtimeRefillEpoch : 0;
+  if (airtimeMicros > airtimeBudgetMicros) {
+    uint32_t budgetWait = (airtimeMicros - airtimeBudgetMicros) / AIRTIME_REFILL_MICROS_PER_SECOND + 1;
+    if (budgetWait > wait) {
+      wait = budgetWait;
+    }
+  }
+  return wait;
+}
+// book an uplink - it takes its airtime from the budget and closes the band for 99x its airtime
+void airtimeCharge(uint32_t airtimeMicros) {
+  telemetryAddMillis(TELEMETRY_TX, (airtimeMicros + 500) / 1000);
+  airtimeRefill();
+  airtimeBudgetMicros -= airtimeMicros < airtimeBudgetMicros ? airtimeMicros : airtimeBudgetMicros;
+  dutyCycleFreeEpoch = airtimeRefillEpoch + (airtimeMicros * (100 / DUTY_CYCLE_PERCENT - 1) + 999999UL) / 1000000UL;
+}
+// refill the budget for the time passed since the last call
+void airtimeRefill() {
+  uint32_t nowEpoch = getCurrentEpoch();
+  if (airtimeRefillEpoch == 0 || nowEpoch < airtimeRefillEpoch) {
+    airtimeRefillEpoch = nowEpoch; // first call or the clock was set back by a time sync
+    dutyCycleFreeEpoch = 0;
+    return;
+  }
+  uint32_t elapsed = nowEpoch - airtimeRefillEpoch;
+  if (elapsed >= AIRTIME_BUDGET_MICROS / AIRTIME_REFILL_MICROS_PER_SECOND) {
+    airtimeBudgetMicros = AIRTIME_BUDGET_MICROS;
+  } else {
+    airtimeBudgetMicros += elapsed * AIRTIME_REFILL_MICROS_PER_SECOND;
+    if (airtimeBudgetMicros > AIRTIME_BUDGET_MICROS) {
+      airtimeBudgetMicros = AIRTIME_BUDGET_MICROS;
+    }
+  }
+  airtimeRefillEpoch = nowEpoch;
+}
+// pause between radio activities - in deep sleep if allowed
+void waitMillis(uint32_t ms) {
+  if (allowDeepSleep == 1) {
+    deepSleepMillis(ms);
+  } else {
+    idleMillis(ms);
+  }
+}
+// CPU in idle - Timer0 keeps millis() running and wakes it every 1 ms
+void idleMillis(uint32_t ms) {
+  telemetryAddMillis(TELEMETRY_IDLE, ms);
+  uint32_t start = millis();
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  while (millis() - start < ms) {
+    sleep_cpu();
+  }
+  sleep_disable();
+}
+// start a task with its first step due now
+void taskStart(uint8_t id, uint16_t timeoutMillis) {
+  uint32_t now = millis();
+  tasks[id].dueMillis = now;
+  tasks[id].deadlineMillis = now + timeoutMillis;
+  tasks[id].running = true;
+}
+// run the started tasks until all are done or expired - idle until the next step or deadline is due
+void runTasks() {
+  for (;;) {
+    bool running = false;
+    int32_t wait = 0;
+    for (uint8_t i = 0; i < TASK_COUNT; i++) {
+      Task &task = tasks[i];
+      if (!task.running) {
+        continue;
+      }
+      uint32_t now = millis();
+      if ((int32_t)(now - task.deadlineMillis) >= 0) {
+        task.running = false;
+        task.expire();
+        continue;
+      }
+      if ((int32_t)(now - task.dueMillis) >= 0) {
+        uint16_t next = task.step();
+        if (next == TASK_DONE) {
+          task.running = false;
+          continue;
+        }
+        now = millis();
+        task.dueMillis = now + next;
+      }
+      int32_t due = (int32_t)(task.dueMillis - now);
+      int32_t deadline = (int32_t)(task.deadlineMillis - now);
+      due = due < deadline ? due : deadline;
+      if (!running || due < wait) {
+        wait = due;
+      }
+      running = true;
+    }
+    if (!running) {
+      return;
+    }
+    if (wait > 0) {
+      idleMillis(wait);
+    }
+  }
+}
+// read both sensors at once into temp, hum and m
+void readSensors() {
+  taskStart(TASK_HTU21D, HTU21D_TIMEOUT_MILLIS);
+  taskStart(TASK_SPS30, SPS30_TIMEOUT_MILLIS);
+  spsWaitStartMillis = millis();
+  runTasks();
+}
+// the last sensor values as a reading in thousandths - the wake error is left to the caller
+void sensorReading(Port1Fields &reading) {
+  reading.temp = temp == HTU21D_NONE ? SFLT16_NONE : temp * 10L;
+  reading.hum = hum == HTU21D_NONE ? SFLT16_NONE : hum * 10L;
+  if (!spsValid) {
+    reading.mc_1p0 = reading.mc_2p5 = reading.mc_4p0 = reading.mc_10p0 = SFLT16_NONE;
+    reading.nc_0p5 = reading.nc_1p0 = reading.nc_2p5 = reading.nc_4p0 = reading.nc_10p0 = SFLT16_NONE;
+    reading.typical_particle_size = SFLT16_NONE;
+    return;
+  }
+  reading.mc_1p0 = m.mc_1p0 * 1000L;
+  reading.mc_2p5 = m.mc_2p5 * 1000L;
+  reading.mc_4p0 = m.mc_4p0 * 1000L;
+  reading.mc_10p0 = m.mc_10p0 * 1000L;
+  reading.nc_0p5 = m.nc_0p5 * 1000L;
+  reading.nc_1p0 = m.nc_1p0 * 1000L;
+  reading.nc_2p5 = m.nc_2p5 * 1000L;
+  reading.nc_4p0 = m.nc_4p0 * 1000L;
+  reading.nc_10p0 = m.nc_10p0 * 1000L;
+  reading.typical_particle_size = m.typical_particle_size; // nm are thousandths of um
+}
+#if OVERSAMPLE_PERIOD_SECONDS
+// read both sensors every OVERSAMPLE_PERIOD_SECONDS until the slot, the readout at the slot adds the last sample -
+// the SPS30 is left out until it settled after a start
+void oversampleUntilSlot() {
+  memset(oversample, 0, sizeof(oversample));
+  if (overrideTimeSynchronization == 1) {
+    return; // no slot to sample towards
+  }
+  uint32_t nowEpoch = getCurrentEpoch();
+  uint32_t settledEpoch = nowEpoch + (spsStopAfterReadout == 1 ? OVERSAMPLE_SETTLE_SECONDS : 0);
+  while (nowEpoch + OVERSAMPLE_PERIOD_SECONDS < nextSlotEpoch) {
+    waitMillis(OVERSAMPLE_PERIOD_SECONDS * 1000UL);
+    readSensors();
+    Port1Fields reading;
+    sensorReading(reading);
+    nowEpoch = getCurrentEpoch();
+    oversampleAdd(reading, (int32_t)(nowEpoch - settledEpoch) >= 0 ? OVERSAMPLE_FIELDS : OVERSAMPLE_HTU_FIELDS);
+  }
+}
+// add the first fields of a reading to the statistics - SFLT16_NONE (sensor failed) is not a sample
+void oversampleAdd(const Port1Fields &reading, uint8_t fields) {
+  const int32_t values[OVERSAMPLE_FIELDS] = {
+    reading.temp, reading.hum, reading.mc_1p0, reading.mc_2p5, reading.mc_4p0, reading.mc_10p0,
+    reading.nc_0p5, reading.nc_1p0, reading.nc_2p5, reading.nc_4p0, reading.nc_10p0, reading.typical_particle_size};
+  for (uint8_t i = 0; i < fields; i++) {
+    FieldStats &s = oversample[i];
+    if (values[i] == SFLT16_NONE || s.count == 255) {
+      continue;
+    }
+    const int16_t step = 1000 / oversampleUnits[i]; // thousandths per code
+    int32_t scaled = (values[i] + (values[i] < 0 ? -step / 2 : step / 2)) / step;
+    int16_t code = scaled >= 32767 ? 32767 : (scaled <= -32767 ? -32767 : (int16_t)scaled);
+    if (s.count == 0) {
+      s.first = s.min = s.max = code;
+    }
+    int32_t deviation = (int32_t)code - s.first;
+    uint32_t magnitude = deviation < 0 ? -deviation : deviation;
+    uint32_t square = magnitude * magnitude; // fits, |deviation| < 2^16
+    s.sum += deviation;
+    s.sumSquares = square > UINT32_MAX - s.sumSquares ? UINT32_MAX : s.sumSquares + square;
+    if (code < s.min) {
+      s.min = code;
+    }
+    if (code > s.max) {
+      s.max = code;
+    }
+    s.count++;
+  }
+}
+// mean of the samples without the lowest and the highest once there are 3 or more - a spike does not become the reading;
+// in thousandths, rounded
+int32_t oversampleValue(const FieldStats &s, uint16_t units) {
+  if (s.count == 0) {
+    return SFLT16_NONE;
+  }
+  int32_t sum = s.sum;
+  uint8_t count = s.count;
+  if (count >= 3) {
+    sum -= (int32_t)s.min + s.max - 2 * (int32_t)s.first;
+    count -= 2;
+  }
+  const int16_t step = 1000 / units;
+  sum *= step; // fits, 253 deviations of less than 2^16 codes of at most 100 thousandths
+  return (int32_t)s.first * step + (sum + (sum < 0 ? -(int32_t)count / 2 : (int32_t)count / 2)) / count;
+}
+// sample standard deviation in thousandths, 0 below 2 samples
+int32_t oversampleDeviation(const FieldStats &s, uint16_t units) {
+  if (s.count < 2) {
+    return 0;
+  }
+  // sum^2 / count without a 64 bit product: with |sum| = q * count + r it is q^2 * count + 2 * q * r + r^2 / count,
+  // each term below sumSquares - a saturated sumSquares leaves it out, the deviation is large then anyway
+  const uint32_t magnitude = labs(s.sum);
+  const uint32_t q = magnitude / s.count;
+  const uint32_t r = magnitude % s.count;
+  const uint32_t meanSquares = s.sumSquares == UINT32_MAX ? 0 : q * magnitude + q * r + r * r / s.count;
+  if (meanSquares >= s.sumSquares) {
+    return 0;
+  }
+  const uint32_t variance = (s.sumSquares - meanSquares) / (s.count - 1);
+  const uint16_t step = 1000 / units;
+  return variance <= UINT32_MAX / step / step ? isqrt(variance * step * step) : (int32_t)isqrt(variance) * step;
+}
+// integer square root, rounded down
+uint16_t isqrt(uint32_t value) {
+  uint32_t root = 0;
+  for (uint32_t bit = 1UL << 30; bit; bit >>= 2) {
+    if (value >= root + bit) {
+      value -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+  }
+  return (uint16_t)root;
+}
+// the reading to send - every field replaced by its mean over the samples, SFLT16_NONE if the sensor gave none
+void oversampleMean(Port1Fields &reading) {
+  int32_t *values[OVERSAMPLE_FIELDS] = {
+    &reading.temp, &reading.hum, &reading.mc_1p0, &reading.mc_2p5, &reading.mc_4p0, &reading.mc_10p0,
+    &reading.nc_0p5, &reading.nc_1p0, &reading.nc_2p5, &reading.nc_4p0, &reading.nc_10p0, &reading.typical_particle_size};
+  for (uint8_t i = 0; i < OVERSAMPLE_FIELDS; i++) {
+    *values[i] = oversampleValue(oversample[i], oversampleUnits[i]);
+  }
+}
+#if OVERSAMPLE_STATS_UPLINK
+// min, max and standard deviation behind the reading of the slot at epoch on STATS_FPORT
+void sendOversampleStats(uint32_t epoch) {
+  Port6Fields stats;
+  int32_t *spread[] = {
+    &stats.temp_min, &stats.temp_max, &stats.temp_sd, &stats.hum_min, &stats.hum_max, &stats.hum_sd,
+    &stats.mc_1p0_min, &stats.mc_1p0_max, &stats.mc_1p0_sd, &stats.mc_2p5_min, &stats.mc_2p5_max, &stats.mc_2p5_sd,
+    &stats.mc_4p0_min, &stats.mc_4p0_max, &stats.mc_4p0_sd, &stats.mc_10p0_min, &stats.mc_10p0_max, &stats.mc_10p0_sd};
+  stats.epoch = epoch;
+  stats.htu_samples = oversample[0].count;
+  stats.sps_samples = oversample[OVERSAMPLE_HTU_FIELDS].count;
+  for (uint8_t i = 0; i < sizeof(spread) / sizeof(spread[0]) / 3; i++) {
+    const FieldStats &s = oversample[i];
+    const int16_t step = 1000 / oversampleUnits[i];
+    *spread[3 * i] = s.count ? (int32_t)s.min * step : SFLT16_NONE;
+    *spread[3 * i + 1] = s.count ? (int32_t)s.max * step : SFLT16_NONE;
+    *spread[3 * i + 2] = oversampleDeviation(s, oversampleUnits[i]);
+  }
+  uint8_t frame[PORT6_LENGTH];
+  encodePort6(stats, frame);
+  sendUplink(STATS_FPORT, frame, PORT6_LENGTH);
+}
+#endif
+#endif
+// HTU21D readout - temperature conversion, then humidity
+uint16_t htuStep() {
+  uint16_t raw;
+  uint8_t result;
+  switch (htuState) {
+    case 0:
+      temp = HTU21D_NONE;
+      hum = HTU21D_NONE;
+      if (!htuCommand(HTU21D_TRIGGER_TEMPERATURE)) {
+        TRACE1(HTU_ERROR, 1)
+        return TASK_DONE;
+      }
+      htuState = 1;
+      return HTU21D_TEMPERATURE_MILLIS;
+    case 1:
+      result = htuRead(raw);
+      if (result == 0) {
+        return HTU21D_POLL_MILLIS;
+      }
+      if (result == 1) {
+        temp = (int16_t)((17572L * raw >> 16) - 4685); // -46.85 + 175.72 * raw / 2^16 degC
+      }
+      if (!htuCommand(HTU21D_TRIGGER_HUMIDITY)) {
+        break;
+      }
+      htuState = 2;
+      return HTU21D_HUMIDITY_MILLIS;
+    default:
+      result = htuRead(raw);
+      if (result == 0) {
+        return HTU21D_POLL_MILLIS;
+      }
+      if (result == 1) {
+        hum = (int16_t)((12500L * raw >> 16) - 600);   // -6 + 125 * raw / 2^16 %RH
+      }
+      break;
+  }
+  htuState = 0;
+  return TASK_DONE;
+}
+// values not read by the deadline stay HTU21D_NONE
+void htuExpire() {
+  TRACE1(HTU_ERROR, 3)
+  htuState = 0;
+}
+// trigger a conversion or the soft reset, false if the sensor does not answer
+bool htuCommand(uint8_t command) {
+  Wire.beginTransmission(HTU21D_I2C_ADDRESS);
+  Wire.write(command);
+  return Wire.endTransmission() == 0;
+}
+// 0 = conversion still running, 1 = raw holds the result, 2 = CRC error
+uint8_t htuRead(uint16_t &raw) {
+  if (Wire.requestFrom((uint8_t)HTU21D_I2C_ADDRESS, (uint8_t)3) != 3) {
+    return 0;
+  }
+  uint8_t data[3];
+  for (uint8_t i = 0; i < 3; i++) {
+    data[i] = Wire.read();
+  }
+  if (crc8(data, 2) != data[2]) {
+    TRACE1(HTU_ERROR, 2)
+    return 2;
+  }
+  raw = (uint16_t)(data[0] << 8 | data[1]) & 0xFFFC; // the low 2 bits are status
+  return 1;
+}
+// CRC-8, polynomial x^8 + x^5 + x^4 + 1 - the HTU21D checksum, used for the config log as well; the SPS30 starts from 0xFF
+uint8_t crc8(const uint8_t *data, uint8_t length, uint8_t crc) {
+  for (uint8_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+// SPS30 readout - polls data ready, a failing read is retried until the deadline
+uint16_t sps30Step() {
+  uint16_t words[SPS30_MEASUREMENT_WORDS];
+  uint8_t error = spsRead(SPS30_READ_DATA_READY, words, 1);
+  if (error) {
+    TRACE1(SPS_ERROR, error)
+    return SPS30_POLL_MILLIS;
+  }
+  if (!(words[0] & 1)) {
+    return SPS30_POLL_MILLIS;
+  }
+  if (spsRead(SPS30_READ_MEASUREMENT, words, SPS30_MEASUREMENT_WORDS)) {
+    return SPS30_POLL_MILLIS;
+  }
+  memcpy(&m, words, sizeof(m));
+  spsValid = true;
+  telemetryAddMillis(TELEMETRY_SPS_WAIT, millis() - spsWaitStartMillis);
+  return TASK_DONE;
+}
+// no data by the deadline - the reading goes out without PM values and the measurement is restarted
+void sps30Expire() {
+  TRACE0(SPS_TIMEOUT)
+  telemetryAddMillis(TELEMETRY_SPS_WAIT, millis() - spsWaitStartMillis);
+  telemetryCount(TELEMETRY_SPS_TIMEOUTS);
+  spsValid = false;
+  const uint16_t format = SPS30_OUTPUT_UINT16;
+  spsCommand(SPS30_START_MEASUREMENT, &format, 1);
+}
+// send a write command with its argument words and wait until it is executed, false if the sensor does not answer
+bool spsCommand(uint16_t command, const uint16_t *args, uint8_t count) {
+  Wire.beginTransmission(SPS30_I2C_ADDRESS);
+  Wire.write((uint8_t)(command >> 8));
+  Wire.write((uint8_t)command);
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t word[2] = {(uint8_t)(args[i] >> 8), (uint8_t)args[i]};
+    Wire.write(word, 2);
+    Wire.write(crc8(word, 2, 0xFF));
+  }
+  bool acknowledged = Wire.endTransmission() == 0;
+  delay(SPS30_COMMAND_MILLIS);
+  return acknowledged;
+}
+// read count words after a command - 0 = words hold them, 1 = no answer, 2 = CRC error
+uint8_t spsRead(uint16_t command, uint16_t *words, uint8_t count) {
+  Wire.beginTransmission(SPS30_I2C_ADDRESS);
+  Wire.write((uint8_t)(command >> 8));
+  Wire.write((uint8_t)command);
+  if (Wire.endTransmission() != 0 || Wire.requestFrom((uint8_t)SPS30_I2C_ADDRESS, (uint8_t)(3 * count)) != 3 * count) {
+    return 1;
+  }
+  uint8_t error = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t data[3];
+    for (uint8_t b = 0; b < 3; b++) {
+      data[b] = Wire.read();
+    }
+    if (crc8(data, 2, 0xFF) != data[2]) {
+      error = 2;
+    }
+    words[i] = (uint16_t)(data[0] << 8 | data[1]);
+  }
+  return error;
+}
+// interval of the automatic fan cleaning, sent in seconds
+void spsSetCleaningInterval(uint8_t days) {
+  const uint32_t seconds = days * 86400UL;
+  const uint16_t interval[2] = {(uint16_t)(seconds >> 16), (uint16_t)seconds};
+  spsCommand(SPS30_AUTO_CLEANING, interval, 2);
+}
+#if DEBUG
+//just print time
+void printCurrentTime() {
+  #if USE_HW_RTC
+    DateTime now = rtc.now();
+    DBG_PRINT("RTC date/time: ");
+    printDateTime(now.year(), now.month(), now.day(), now.hour(), now.minute(), now.second());
+  #else 
+  //if (currentUnixEpoch == 0) {
+    if (now() == 0) {
+      DBG_PRINTLN("GPS epoch not set yet."); // time n0t synchronized
+      return;
+    }
+    //setTime(currentUnixEpoch); // Přepočítá podle TimeLib
+    DBG_PRINT("GPS date/time: ");
+    printDateTime(year(), month(), day(), hour(), minute(), second());
+  #endif
+}
+// print time format
+void printDateTime(int y, int mo, int d, int h, int mi, int s) {
+  DBG_PRINT(y); DBG_PRINT("-");
+  if (mo < 10) DBG_PRINT("0");
+  DBG_PRINT(mo); DBG_PRINT("-");
+  if (d < 10) DBG_PRINT("0");
+  DBG_PRINT(d); DBG_PRINT(" ");
+  if (h < 10) DBG_PRINT("0");
+  DBG_PRINT(h); DBG_PRINT(":");
+  if (mi < 10) DBG_PRINT("0");
+  DBG_PRINT(mi); DBG_PRINT(":");
+  if (s < 10) DBG_PRINT("0");
+  DBG_PRINTLN(s);
+}
+#endif 
+#if BENCHMARK_SFLT16
+// time the payload encoder on the MCU - 1000 calls over a typical sensor value in thousandths
+void benchmarkSflt16() {
+  volatile int32_t input = 12340;
+  volatile uint16_t output;
+  uint32_t start = micros();
+  for (uint16_t i = 0; i < 1000; i++) {
+    output = sflt16FromRatio(input, 100 * 1000UL);
+  }
+  uint32_t elapsed = micros() - start;
+  (void)output;
+  DBG_PRINT(F("sflt16FromRatio cycles/call: "));
+  DBG_PRINTLN(elapsed * (F_CPU / 1000000UL) / 1000UL);
+}
+#endif
+// Time synchronization - one request, if it fails it is retried in the background in the specified intervals
+void synchronizeTime() {
+  uint32_t gpsEpoch = getTimeRequestTimestamp(); // Request time synchronization from the network
+  if (gpsEpoch == 0) {
+    timeSyncFailed();
+    return;
+  }
+  setNetworkTime(gpsEpoch);
+}
+// set the clock from a DeviceTimeAns received with the uplink that SendData() returned from last
+void setNetworkTime(uint32_t gpsEpoch) {
+  // network local time - the answer dates the opening of RX1, SendData() returned once the downlink was in
+  uint32_t networkEpoch = gpsEpoch + GPS_TO_UNIX_OFFSET + (TIMEZONE_OFFSET_HOURS * 3600);
+  uint8_t fOptsLength = DEVICE_TIME_ANS_LENGTH;
+  #if LINK_ADAPTATION
+    if (lora.LoRaWANreceived & LINK_CHECK_ANSWERED) {
+      fOptsLength += LINK_CHECK_ANS_LENGTH;
+    }
+  #endif
+  uint32_t answerMillis = (lora.fracSecond * 1000UL + 128) / 256 +
+                          (downlinkAirtimeMicros(timeAnswerDataRate, lora.downlinkSize, fOptsLength) + 500) / 1000;
+  #if USE_HW_RTC
+    uint32_t rtcEpoch = rtcWaitForSecond(); // the RTC offset is measured at the start of an RTC second
+    if (rtcEpoch != 0) {
+      rtcDriftUpdate((int32_t)(rtcEpoch - networkEpoch), answerMillis + (millis() - timeAnswerMillis), networkEpoch);
+    }
+  #endif
+  uint32_t networkMillis = answerMillis + (millis() - timeAnswerMillis);
+  TRACE2(TIME_SYNCED, gpsEpoch, networkMillis)
+  idleMillis(1000 - networkMillis % 1000); // the clock is set at the start of the next network second
+  networkEpoch += networkMillis / 1000 + 1;
+  spsFanCount(); // up to the old clock, from the new one on
+  spsFanSinceEpoch = networkEpoch;
+  telemetryClock(networkEpoch);
+
+  #if USE_HW_RTC
+    rtc.adjust(DateTime(networkEpoch)); // writing the seconds restarts the DS3231 countdown
+    lastSyncEpoch = networkEpoch;
+    rtcSetByNetwork = true;
+    #if TEST_RTC_VS_LORA_TIME
+      DBG_PRINT("RTC sync after: ");
+      DBG_PRINT_RTC_TIME();
+      DBG_PRINTLN(gpsEpoch);
+      unsigned long startMillis = millis();
+      while (Serial.available() < 12 && millis() - startMillis < 20000) {
+
+      digitalWrite(LED_BUILTIN, HIGH);  // LED on
+      delay(50);
+      digitalWrite(LED_BUILTIN, LOW);   // LED off
+      delay(50);
+      }
+      if (Serial.available() >= 12) {
+        int year = Serial.parseInt();
+        int month = Serial.parseInt();
+        int day = Serial.parseInt();
+        int hour = Serial.parseInt();
+        int minute = Serial.parseInt();
+        int second = Serial.parseInt();
+
+        DBG_PRINT("Serial Time: ");
+        printDateTime(year, month, day, hour, minute, second);
+        DBG_PRINT_RTC_TIME();
+      }
+    #endif
+  #else 
+    setTime(networkEpoch); // Set the time 
+    lastSyncEpoch = networkEpoch; 
+  #endif
+
+  syncFailedCount = 0;
+  syncRetryEpoch = 0;
+  if (timeSyncFreeRunning) {
+    timeSyncFreeRunning = false;
+    overrideTimeSynchronization = 0;
+    settingsReportPending = true; // reported before the next reading
+  }
+}
+// schedule the next attempt - slots stay on the clock until the failures last TIME_SYNC_FREE_RUN_HOURS
+void timeSyncFailed() {
+  uint32_t nowEpoch = getCurrentEpoch();
+  if (syncFailedCount == 0) {
+    syncFailedSinceEpoch = nowEpoch;
+  }
+  if (syncFailedCount < 7) {
+    syncFailedCount++;
+  }
+  syncRetryEpoch = nowEpoch + syncFailedResyncIntervalsInMinutes[syncFailedCount] * 60UL;
+  TRACE2(TIME_SYNC_FAILED, syncFailedCount, syncFailedResyncIntervalsInMinutes[syncFailedCount])
+  telemetryCount(TELEMETRY_TIME_SYNC_FAILURES);
+  if (!overrideTimeSynchronization && nowEpoch - syncFailedSinceEpoch >= TIME_SYNC_FREE_RUN_HOURS * 3600UL) {
+    TRACE0(TIME_FREE_RUNNING)
+    timeSyncFreeRunning = true;
+    overrideTimeSynchronization = 1; // send by interval until a retry gets through
+    settingsReportPending = true;    // reported before the next reading
+  }
+}
+// true if a time sync or a retry of one is due
+bool timeSyncDue() {
+  return syncRetryEpoch != 0 && getCurrentEpoch() >= syncRetryEpoch;
+}
+// DeviceTimeAns to a DeviceTimeReq piggybacked on a data uplink - any answer does while a sync waits for a retry
+void timeSyncAnswer() {
+  if ((lora.LoRaWANreceived & 0x40) == 0x40 && lora.epoch != 0) {
+    setNetworkTime(lora.epoch);
+  } else if (timeSyncDue()) {
+    timeSyncFailed();
+  }
+}
+// proceeds MAC DeviceTimeReq and returns LoRaWAN timestamp in GPS epoch format
+uint32_t getTimeRequestTimestamp() {
+  uint32_t ret = 0;
+  lora.epoch = 0;
+  lora.LoRaWANreceived = 0;
+  lora.TimeLinkCheck = 1; // Request time synchronization
+  uint8_t emptyPayload[1] = {0}; // Empty payload for the request
+
+  if (!sendUplink(3, emptyPayload, 1)) { // Send the request port 3 has no formater setup 
+    return 0; // deferred by the airtime limits - counts as a failed request
+  }
+
+  TRACE1(TIME_REQUEST, lora.LoRaWANreceived)
+
+  if ((lora.LoRaWANreceived & 0x40) == 0x40) {
+      ret = lora.epoch;
+  }
+
+  return ret;
+}
+// check if the time resync is schadduled for now - if the last sync was more than realTimeResyncIntervalDays days ago
+void checkForTimeResync() {
+  uint32_t currentEpoch;
+  #if USE_HW_RTC
+    DateTime now = rtc.now();
+    currentEpoch = now.unixtime(); // aktuální čas v epoch
+  #else
+    currentEpoch = now(); 
+  #endif
+  if(lastSyncEpoch == 0){
+    lastSyncEpoch = currentEpoch - (realTimeResyncIntervalDays * 86400UL)/3; // set last sync to 3 days ago if it is not set yet or was lost due to power off
+  }
+  if (syncRetryEpoch == 0 && (currentEpoch - lastSyncEpoch) >= (resyncIntervalDays() * 86400UL)) {
+    syncRetryEpoch = currentEpoch; // Synchronize time if the interval has passed - with the next uplink
+  }
+}
+// days between time syncs - realTimeResyncIntervalDays until the RTC drift is known
+uint8_t resyncIntervalDays() {
+  #if USE_HW_RTC
+    if (rtcResyncDays) {
+      return rtcResyncDays;
+    }
+  #endif
+  return realTimeResyncIntervalDays;
+}
+// current local time as Unix epoch from the clock in use
+uint32_t getCurrentEpoch() {
+  #if USE_HW_RTC
+    return rtc.now().unixtime();
+  #else
+    return now();
+  #endif
+}
+#if USE_HW_RTC
+// the RTC second that has just begun - polls with the CPU idle in between, 0 if the RTC does not tick
+uint32_t rtcWaitForSecond() {
+  uint32_t start = rtc.now().unixtime();
+  uint32_t startMillis = millis();
+  while (millis() - startMillis < 1100) {
+    uint32_t epoch = rtc.now().unixtime();
+    if (epoch != start) {
+      return epoch;
+    }
+    idleMillis(1);
+  }
+  return 0;
+}
+// drift from the RTC offset to network time at this sync, which trims the aging offset and sets the resync interval
+void rtcDriftUpdate(int32_t rtcAheadSeconds, uint32_t networkMillis, uint32_t networkEpoch) {
+  uint32_t span = networkEpoch - lastSyncEpoch;
+  if (!rtcSetByNetwork || span < RTC_DRIFT_MIN_SECONDS || rtcAheadSeconds > 60 || rtcAheadSeconds < -60) {
+    return; // not set by the network since the last reset, or set by hand since
+  }
+  int32_t offsetMillis = rtcAheadSeconds * 1000 - (int32_t)networkMillis;
+  int32_t drift = offsetMillis * 1000 / (int32_t)(span / 100);
+  rtcDrift = drift > 32767 ? 32767 : (drift < -32767 ? -32767 : drift);
+  TRACE2(RTC_DRIFT, offsetMillis, rtcDrift)
+  #if RTC_AGING_CORRECTION
+    int16_t aging = rtcReadAging() + (rtcDrift + (rtcDrift > 0 ? RTC_AGING_STEP / 2 : -RTC_AGING_STEP / 2)) / RTC_AGING_STEP;
+    rtcWriteAging(aging > 127 ? 127 : (aging < -128 ? -128 : aging)); // + slows the oscillator
+  #endif
+  // sized for the drift measured before the trim - the next sync shows what the trim left
+  uint16_t limit = rtcDrift < 0 ? -rtcDrift : rtcDrift;
+  uint32_t days = RTC_SYNC_MAX_ERROR_MILLIS * 100000UL / (limit > RTC_DRIFT_FLOOR ? limit : RTC_DRIFT_FLOOR) / 86400UL;
+  rtcResyncDays = days < 1 ? 1 : (days > RTC_RESYNC_MAX_DAYS ? RTC_RESYNC_MAX_DAYS : days);
+}
+#if RTC_AGING_CORRECTION
+// DS3231 aging offset register - not in RTClib
+int8_t rtcReadAging() {
+  Wire.beginTransmission(DS3231_I2C_ADDRESS);
+  Wire.write(DS3231_AGING_OFFSET);
+  if (Wire.endTransmission() == 0 && Wire.requestFrom((uint8_t)DS3231_I2C_ADDRESS, (uint8_t)1) == 1) {
+    rtcAging = (int8_t)Wire.read();
+  }
+  return rtcAging;
+}
+void rtcWriteAging(int8_t aging) {
+  Wire.beginTransmission(DS3231_I2C_ADDRESS);
+  Wire.write(DS3231_AGING_OFFSET);
+  Wire.write((uint8_t)aging);
+  if (Wire.endTransmission() == 0) {
+    rtcAging = aging;
+  }
+}
+#endif
+#endif
+// clear EEPROM SlimLoRa session data - for change of the session keys or for testing
+void clearSessionEEPROM() {
+  for (uint16_t addr = 0; addr < EEPROM_END; addr++) {
+      EEPROM.update(addr, 0xFF);  // erased state - bytes already erased are not written again
+  }
+}
+// Read configuration from EEPROM - the newest valid config log record, the config.h values if there is none
+// or FIRMWARE_CONFIG_VERSION changed
+void loadConfigFromEEPROM() {
+  ConfigRecord record, newest;
+  for (uint8_t slot = 0; slot < CONFIG_LOG_RECORDS; slot++) {
+    EEPROM.get(EEPROM_CONFIG_LOG_START + slot * CONFIG_RECORD_SIZE, record);
+    if (record.schema != CONFIG_SCHEMA || crc8((uint8_t *)&record, CONFIG_RECORD_SIZE - 1) != record.crc) {
+      continue; // never written, torn by a power loss or of another layout
+    }
+    if (configSlot == CONFIG_NONE || (int8_t)(record.sequence - configSequence) > 0) {
+      configSlot = slot;
+      configSequence = record.sequence;
+      newest = record;
+    }
+  }
+  if (configSlot == CONFIG_NONE) {
+    if (EEPROM.read(EEPROM_FIRMWARE_CONFIG_VERSION) == FIRMWARE_CONFIG_VERSION) {
+      loadLegacyConfig(); // backup written by a firmware before the config log
+    }
+    saveConfigToEEPROM();
+    return;
+  }
+  if (newest.version != FIRMWARE_CONFIG_VERSION) {
+    TRACE0(CONFIG_DEFAULTS)
+    saveConfigToEEPROM();
+    return;
+  }
+  sendIntervalMinutes = newest.sendIntervalMinutes;
+  spsCleanIntervalDays = newest.spsCleanIntervalDays;
+  spsStabilizationPreReadoutDelay = newest.spsStabilizationPreReadoutDelay;
+  spsStopAfterReadout = newest.spsStopAfterReadout;
+  realTimeResyncIntervalDays = newest.realTimeResyncIntervalDays;
+  overrideTimeSynchronization = newest.overrideTimeSynchronization;
+  allowDeepSleep = newest.allowDeepSleep;
+  samplesPerFrame = newest.samplesPerFrame;
+  deltaHeartbeatSlots = newest.deltaHeartbeatSlots;
+  memcpy(deltaThresholds, newest.deltaThresholds, DELTA_FIELDS);
+  slotOffsetSeconds = newest.slotOffsetSeconds[0] | (newest.slotOffsetSeconds[1] << 8);
+  linkCheckInterval = newest.linkAdr[0];
+  linkMinDataRate = newest.linkAdr[1];
+  linkMaxDataRate = newest.linkAdr[2];
+  linkMinPowerDbm = newest.linkAdr[3];
+  linkMaxPowerDbm = newest.linkAdr[4];
+  linkMarginTargetDb = newest.linkAdr[5];
+  TRACE2(CONFIG_LOADED, configSlot, configSequence)
+}
+// settings of the fixed backup block at EEPROM_FIRMWARE_CONFIG_VERSION - migrated into the config log once
+void loadLegacyConfig() {
+  sendIntervalMinutes = EEPROM.read(EEPROM_SEND_INTERVAL) | (EEPROM.read(EEPROM_SEND_INTERVAL+1) << 8);
+  spsCleanIntervalDays = EEPROM.read(EEPROM_SPS_CLEAN_INTERVAL); 
+  spsStabilizationPreReadoutDelay = EEPROM.read(EEPROM_SPS_STABILIZATION_PRE_READOUT_DELAY);
+  spsStopAfterReadout = EEPROM.read(EEPROM_SPS_STOP_AFTER_READOUT); 
+  realTimeResyncIntervalDays = EEPROM.read(EEPROM_REAL_TIME_RESYNC_INTERVAL); 
+  overrideTimeSynchronization = EEPROM.read(EEPROM_OVERRIDE_TIME_SYNCHRONIZATION); 
+  allowDeepSleep = EEPROM.read(EEPROM_ALLOW_DEEP_SLEEP); 
+}
+// Save configuration to EEPROM - for keeping OTA configurable settings after power off
+// goes to the next config log record, only the bytes that differ from the record it replaces are written
+void saveConfigToEEPROM() {
+  ConfigRecord record;
+  memset(&record, 0xFF, sizeof(record));
+  record.schema = CONFIG_SCHEMA;
+  record.version = FIRMWARE_CONFIG_VERSION;
+  record.sendIntervalMinutes = sendIntervalMinutes;
+  record.sequence = configSequence + 1;
+  record.spsCleanIntervalDays = spsCleanIntervalDays;
+  record.spsStabilizationPreReadoutDelay = spsStabilizationPreReadoutDelay;
+  record.spsStopAfterReadout = spsStopAfterReadout;
+  record.realTimeResyncIntervalDays = realTimeResyncIntervalDays;
+  record.overrideTimeSynchronization = overrideTimeSynchronization;
+  record.allowDeepSleep = allowDeepSleep;
+  record.samplesPerFrame = samplesPerFrame;
+  record.deltaHeartbeatSlots = deltaHeartbeatSlots;
+  memcpy(record.deltaThresholds, deltaThresholds, DELTA_FIELDS);
+  record.slotOffsetSeconds[0] = slotOffsetSeconds & 0xFF;
+  record.slotOffsetSeconds[1] = slotOffsetSeconds >> 8;
+  uint8_t linkAdr[LINK_ADR_SETTINGS] = {linkCheckInterval, linkMinDataRate, linkMaxDataRate, linkMinPowerDbm, linkMaxPowerDbm, linkMarginTargetDb};
+  memcpy(record.linkAdr, linkAdr, LINK_ADR_SETTINGS);
+  record.crc = crc8((uint8_t *)&record, CONFIG_RECORD_SIZE - 1);
+  uint8_t slot = configSlot == CONFIG_NONE ? 0 : (configSlot + 1) % CONFIG_LOG_RECORDS;
+  EEPROM.put(EEPROM_CONFIG_LOG_START + slot * CONFIG_RECORD_SIZE, record); // byte by byte in order, the CRC last
+  configSlot = slot;
+  configSequence = record.sequence;
+  TRACE2(CONFIG_SAVED, configSlot, configSequence)
+}
+void manageSessionKeyChange() {
+  for (uint8_t i = 0; i < 8; i++)
+  {
+    if (EEPROM.read(EEPROM_DEVEUI + i) != DevEUI[i]) {
+      TRACE0(SESSION_KEYS_CHANGED)
+      clearSessionEEPROM(); // Clear EEPROM if the session keys are different
+      for (uint16_t addr = EEPROM_JOIN_STATE_START; addr < EEPROM_JOIN_STATE_END; addr++) {
+        EEPROM.update(addr, 0xFF); // a new device starts joining afresh
+      }
+      for (uint8_t j = 0; j < 8; j++)
+      {
+        EEPROM.write(EEPROM_DEVEUI + j, DevEUI[j]); // Save the new DevEUI to EEPROM
+      }
+      return;
+    }
+    
+  }
+}
+#if STORE_AND_FORWARD
+// byte access to the ring buffer memory - free EEPROM or external FRAM
+uint8_t storeRead(uint16_t addr) {
+  #if STORE_USE_FRAM
+    Wire.beginTransmission(FRAM_I2C_ADDRESS);
+    Wire.write(addr >> 8);
+    Wire.write(addr & 0xFF);
+    Wire.endTransmission();
+    Wire.requestFrom(FRAM_I2C_ADDRESS, 1);
+    return Wire.read();
+  #else
+    return EEPROM.read(addr);
+  #endif
+}
+void storeWrite(uint16_t addr, uint8_t value) {
+  #if STORE_USE_FRAM
+    Wire.beginTransmission(FRAM_I2C_ADDRESS);
+    Wire.write(addr >> 8);
+    Wire.write(addr & 0xFF);
+    Wire.write(value);
+    Wire.endTransmission();
+  #else
+    EEPROM.update(addr, value); // EEPROM cells are only written if the value changes
+  #endif
+}
+uint16_t storeAddress(uint16_t slot) {
+  return STORE_START + slot * STORE_RECORD_SIZE;
+}
+// find the newest record after a reset - sequence numbers increase by one from slot to slot up to the newest record
+void storeInit() {
+  storeNewest = STORE_NONE;
+  for (uint16_t slot = 0; slot < STORE_CAPACITY; slot++) {
+    uint8_t seq = storeRead(storeAddress(slot));
+    if (seq == STORE_SEQ_EMPTY) {
+      continue;
+    }
+    uint8_t nextSeq = storeRead(storeAddress((slot + 1) % STORE_CAPACITY));
+    if (nextSeq != (seq + 1) % 255) {
+      storeNewest = slot;
+      break;
+    }
+  }
+  TRACE1(STORE_NEWEST, storeNewest)
+}
+// write a reading to the oldest slot - the sequence byte is cleared first and written last, so a torn record is never valid
+uint16_t storeAppend(uint32_t epoch, const uint8_t *data) {
+  uint8_t seq = 0;
+  uint16_t slot = 0;
+  if (storeNewest != STORE_NONE) {
+    seq = (storeRead(storeAddress(storeNewest)) + 1) % 255;
+    slot = (storeNewest + 1) % STORE_CAPACITY;
+  }
+  if (slot == storeSentFrom) {
+    storeSentFrom = STORE_NONE; // the ring wrapped over the unconfirmed window
+  }
+  if (slot == storeResentFrom) {  // or over the oldest record resent
+    storeResentFrom = slot == storeResentTo ? STORE_NONE : (slot + 1) % STORE_CAPACITY;
+    if (storeResentFrom == STORE_NONE) {
+      storeResentTo = STORE_NONE;
+    }
+  }
+  uint16_t addr = storeAddress(slot);
+  storeWrite(addr, STORE_SEQ_EMPTY);
+  storeWrite(addr + 1, STORE_STATUS_PENDING);
+  for (uint8_t i = 0; i < 4; i++) {
+    storeWrite(addr + 2 + i, (epoch >> (8 * i)) & 0xFF);
+  }
+  for (uint8_t i = 0; i < STORE_DATA_LENGTH; i++) {
+    storeWrite(addr + 6 + i, data[i]);
+  }
+  storeWrite(addr, seq);
+  storeNewest = slot;
+  return slot;
+}
+// oldest record the network has not confirmed yet after those resent since the last link check - none of those sent since
+uint16_t storeNextResend() {
+  if (storeNewest == STORE_NONE || storeResentTo == storeNewest) {
+    return STORE_NONE;
+  }
+  uint16_t slot = storeResentTo == STORE_NONE ? storeNewest : storeResentTo;
+  do {
+    slot = (slot + 1) % STORE_CAPACITY;
+    if (slot == storeSentFrom) {
+      break;
+    }
+    uint16_t addr = storeAddress(slot);
+    if (storeRead(addr) != STORE_SEQ_EMPTY && storeRead(addr + 1) == STORE_STATUS_PENDING) {
+      return slot;
+    }
+  } while (slot != storeNewest);
+  return STORE_NONE;
+}
+// mark the records from fromSlot up to toSlot as delivered
+void storeConfirm(uint16_t fromSlot, uint16_t toSlot) {
+  if (fromSlot == STORE_NONE) {
+    return;
+  }
+  for (uint16_t slot = fromSlot;; slot = (slot + 1) % STORE_CAPACITY) {
+    storeWrite(storeAddress(slot) + 1, STORE_STATUS_CONFIRMED);
+    if (slot == toSlot) {
+      break;
+    }
+  }
+}
+// after an uplink with a link check - an answer confirms the readings sent and resent since the last one, a miss leaves
+// them for resend and holds the resends back until a link check is answered
+void storeLinkChecked(bool answered) {
+  if (answered) {
+    TRACE0(LINK_CONFIRMED)
+    storeLinkDown = false;
+    storeConfirm(storeResentFrom, storeResentTo);
+    if (multiSampleLength > 0) {
+      storeResentFrom = storeResentTo = STORE_NONE;
+      return; // readings collected for the next frame are not sent yet
+    }
+    storeConfirm(storeSentFrom, storeNewest);
+  } else {
+    TRACE0(LINK_LOST)
+    storeLinkDown = true;
+  }
+  storeSentFrom = STORE_NONE;
+  storeResentFrom = storeResentTo = STORE_NONE;
+}
+// resend the oldest unconfirmed readings on port 2 - after every uplink while the last link check was answered, spaced
+// by the duty cycle, confirmed by the next link check
+void storeDrain() {
+  uint8_t frame[PORT2_LENGTH];
+  for (uint8_t n = 0; n < STORE_DRAIN_PER_SLOT && !storeLinkDown; n++) {
+    uint16_t slot = storeNextResend();
+    if (slot == STORE_NONE || lora.downlinkSize > 0) {
+      return; // a downlink waits for processDownlink() - the next SendData() would drop it
+    }
+    uint16_t addr = storeAddress(slot);
+    for (uint8_t i = 0; i < sizeof(frame); i++) {
+      frame[i] = storeRead(addr + 2 + i);
+    }
+    TRACE1(STORE_RESEND, slot)
+    uint16_t resentFrom = storeResentFrom, resentTo = storeResentTo;
+    storeResentTo = slot; // before - a link check riding on the resend confirms it as well
+    if (storeResentFrom == STORE_NONE) {
+      storeResentFrom = slot;
+    }
+    if (!sendUplink(STORE_FPORT, frame, sizeof(frame))) {
+      storeResentFrom = resentFrom;
+      storeResentTo = resentTo;
+      return; // airtime limits - the rest waits for the next slot
+    }
+  }
+}
+#endif
+// control the time slotting - sleep until the cycle of the next slot starts, making the jobs due before it
+void waitUntilNextSlot() {
+  if(overrideTimeSynchronization == 0){
+    #if !USE_HW_RTC
+      if (now() == 0) {
+        synchronizeTime();
+      }
+    #endif
+    uint8_t ran = 0; // jobs made in between this cycle
+    for (;;) {
+      uint32_t nowEpoch = getCurrentEpoch();
+      jobSchedule(nowEpoch, ran);
+      uint8_t job = jobEarliest();
+      uint32_t waitSeconds = jobEpoch[job] > nowEpoch ? jobEpoch[job] - nowEpoch : 0;
+      if (job == JOB_SPS_START || job == JOB_SLOT) {
+        nextSlotEpoch = jobEpoch[JOB_SLOT];
+        TRACE1(WAIT_SLOT, waitSeconds)
+        sleepUntilClock(nowEpoch, jobEpoch[job]);
+        return;
+      }
+      TRACE2(WAIT_JOB, waitSeconds, job)
+      sleepUntilClock(nowEpoch, jobEpoch[job]);
+      ran |= 1 << job;
+      if (job == JOB_TIME_SYNC) {
+        synchronizeTime(); // the clock may have been set - the jobs are scheduled again from it
+      } else {
+        reportSettingsByUplink();
       }
     }
   }else{
     if (allowDeepSleep == 1)
     {
+    #if USE_HW_RTC
+      sleepUntilEpoch(rtc.now().unixtime() + sendIntervalMinutes * 60UL); // wait for the next slot if synchronisation by real time is overriden
+    #else
       deepSleepMillis(sendIntervalMinutes * 60 * 1000UL); // wait for the next slot if synchronisation by real time is overriden
+    #endif
     }else{
-      delay((sendIntervalMinutes * 60 * 1000U) - SENSORS_MEASUREMENT_DELAY); // wait for the next slot if synchronisation by real time is overriden no deep sleep allowed
+      idleMillis((sendIntervalMinutes * 60 * 1000UL) - SENSORS_MEASUREMENT_DELAY); // wait for the next slot if synchronisation by real time is overriden no deep sleep allowed
     }
       
   }
 }
-// Setup watchdog timer
+// the first slot after epoch - slots are multiples of the send interval since the Unix epoch, so any interval works
+// and one that divides a day starts the day at local midnight - the RTC epoch includes TIMEZONE_OFFSET_HOURS
+uint32_t slotAfter(uint32_t epoch) {
+  const uint32_t interval = sendIntervalMinutes * 60UL;
+  return (epoch / interval + 1) * interval;
+}
+// when each job is due next, O(jobs) in integer math - ran holds the jobs made in between this cycle
+void jobSchedule(uint32_t nowEpoch, uint8_t ran) {
+  jobEpoch[JOB_SLOT] = slotAfter(nowEpoch);
+  jobEpoch[JOB_SPS_START] = spsStopAfterReadout == 1 ? jobEpoch[JOB_SLOT] - spsStabilizationPreReadoutDelay * 60UL : JOB_NONE;
+  jobEpoch[JOB_TIME_SYNC] = syncRetryEpoch != 0 && isJoined() ? syncRetryEpoch : JOB_NONE;
+  jobEpoch[JOB_SETTINGS_REPORT] = settingsReportPending && isJoined() ?
+      nowEpoch + airtimeWaitSeconds(uplinkAirtimeMicros(linkDataRate, SETTINGS_REPORT_LENGTH)) : JOB_NONE;
+  jobEpoch[JOB_FAN_CLEANING] = spsCleaningEpoch(jobEpoch[JOB_SLOT]);
+  if (jobEpoch[JOB_FAN_CLEANING] < jobEpoch[JOB_SLOT]) {
+    jobEpoch[JOB_FAN_CLEANING] = jobEpoch[JOB_SLOT]; // overdue after the clock was set
+  }
+  // one due close to the cycle, or made already and still due, rides on the slot's uplink
+  const uint32_t cycle = jobEpoch[JOB_SPS_START] < jobEpoch[JOB_SLOT] ? jobEpoch[JOB_SPS_START] : jobEpoch[JOB_SLOT];
+  for (uint8_t job = JOB_TIME_SYNC; job <= JOB_SETTINGS_REPORT; job++) {
+    if (jobEpoch[job] != JOB_NONE && (jobEpoch[job] + JOB_SLOT_MARGIN_SECONDS >= cycle ||
+                                      ((ran & (1 << job)) && jobEpoch[job] <= nowEpoch))) {
+      jobEpoch[job] = jobEpoch[JOB_SLOT];
+    }
+  }
+}
+// the job due first - the cycle of the slot on a tie
+uint8_t jobEarliest() {
+  uint8_t earliest = JOB_SLOT;
+  for (uint8_t job = 0; job < JOB_COUNT; job++) {
+    if (jobEpoch[job] < jobEpoch[earliest]) {
+      earliest = job;
+    }
+  }
+  return earliest;
+}
+// sleep until wakeEpoch on the clock in use - in power-down if allowed
+void sleepUntilClock(uint32_t nowEpoch, uint32_t wakeEpoch) {
+  if (wakeEpoch <= nowEpoch) {
+    return;
+  }
+  if (allowDeepSleep == 1)
+  {
+  #if USE_HW_RTC
+    sleepUntilEpoch(wakeEpoch);
+  #else
+    deepSleepMillis((wakeEpoch - nowEpoch) * 1000UL);
+  #endif
+  }else{
+    idleMillis((wakeEpoch - nowEpoch) * 1000UL);
+  }
+}
+// Setup watchdog timer - interrupt mode, WDTO_* keeps WDP3 in bit 3 but WDTCSR has it in bit 5
 void setupWatchdog(uint8_t timeout) {
   MCUSR &= ~(1 << WDRF); // Clear the watchdog reset flag
+  cli();
   WDTCSR = (1 << WDCE) | (1 << WDE);
-  WDTCSR = (1 << WDIE) | timeout;
+  WDTCSR = (1 << WDIE) | ((timeout & 8) ? (1 << WDP3) : 0) | (timeout & 7);
+  sei();
 }
-// Go to sleep for a specified number of milliseconds
+// one watchdog period in power-down
+void watchdogSleep(uint8_t timeout) {
+  setupWatchdog(timeout);
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  cli();
+  sleep_enable();
+  sei();
+  sleep_cpu(); // ZZZ...
+  sleep_disable();
+}
+// Go to sleep for a specified number of milliseconds - watchdog periods of the calibrated length, the rest below
+// the shortest period is waited out awake
 void deepSleepMillis(uint32_t ms)
 {
-  
-  const struct
-  {
-    uint16_t duration;
-    uint8_t wdt_setting;
-  } wdt_options[] = {
-      {8000, WDTO_8S},
-      {4000, WDTO_4S},
-      {2000, WDTO_2S},
-      {1000, WDTO_1S},
-      {500, WDTO_500MS},
-      {250, WDTO_250MS},
-      {120, WDTO_120MS},
-      {60, WDTO_60MS},
-      {30, WDTO_30MS},
-      {15, WDTO_15MS}};
-  for (; ms > 0;)
-  {
-    for (uint8_t i = 0; i < sizeof(wdt_options) / sizeof(wdt_options[0]); i++)
-    {
-      if (ms >= wdt_options[i].duration)
-      {
-        MCUSR &= ~(1 << WDRF);
-        WDTCSR |= (1 << WDCE) | (1 << WDE);
-        WDTCSR = (1 << WDIE) | wdt_options[i].wdt_setting;
-
-        set_sleep_mode(SLEEP_MODE_PWR_DOWN);
-        cli();
-        sleep_enable();
-        sei();
-        sleep_cpu(); // ZZZ...
-        sleep_disable();
-
-        ms -= wdt_options[i].duration;
-        break;
+  telemetryAddMillis(TELEMETRY_POWER_DOWN, ms);
+  const uint32_t base = watchdogBaseNanos() / 10; // in 10 ns, so the 8 s period still fits into 32 bits
+  uint32_t rest = ms * 10UL; // in 0.1 ms
+  for (int8_t timeout = WDTO_8S; timeout >= WDTO_15MS; timeout--) {
+    const uint32_t period = ((base << timeout) + 5000) / 10000;
+    while (rest >= period) {
+      watchdogSleep(timeout);
+      rest -= period;
+    }
+  }
+  wdt_disable();
+  delay(rest / 10);
+}
+// temperature bucket of the last HTU21D reading - the watchdog oscillator drifts with temperature
+uint8_t watchdogBucket() {
+  if (temp == HTU21D_NONE) {
+    return 4; // 16-24 degC until the first reading
+  }
+  int16_t t = temp / 100 + 16;
+  if (t < 0) {
+    return 0;
+  }
+  return t / 8 < WDT_TEMPERATURE_BUCKETS ? t / 8 : WDT_TEMPERATURE_BUCKETS - 1;
+}
+// base period for the current temperature - from the nearest measured bucket, nominal before the first measurement
+uint32_t watchdogBaseNanos() {
+  uint8_t bucket = watchdogBucket();
+  for (uint8_t d = 0; d < WDT_TEMPERATURE_BUCKETS; d++) {
+    if (bucket >= d && wdtBaseNanos[bucket - d]) {
+      return wdtBaseNanos[bucket - d];
+    }
+    if (bucket + d < WDT_TEMPERATURE_BUCKETS && wdtBaseNanos[bucket + d]) {
+      return wdtBaseNanos[bucket + d];
+    }
+  }
+  return WDT_NOMINAL_BASE_NANOS;
+}
+#if USE_HW_RTC
+// baseNanos * (plannedMillis + deviationMillis) / plannedMillis, rounded - base * deviation / planned by shifting and
+// subtracting, one bit of the base at a time, so there is no 64 bit division; 0 for a deviation of 25 % or more
+uint32_t watchdogScale(uint32_t baseNanos, int32_t deviationMillis, uint32_t plannedMillis) {
+  const uint32_t deviation = labs(deviationMillis);
+  if (deviation >= plannedMillis / 4) {
+    return 0;
+  }
+  uint32_t bits = baseNanos;
+  uint32_t quotient = 0;
+  uint32_t remainder = 0; // below plannedMillis, doubled plus the deviation it stays below 2^31
+  for (uint8_t i = 0; i < 32; i++) {
+    quotient <<= 1;
+    remainder <<= 1;
+    if (bits & 0x80000000UL) {
+      remainder += deviation;
+    }
+    bits <<= 1;
+    while (remainder >= plannedMillis) {
+      remainder -= plannedMillis;
+      quotient++;
+    }
+  }
+  if (remainder >= plannedMillis - remainder) {
+    quotient++;
+  }
+  return deviationMillis < 0 ? baseNanos - quotient : baseNanos + quotient;
+}
+// power-down until the RTC shows epoch
+void sleepUntilEpoch(uint32_t epoch) {
+#if RTC_ALARM_WAKEUP
+  if (rtcAlarmSleepUntil(epoch)) {
+    return;
+  }
+#endif
+  watchdogSleepUntil(epoch);
+}
+// sleep in base periods until the RTC second changes - returns the new second, polls counts the periods
+uint32_t watchdogWaitForRtcSecond(uint16_t &polls) {
+  const uint32_t second = rtc.now().unixtime();
+  uint32_t next = second;
+  for (polls = 0; polls < 200 && (next = rtc.now().unixtime()) == second; polls++) { // 200 = 3 s, a stopped RTC must not hang
+    watchdogSleep(WDTO_15MS);
+  }
+  wdt_disable();
+  telemetryAddMillis(TELEMETRY_POWER_DOWN, polls * (WDT_NOMINAL_BASE_NANOS / 1000000UL));
+  return next;
+}
+// power-down until the RTC shows epoch on the watchdog - calibrated periods up to WDT_TAIL_MILLIS before it, then a
+// tail of base periods until the RTC second changes. Every sleep starts on an RTC second, so where it ended follows
+// from the second the tail finds: sleeps of WDT_CALIBRATION_MIN_SECONDS and more re-measure the base period.
+void watchdogSleepUntil(uint32_t epoch) {
+  uint16_t polls;
+  uint32_t edge = watchdogWaitForRtcSecond(polls);
+  int16_t error = 0;
+  bool first = true;
+  while (edge < epoch) {
+    const uint8_t bucket = watchdogBucket();
+    const uint32_t remainingMillis = (epoch - edge) * 1000UL;
+    // a measured bucket is good to about 0.2 % of the sleep, the nominal period only to 10 %
+    const uint32_t margin = WDT_TAIL_MILLIS + remainingMillis / (wdtBaseNanos[bucket] ? 512 : 8);
+    if (remainingMillis <= margin) {
+      edge = watchdogWaitForRtcSecond(polls);
+      continue;
+    }
+    const uint32_t plannedMillis = remainingMillis - margin;
+    const uint32_t baseNanos = watchdogBaseNanos();
+    const uint32_t start = edge;
+    deepSleepMillis(plannedMillis);
+    edge = watchdogWaitForRtcSecond(polls);
+    // start and end were found the same way, polls periods and a bit before a second changed
+    const uint32_t pollMicros = baseNanos / 1000 + WDT_POLL_OVERHEAD_MICROS;
+    const int32_t sleptMillis = (int32_t)(edge - start) * 1000L - (int32_t)(polls * pollMicros / 1000UL);
+    if (first) {
+      const int32_t late = sleptMillis - (int32_t)plannedMillis;
+      error = late > 32767 ? 32767 : (late < -32767 ? -32767 : late);
+      first = false;
+    }
+    if (plannedMillis >= WDT_CALIBRATION_MIN_SECONDS * 1000UL && sleptMillis > 0) {
+      const uint32_t measured = watchdogScale(baseNanos, sleptMillis - (int32_t)plannedMillis, plannedMillis);
+      if (measured > WDT_NOMINAL_BASE_NANOS * 3 / 4 && measured < WDT_NOMINAL_BASE_NANOS * 5 / 4) {
+        wdtBaseNanos[bucket] = wdtBaseNanos[bucket] ? (3 * wdtBaseNanos[bucket] + measured + 2) / 4 : measured;
       }
+      TRACE2(WDT_CALIBRATED, wdtBaseNanos[bucket], bucket)
+    }
+  }
+  if (abs(error) > abs(wakeErrorMillis)) {
+    wakeErrorMillis = error;
+  }
+  TRACE1(WAKE_ERROR, error)
+}
+#endif
+#if RTC_ALARM_WAKEUP
+// alarm 1 pulls RTC_INT_PIN low - the level interrupt is detached until the next sleep, it would fire again and again
+void rtcAlarmISR() {
+  rtcAlarmFired = true;
+  detachInterrupt(digitalPinToInterrupt(RTC_INT_PIN));
+}
+// INT/SQW as alarm interrupt output, alarm 2 and the 32 kHz output off
+void rtcAlarmSetup() {
+  pinMode(RTC_INT_PIN, INPUT_PULLUP);
+  rtc.disable32K();
+  rtc.writeSqwPinMode(DS3231_OFF);
+  rtc.disableAlarm(2);
+  rtc.clearAlarm(1);
+  rtc.clearAlarm(2);
+}
+// power-down until the RTC shows epoch - only the alarm wakes the MCU, so the wake-up is as exact as the RTC;
+// false if the alarm could not be set
+bool rtcAlarmSleepUntil(uint32_t epoch) {
+  const uint32_t start = rtc.now().unixtime();
+  if (epoch <= start) {
+    return true;
+  }
+  rtc.clearAlarm(1);
+  if (!rtc.setAlarm1(DateTime(epoch), DS3231_A1_Date)) {
+    return false; // INT/SQW is not in interrupt mode
+  }
+  if (rtc.now().unixtime() >= epoch) { // the second passed while the alarm was written, the match may be missed
+    rtc.clearAlarm(1);
+    return true;
+  }
+  rtcAlarmFired = false;
+  wdt_disable(); // a watchdog left running by deepSleepMillis() would wake the MCU every period
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  attachInterrupt(digitalPinToInterrupt(RTC_INT_PIN), rtcAlarmISR, LOW);
+  while (!rtcAlarmFired) {
+    cli();
+    if (!rtcAlarmFired) { // an alarm between the check and sleep_cpu() still wakes, sei() takes effect after the next instruction
+      sleep_enable();
+      sei();
+      sleep_cpu(); // ZZZ...
+      sleep_disable();
     }
+    sei();
   }
+  rtc.clearAlarm(1); // releases INT/SQW
+  telemetryAddMillis(TELEMETRY_POWER_DOWN, (epoch - start) * 1000UL - 500); // from somewhere in second start, half way on average
+  return true;
 }
+#endif
 // process incoming data from the server - mainly used for OTA configuration changes
 void processDownlink(){
   if ( lora.downlinkSize > 0 ) {
-    uint16_t payload16b = 0;
-    uint8_t payload = 0;
+    TRACE2(DOWNLINK, lora.downPort, lora.downlinkSize)
     switch (lora.downPort) {
-      case 1: // SEND INTERvAL - send 2 bytes - uint16_t to port 1 - sets the interval for sending data in minutes !!!keep in multiples of 5 -> 5, 10, 30, 60 !!!
-          payload16b = (lora.downlinkData[0] << 8) | lora.downlinkData[1];
-          payload16b = (payload16b / 5) * 5; //keep in multiples of 5
-          if (payload16b < 5) { 
-              payload16b = 5;  // minimum 5 minutes
-          }
-          sendIntervalMinutes = payload16b;
-          EEPROM.write(EEPROM_SEND_INTERVAL, (sendIntervalMinutes & 0xFF)); 
-          EEPROM.write(EEPROM_SEND_INTERVAL + 1, ((sendIntervalMinutes >> 8) & 0xFF)); 
-          reportSettingsByUplink(); // send the report back to the server to confirm the change
-        break;    
-      case 2: // SPS30 CLEANING INTERVAL - send 0-255 to port 2 - sets cleaning interval for the fan
-          payload = lora.downlinkData[0];
-          if (payload < 1) { 
-              payload = 7;  // if less than 1, set to 7 days as default
-          }
-          spsCleanIntervalDays = payload;
-          sps30_set_fan_auto_cleaning_interval_days(spsCleanIntervalDays); // set the cleaning interval for the fan
-          EEPROM.write(EEPROM_SPS_CLEAN_INTERVAL, spsCleanIntervalDays); 
-          reportSettingsByUplink(); // send the report back to the server to confirm the change 
-        break;
-      case 3: // SPS30 STABILIZATION PRE READOUT DELAY  - send 0-255 to port 3 - time in minutes for SPS30 to start, before data readout if sps30MeasurementStart is true
-        payload = lora.downlinkData[0];
-        if(payload > sendIntervalMinutes){
-          payload = sendIntervalMinutes; // if more than sendIntervalMinutes, set to sendIntervalMinutes
-        }  
-        if (payload < 1 || payload == sendIntervalMinutes) { 
-          spsStopAfterReadout = 0;  // if less than 1 or more than sendIntervalMinutes do not stop the SPS30
-          sps30_start_measurement(); // start the measurement in case it is stopped
-        }else{
-          spsStopAfterReadout = 1; 
-        } 
-        spsStabilizationPreReadoutDelay = payload; 
-        EEPROM.write(EEPROM_SPS_STABILIZATION_PRE_READOUT_DELAY, spsStabilizationPreReadoutDelay);
-        reportSettingsByUplink(); // send the report back to the server to confirm the change 
-        break;
-      case 4: // SPS30 STOP AFTER READOUT - send 0/1 to port 4 - 1 stops measurement after data readout, starts sps30MeasurementLength minutes before the next sendIntervalMinutes slot. If false, it will run continuously.
-          payload = lora.downlinkData[0];
-          if(payload == 1){
-            spsStopAfterReadout = 1;
-            if (spsStabilizationPreReadoutDelay > sendIntervalMinutes) {
-              spsStabilizationPreReadoutDelay = sendIntervalMinutes;
-            }else if(spsStabilizationPreReadoutDelay < 1){
-              spsStabilizationPreReadoutDelay = SPS30_DEFAULT_STABILIZATION_TIME; 
-            }
-          }else if(payload == 0){
-            spsStopAfterReadout = 0; // do not stop the SPS30
-            sps30_start_measurement(); // start the measurement in case it is stopped
-          }
-          EEPROM.write(EEPROM_SPS_STOP_AFTER_READOUT, spsStopAfterReadout);
-          reportSettingsByUplink(); // send the report back to the server to confirm the change 
-        break;
-      case 5: // REAL TIME RESYNcHRONISATION INTERVAL - 0-255 days send to port 5 to set the time resynchronisation interval for the real-time clock
-          payload = lora.downlinkData[0];
-          if (payload < 1) { 
-              payload = 7;  // if less than 1, set to 7 days as default
-          }
-          realTimeResyncIntervalDays = payload; // set the resynchronisation interval for the real-time clock
-          EEPROM.write(EEPROM_REAL_TIME_RESYNC_INTERVAL, realTimeResyncIntervalDays);
-          reportSettingsByUplink(); // send the report back to the server to confirm the change
-        break;
-      case 6: // TIME SYNCHRONISATION OVERRIDE - send 0/1 to port 6 to set the time synchronisation override
-          payload = lora.downlinkData[0];
-          payload == 1 ? overrideTimeSynchronization = 1 : overrideTimeSynchronization = 0; // set the time synchronisation override
-          EEPROM.write(EEPROM_OVERRIDE_TIME_SYNCHRONIZATION, overrideTimeSynchronization);
-          reportSettingsByUplink(); // send the report back to the server to confirm the change
-          break;
-      case 7: // ALLOW DEEP SLEEP - send 0/1 to port 7 to set the deep sleep mode. IF there is no USE_HW_RTC, the deep sleep is not allowed.
-          payload = lora.downlinkData[0];
-          payload == 1 && USE_HW_RTC ? allowDeepSleep = 1 : allowDeepSleep = 0; // set the deep sleep mode
-           EEPROM.write(EEPROM_ALLOW_DEEP_SLEEP, allowDeepSleep);
-          reportSettingsByUplink(); // send the report back to the server to confirm the change
-        break;
       case 8: // FORCE TIME RESYNCHRINISATION - just send 1 (01) to the port 6...
         if(lora.downlinkData[0] == 1){
           synchronizeTime();
@@ -724,18 +2381,255 @@ void processDownlink(){
           reportSettingsByUplink();
         }
         break;
-      default:
-          DBG_PRINT("\nUndefined Port\t: ");DBG_PRINT(lora.downPort);
-          DBG_PRINT(F("\ndownlinkSize\t: "));DBG_PRINTLN(lora.downlinkSize);
+      case CONFIG_BATCH_FPORT: // CONFIG BATCH - several settings as TLV, acknowledged by the next data uplink
+        applyConfigBatch(lora.downlinkData, lora.downlinkSize);
+        break;
+    #if TRACE_BUFFER_SIZE
+      case TRACE_REQUEST_FPORT: // TRACE DUMP - send 1 (01) to port 12, the oldest trace records come back on port 8
+        if(lora.downlinkData[0] == 1){
+          traceSendByUplink();
+        }
+        break;
+    #endif
+      case DIAGNOSTICS_REQUEST_FPORT: // DIAGNOSTICS - send 1 (01) to port 15, the telemetry counters come back on port 7
+        if(lora.downlinkData[0] == 1){
+          diagnosticsSendByUplink();
+        }
+        break;
+      default: // one setting per port - 1-7, 10, 13, 14 and 16
+        if (lora.downlinkSize >= settingLength(lora.downPort) && applySetting(lora.downPort, lora.downlinkData)) {
+          saveConfigToEEPROM();
+          reportSettingsByUplink(); // send the report back to the server to confirm the change
+        } else {
+          TRACE2(DOWNLINK_UNKNOWN, lora.downPort, lora.downlinkSize)
+        }
       break;      
     }
-  } else { 
-    DBG_PRINTLN(F("No downlink data."));
   }
 }
+// value length of a setting - its port, which is its tag in a config batch as well, 0 = no setting
+uint8_t settingLength(uint8_t tag) {
+  if (tag == 1 || tag == SLOT_OFFSET_FPORT) {
+    return 2;
+  }
+  if (tag == DELTA_FPORT) {
+    return 1 + DELTA_FIELDS;
+  }
+  if (tag == LINK_ADR_FPORT) {
+    return LINK_ADR_SETTINGS;
+  }
+  return (tag >= 2 && tag <= 7) || tag == 10 ? 1 : 0;
+}
+// apply one setting with the checks of its port, false if there is no such setting
+bool applySetting(uint8_t tag, const uint8_t *value) {
+  uint16_t payload16b = 0;
+  uint8_t payload = 0;
+  switch (tag) {
+    case 1: // SEND INTERvAL - send 2 bytes - uint16_t to port 1 - sets the interval for sending data in minutes, multiples of 5 - 90, 120 or 1440 work as well
+        payload16b = (value[0] << 8) | value[1];
+        payload16b = (payload16b / 5) * 5; //keep in multiples of 5
+        if (payload16b < 5) { 
+            payload16b = 5;  // minimum 5 minutes
+        }
+        sendIntervalMinutes = payload16b;
+      break;    
+    case 2: // SPS30 CLEANING INTERVAL - send 0-255 to port 2 - sets cleaning interval for the fan
+        payload = value[0];
+        if (payload < 1) { 
+            payload = 7;  // if less than 1, set to 7 days as default
+        }
+        spsCleanIntervalDays = payload; // the next cleaning is due this many days after the last one
+      break;
+    case 3: // SPS30 STABILIZATION PRE READOUT DELAY  - send 0-255 to port 3 - time in minutes for SPS30 to start, before data readout if sps30MeasurementStart is true
+      payload = value[0];
+      if(payload > sendIntervalMinutes){
+        payload = sendIntervalMinutes; // if more than sendIntervalMinutes, set to sendIntervalMinutes
+      }  
+      if (payload < 1 || payload == sendIntervalMinutes) { 
+        spsStopAfterReadout = 0;  // if less than 1 or more than sendIntervalMinutes do not stop the SPS30
+        spsStart(); // start the measurement in case it is stopped
+      }else{
+        spsStopAfterReadout = 1; 
+      } 
+      spsStabilizationPreReadoutDelay = payload; 
+      break;
+    case 4: // SPS30 STOP AFTER READOUT - send 0/1 to port 4 - 1 stops measurement after data readout, starts sps30MeasurementLength minutes before the next sendIntervalMinutes slot. If false, it will run continuously.
+        payload = value[0];
+        if(payload == 1){
+          spsStopAfterReadout = 1;
+          if (spsStabilizationPreReadoutDelay > sendIntervalMinutes) {
+            spsStabilizationPreReadoutDelay = sendIntervalMinutes;
+          }else if(spsStabilizationPreReadoutDelay < 1){
+            spsStabilizationPreReadoutDelay = SPS30_DEFAULT_STABILIZATION_TIME; 
+          }
+        }else if(payload == 0){
+          spsStopAfterReadout = 0; // do not stop the SPS30
+          spsStart(); // start the measurement in case it is stopped
+        }
+      break;
+    case 5: // REAL TIME RESYNcHRONISATION INTERVAL - 0-255 days send to port 5 to set the time resynchronisation interval for the real-time clock
+        payload = value[0];
+        if (payload < 1) { 
+            payload = 7;  // if less than 1, set to 7 days as default
+        }
+        realTimeResyncIntervalDays = payload; // set the resynchronisation interval for the real-time clock
+      #if USE_HW_RTC
+        rtcResyncDays = 0; // used until the next sync measures the drift again
+      #endif
+      break;
+    case 6: // TIME SYNCHRONISATION OVERRIDE - send 0/1 to port 6 to set the time synchronisation override
+        payload = value[0];
+        payload == 1 ? overrideTimeSynchronization = 1 : overrideTimeSynchronization = 0; // set the time synchronisation override
+        timeSyncFreeRunning = false; // set here, a sync no longer clears it
+        if (overrideTimeSynchronization) {
+          syncRetryEpoch = 0;
+        }
+        break;
+    case 7: // ALLOW DEEP SLEEP - send 0/1 to port 7 to set the deep sleep mode. IF there is no USE_HW_RTC, the deep sleep is not allowed.
+        payload = value[0];
+        payload == 1 && USE_HW_RTC ? allowDeepSleep = 1 : allowDeepSleep = 0; // set the deep sleep mode
+      break;
+    case 10: // SAMPLES PER FRAME - send 1-15 to port 10 - readings per uplink, 1 sends every reading on port 1, more collects them into delta compressed port 5 frames
+        payload = value[0];
+        if (payload < 1) {
+          payload = 1;
+        } else if (payload > MULTI_SAMPLE_MAX_COUNT) {
+          payload = MULTI_SAMPLE_MAX_COUNT;
+        }
+        samplesPerFrame = payload;
+      break;
+    case DELTA_FPORT: // SEND ON DELTA - send 7 bytes to port 13 - heartbeat slots (0 = send every reading), then the thresholds of temp, hum, mc_1p0, mc_2p5, mc_4p0 and mc_10p0
+      deltaHeartbeatSlots = value[0];
+      memcpy(deltaThresholds, value + 1, DELTA_FIELDS);
+      break;
+    case SLOT_OFFSET_FPORT: // SLOT OFFSET - send 2 bytes - uint16_t to port 14 - seconds the uplinks wait after the slot, 0xFFFF = hashed from the DevEUI
+      slotOffsetSeconds = (value[0] << 8) | value[1];
+      break;
+    case LINK_ADR_FPORT: // LINK ADAPTATION - send 6 bytes to port 16 - link check interval in uplinks (0 = DATA_RATE at the max power), min and max data rate (0 = SF12 - 5 = SF7), min and max TX power in dBm, margin target in dB
+      linkCheckInterval = value[0];
+      linkMaxDataRate = value[2] < SF7BW250 ? value[2] : SF7BW250;
+      linkMinDataRate = value[1] < linkMaxDataRate ? value[1] : linkMaxDataRate;
+      linkMaxPowerDbm = linkPowerStep(value[4]);
+      linkMinPowerDbm = value[3] < linkMaxPowerDbm ? linkPowerStep(value[3]) : linkMaxPowerDbm;
+      linkMarginTargetDb = value[5];
+      linkStart(); // the adaptation starts over within the new limits
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+// config batch - <tag><length><value> per setting, tags are the setting ports; applied all or none, saved once
+void applyConfigBatch(const uint8_t *data, uint8_t length) {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < length; i += 2 + data[i + 1], count++) {
+    if (length - i < 2 || settingLength(data[i]) == 0 || data[i + 1] != settingLength(data[i]) || length - i - 2 < data[i + 1]) {
+      TRACE1(CONFIG_BATCH_REJECTED, count)
+      configAckStatus = CONFIG_ACK_REJECTED | count; // index of the first bad entry
+      configAckPending = true;
+      return;
+    }
+  }
+  for (uint8_t i = 0; i < length; i += 2 + data[i + 1]) {
+    applySetting(data[i], data + i + 2);
+  }
+  saveConfigToEEPROM();
+  configAckStatus = count; // settings applied
+  configAckPending = true;
+}
+// CRC-8 of the OTA settings in settings report order (bytes 0-7, 12, 20-28 and 31-36) - the server compares it with what it sent
+uint8_t configHash() {
+  uint8_t settings[12 + DELTA_FIELDS + LINK_ADR_SETTINGS] = {(uint8_t)(sendIntervalMinutes & 0xFF), (uint8_t)(sendIntervalMinutes >> 8), spsCleanIntervalDays,
+                         spsStabilizationPreReadoutDelay, spsStopAfterReadout, realTimeResyncIntervalDays,
+                         overrideTimeSynchronization, allowDeepSleep, samplesPerFrame, deltaHeartbeatSlots};
+  memcpy(settings + 10, deltaThresholds, DELTA_FIELDS);
+  settings[10 + DELTA_FIELDS] = slotOffsetSeconds & 0xFF;
+  settings[11 + DELTA_FIELDS] = slotOffsetSeconds >> 8;
+  uint8_t *linkAdr = settings + 12 + DELTA_FIELDS;
+  linkAdr[0] = linkCheckInterval;
+  linkAdr[1] = linkMinDataRate;
+  linkAdr[2] = linkMaxDataRate;
+  linkAdr[3] = linkMinPowerDbm;
+  linkAdr[4] = linkMaxPowerDbm;
+  linkAdr[5] = linkMarginTargetDb;
+  return crc8(settings, sizeof(settings));
+}
+#if TRACE_BUFFER_SIZE
+// record a trace.h event - the oldest records make room
+void traceEvent(uint8_t event, uint8_t args, int32_t a, int32_t b) {
+  uint8_t record[TRACE_RECORD_MAX_LENGTH];
+  uint8_t length = 1;
+  record[0] = traceRecordHeader(event, args);
+  if (args > 0) {
+    length += traceVarint(record + length, a);
+  }
+  if (args > 1) {
+    length += traceVarint(record + length, b);
+  }
+  while ((uint8_t)((traceHead + TRACE_BUFFER_SIZE - traceTail) % TRACE_BUFFER_SIZE) + length >= TRACE_BUFFER_SIZE) {
+    traceTail = (traceTail + traceRecordLength(traceTail)) % TRACE_BUFFER_SIZE;
+    if (traceDropped < 255) {
+      traceDropped++;
+    }
+  }
+  for (uint8_t i = 0; i < length; i++) {
+    traceBuffer[traceHead] = record[i];
+    traceHead = (traceHead + 1) % TRACE_BUFFER_SIZE;
+  }
+}
+// bytes of the record starting at index at - the header and a varint per argument
+uint8_t traceRecordLength(uint8_t at) {
+  uint8_t length = 1;
+  for (uint8_t args = traceBuffer[at] >> 6; args > 0; args--) {
+    while (traceBuffer[(at + length++) % TRACE_BUFFER_SIZE] & 0x80);
+  }
+  return length;
+}
+// the dropped count and the oldest whole records that fit into maxLength bytes - tail is where the rest starts
+uint8_t traceDump(uint8_t *out, uint8_t maxLength, uint8_t &tail) {
+  uint8_t length = 1;
+  out[0] = traceDropped;
+  tail = traceTail;
+  while (tail != traceHead) {
+    uint8_t recordLength = traceRecordLength(tail);
+    if (length + recordLength > maxLength) {
+      break;
+    }
+    for (uint8_t i = 0; i < recordLength; i++) {
+      out[length++] = traceBuffer[tail];
+      tail = (tail + 1) % TRACE_BUFFER_SIZE;
+    }
+  }
+  return length;
+}
+// all records as "TRACE <hex>" lines for traceDecode - only while a host has the serial port open
+void traceFlushSerial() {
+  uint8_t line[32];
+  while (Serial && (traceTail != traceHead || traceDropped != 0)) {
+    uint8_t length = traceDump(line, sizeof(line), traceTail);
+    traceDropped = 0;
+    Serial.print(F("TRACE "));
+    for (uint8_t i = 0; i < length; i++) {
+      Serial.print("0123456789abcdef"[line[i] >> 4]);
+      Serial.print("0123456789abcdef"[line[i] & 0x0F]);
+    }
+    Serial.print('\n');
+  }
+}
+// oldest records on TRACE_FPORT - a deferred dump keeps them
+void traceSendByUplink() {
+  uint8_t frame[MULTI_SAMPLE_MAX_LENGTH];
+  uint8_t tail;
+  uint8_t length = traceDump(frame, sizeof(frame), tail);
+  if (sendUplink(TRACE_FPORT, frame, length)) {
+    traceTail = tail;
+    traceDropped = 0;
+  }
+}
+#endif
 // Report settings to the server
 void reportSettingsByUplink(){
-  uint8_t reportPayload[12];                
+  uint8_t reportPayload[SETTINGS_REPORT_LENGTH];
   uint8_t fport = 4; // port 4 for settings report             
   #if USE_HW_RTC
     DateTime now = rtc.now();
@@ -743,20 +2637,184 @@ void reportSettingsByUplink(){
   #else
     uint32_t timestamp = now(); 
   #endif
-  reportPayload[0] = (sendIntervalMinutes & 0xFF);           // sendIntervalMinutes Low byte
-  reportPayload[1] = (sendIntervalMinutes >> 8) & 0xFF;      // sendIntervalMinutes High byte
-  reportPayload[2] = spsCleanIntervalDays;                   // Cleaning interval (in days)
-  reportPayload[3] = spsStabilizationPreReadoutDelay;        // Stabilization delay (in minutes)
-  reportPayload[4] = spsStopAfterReadout;                    // Stop after readout flag (1 = stop, 0 = continue)
-  reportPayload[5] = realTimeResyncIntervalDays;             // Real-time synchronization interval (in days)
-  reportPayload[6] = overrideTimeSynchronization;            // Time synchronization override flag (1 = override, 0 = sync)
-  reportPayload[7] = allowDeepSleep;                         // allow deep sleep
-  
-  // add timestamp (little-endian – LSB first)
-  reportPayload[8]  = (timestamp >> 0) & 0xFF;
-  reportPayload[9]  = (timestamp >> 8) & 0xFF;
-  reportPayload[10] = (timestamp >> 16) & 0xFF;
-  reportPayload[11] = (timestamp >> 24) & 0xFF;
+  Port4Fields report;
+  report.sendIntervalMinutes = sendIntervalMinutes;
+  report.spsCleanIntervalDays = spsCleanIntervalDays;
+  report.spsStabilizationPreReadoutDelay = spsStabilizationPreReadoutDelay;
+  report.spsStopAfterReadout = spsStopAfterReadout;                   // 1 = stop, 0 = continue
+  report.realTimeResyncIntervalDays = realTimeResyncIntervalDays;
+  report.overrideTimeSynchronization = overrideTimeSynchronization;   // 1 = override, 0 = sync
+  report.allowDeepSleep = allowDeepSleep;
+  report.timestamp = timestamp;
+  report.samplesPerFrame = samplesPerFrame;
+  report.watchdogDeviationPercent = wdtBaseNanos[watchdogBucket()] ? (int16_t)(((int32_t)wdtBaseNanos[watchdogBucket()] - (int32_t)WDT_NOMINAL_BASE_NANOS) / 160) : (int16_t)0x8000; // 10 ppm
+  #if USE_HW_RTC
+    report.rtcDriftPpm = rtcDrift;                                    // 0.01 ppm, 0x8000 = not measured yet
+    report.rtcAgingOffset = rtcAging;
+  #else
+    report.rtcDriftPpm = (int16_t)0x8000;
+    report.rtcAgingOffset = 0;
+  #endif
+  report.resyncIntervalDays = resyncIntervalDays();
+  report.configHash = configHash();                                   // CRC-8 of bytes 0-7, 12, 20-28 and 31-36, as in a config ack
+  report.deltaHeartbeatSlots = deltaHeartbeatSlots;
+  report.deltaThresholdTemp = deltaThresholds[0];
+  report.deltaThresholdHum = deltaThresholds[1];
+  report.deltaThresholdMc1p0 = deltaThresholds[2];
+  report.deltaThresholdMc2p5 = deltaThresholds[3];
+  report.deltaThresholdMc4p0 = deltaThresholds[4];
+  report.deltaThresholdMc10p0 = deltaThresholds[5];
+  report.slotOffsetSeconds = slotOffsetSeconds;
+  report.slotOffsetInUse = slotOffset();
+  report.linkCheckInterval = linkCheckInterval;
+  report.linkMinDataRate = linkMinDataRate;
+  report.linkMaxDataRate = linkMaxDataRate;
+  report.linkMinPowerDbm = linkMinPowerDbm;
+  report.linkMaxPowerDbm = linkMaxPowerDbm;
+  report.linkMarginTargetDb = linkMarginTargetDb;
+  report.dataRateInUse = linkDataRate;
+  report.txPowerInUse = linkPowerDbm;
+  report.linkMarginDb = linkMarginDb;                                 // last LinkCheckAns, 0xFF = none yet
+  encodePort4(report, reportPayload);
   
-  lora.SendData(fport, reportPayload, sizeof(reportPayload));
-}
\ No newline at end of file
+  settingsReportPending = !sendUplink(fport, reportPayload, sizeof(reportPayload)); // a deferred report is sent before the next reading
+}
+// counters of the last checkpoint, a fresh start if there is none - every power-on counts
+void telemetryLoad() {
+  EEPROM.get(EEPROM_TELEMETRY_START, telemetry);
+  if (crc8((uint8_t *)&telemetry, sizeof(telemetry) - 1) != telemetry.crc) {
+    memset(&telemetry, 0, sizeof(telemetry)); // never saved, cleared or torn by a power loss
+  }
+  telemetryCount(TELEMETRY_POWER_ONS);
+}
+// the clock is known from nowEpoch on - counting starts, or resumes without the time since the checkpoint: the station
+// was off or its counts were lost, so sinceEpoch moves on by it and the totals still cover timestamp - sinceEpoch
+void telemetryClock(uint32_t nowEpoch) {
+  if (telemetryClockKnown) {
+    return;
+  }
+  telemetryClockKnown = true;
+  if (telemetry.sinceEpoch == 0) {
+    telemetry.sinceEpoch = nowEpoch;
+  } else if (nowEpoch > telemetry.savedEpoch) {
+    telemetry.sinceEpoch += nowEpoch - telemetry.savedEpoch;
+  }
+}
+// checkpoint - only the bytes that changed are written, the CRC last
+void telemetrySave() {
+  telemetry.savedEpoch = getCurrentEpoch();
+  telemetry.crc = crc8((uint8_t *)&telemetry, sizeof(telemetry) - 1);
+  EEPROM.put(EEPROM_TELEMETRY_START, telemetry);
+  telemetrySavedEpoch = telemetry.savedEpoch;
+}
+// add to a time total - whole seconds go to the total, the rest is carried to the next call
+void telemetryAddMillis(uint8_t time, uint32_t ms) {
+  uint32_t total = telemetryCarryMillis[time] + ms;
+  telemetryCarryMillis[time] = total % 1000;
+  telemetry.seconds[time] += total / 1000;
+}
+void telemetryCount(uint8_t counter) {
+  if (telemetry.counts[counter] < 0xFFFF) {
+    telemetry.counts[counter]++;
+  }
+}
+// once a slot - a checkpoint every TELEMETRY_CHECKPOINT_HOURS and diagnostics every DIAGNOSTICS_INTERVAL_DAYS,
+// counted from the first slot with a known clock
+void telemetryUpdate() {
+  spsFanCount();
+  if (!telemetryClockKnown) {
+    return;
+  }
+  uint32_t nowEpoch = getCurrentEpoch();
+  if (telemetrySavedEpoch == 0 || nowEpoch < telemetrySavedEpoch) {
+    telemetrySavedEpoch = nowEpoch;
+  }
+  if (nowEpoch - telemetrySavedEpoch >= TELEMETRY_CHECKPOINT_HOURS * 3600UL) {
+    telemetrySave();
+  }
+#if DIAGNOSTICS_INTERVAL_DAYS
+  if (diagnosticsSentEpoch == 0 || nowEpoch < diagnosticsSentEpoch) {
+    diagnosticsSentEpoch = nowEpoch;
+  }
+  if (nowEpoch - diagnosticsSentEpoch >= DIAGNOSTICS_INTERVAL_DAYS * 86400UL) {
+    diagnosticsPending = true;
+  }
+#endif
+  if (diagnosticsPending && isJoined()) {
+    diagnosticsSendByUplink();
+  }
+}
+// telemetry totals on DIAGNOSTICS_FPORT - checkpointed first, a deferred uplink is sent with a later slot
+void diagnosticsSendByUplink() {
+  spsFanCount();
+  telemetrySave();
+  Port7Fields diagnostics;
+  diagnostics.timestamp = telemetry.savedEpoch;
+  diagnostics.sinceEpoch = telemetry.sinceEpoch;
+  diagnostics.powerDownSeconds = telemetry.seconds[TELEMETRY_POWER_DOWN];
+  diagnostics.idleSeconds = telemetry.seconds[TELEMETRY_IDLE];
+  diagnostics.spsFanSeconds = telemetry.seconds[TELEMETRY_SPS_FAN];
+  diagnostics.spsWaitSeconds = telemetry.seconds[TELEMETRY_SPS_WAIT];
+  diagnostics.radioSeconds = telemetry.seconds[TELEMETRY_RADIO];
+  diagnostics.txSeconds = telemetry.seconds[TELEMETRY_TX];
+  diagnostics.uplinks = telemetry.counts[TELEMETRY_UPLINKS];
+  diagnostics.joinRequests = telemetry.counts[TELEMETRY_JOIN_REQUESTS];
+  diagnostics.timeSyncFailures = telemetry.counts[TELEMETRY_TIME_SYNC_FAILURES];
+  diagnostics.spsTimeouts = telemetry.counts[TELEMETRY_SPS_TIMEOUTS];
+  diagnostics.powerOns = telemetry.counts[TELEMETRY_POWER_ONS];
+  diagnostics.joinSeconds = joinSeconds;
+  uint8_t frame[PORT7_LENGTH];
+  encodePort7(diagnostics, frame);
+  diagnosticsPending = !sendUplink(DIAGNOSTICS_FPORT, frame, sizeof(frame));
+  if (!diagnosticsPending) {
+    diagnosticsSentEpoch = diagnostics.timestamp;
+  }
+}
+// slot of the next fan cleaning - the first spsCleanIntervalDays after the last one, which the first slot since
+// power-on stands in for
+uint32_t spsCleaningEpoch(uint32_t slotEpoch) {
+  if (spsCleanedEpoch == 0 || spsCleanedEpoch > slotEpoch) {
+    spsCleanedEpoch = slotEpoch; // power-on or the clock was set back
+  }
+  return spsCleanIntervalDays ? slotAfter(spsCleanedEpoch + spsCleanIntervalDays * 86400UL - 1) : JOB_NONE;
+}
+// fan cleaning - the measurement is started for it if it was stopped, and runs until the cleaning ends
+void spsFanCleaning(uint32_t slotEpoch) {
+  const bool stopped = !spsMeasuring;
+  if (stopped) {
+    spsStart();
+  }
+  spsCommand(SPS30_START_FAN_CLEANING, NULL, 0);
+  TRACE1(SPS_FAN_CLEANING, spsCleanIntervalDays)
+  spsCleanedEpoch = slotEpoch;
+  const uint32_t nowEpoch = getCurrentEpoch();
+  sleepUntilClock(nowEpoch, nowEpoch + SPS30_FAN_CLEANING_SECONDS);
+  if (stopped) {
+    spsStop();
+  }
+}
+// SPS30 measurement on and off - the fan time is counted for the telemetry
+void spsStart() {
+  const uint16_t format = SPS30_OUTPUT_UINT16;
+  spsCommand(SPS30_START_MEASUREMENT, &format, 1);
+  if (!spsMeasuring) {
+    spsMeasuring = true;
+    spsFanSinceEpoch = getCurrentEpoch();
+  }
+}
+void spsStop() {
+  spsCommand(SPS30_STOP_MEASUREMENT, NULL, 0);
+  spsFanCount();
+  spsMeasuring = false;
+}
+// add the fan time up to now - a clock set back adds nothing
+void spsFanCount() {
+  if (!spsMeasuring) {
+    return;
+  }
+  uint32_t nowEpoch = getCurrentEpoch();
+  if (nowEpoch > spsFanSinceEpoch) {
+    telemetryAddMillis(TELEMETRY_SPS_FAN, (nowEpoch - spsFanSinceEpoch) * 1000UL);
+  }
+  spsFanSinceEpoch = nowEpoch;
+}
@@ -0,0 +1,131 @@
+#ifndef MULTI_SAMPLE_H
+#define MULTI_SAMPLE_H
+
+#include <stdint.h>
+
+// Multi-sample uplink frame - several consecutive readings of the port 1 data in one uplink:
+//   byte 0     bits 0-3 number of readings, bits 4-6 mantissa bits dropped from the readings after the keyframe,
+//              bit 7 set if the frame ends with a 2 byte config ack (config hash and status) after the readings
+//   varint     send interval in minutes - reading i of n was taken (n - 1 - i) intervals before the last one
+//   24 bytes   keyframe - the first reading exactly as in the port 1 payload
+//   then for every further reading 12 zig-zag varints, one per field in payload order: the
+//   difference of its reduced sflt16 code to the reduced code of the reading before
+// Varints carry 7 bits per byte, lowest group first, bit 7 set if another byte follows.
+// With 0 dropped bits the codes are kept exactly, so the decoded values equal those of port 1.
+// Dropping bits rounds the 11 bit mantissa of the later readings to 11 - n bits (0.05 % * 2^n
+// resolution) - sensor noise below the sensor accuracy then stops costing a second varint byte.
+#define MULTI_SAMPLE_FIELDS 12
+#define MULTI_SAMPLE_KEYFRAME_LENGTH (2 * MULTI_SAMPLE_FIELDS)
+#define MULTI_SAMPLE_MAX_DROP_BITS 7
+#define MULTI_SAMPLE_CONFIG_ACK 0x80
+
+static inline uint16_t multiSampleCode(const uint8_t *data, uint8_t field) {
+  return (uint16_t)(data[2 * field] | (data[2 * field + 1] << 8));   // LSB first as in payloadSchema.h
+}
+
+static inline void multiSampleSetCode(uint8_t *data, uint8_t field, uint16_t code) {
+  data[2 * field] = (uint8_t)code;
+  data[2 * field + 1] = (uint8_t)(code >> 8);
+}
+
+// sflt16 code with its mantissa rounded to 11 - dropBits bits and shifted down by dropBits - the rounding
+// carries into the exponent like f2sflt16() does but stops below the saturation codes
+static inline uint16_t multiSampleReduce(uint16_t code, uint8_t dropBits) {
+  if (dropBits == 0 || (code & 0x7FFF) == 0x7FFF) {
+    return code >> dropBits;
+  }
+  const uint16_t mask = (uint16_t)((1 << dropBits) - 1);
+  uint16_t exponent = (code >> 11) & 0x0F;
+  uint16_t mantissa = code & 0x7FF;
+  if (mantissa != 0) {   // 0 is the zero code
+    mantissa = (uint16_t)((mantissa + (mask >> 1) + 1) & ~mask);
+    if (mantissa > 0x7FF) {
+      mantissa = 1 << 10;
+      exponent++;
+    }
+    if (exponent > 15 || (exponent == 15 && mantissa == (0x7FF & ~mask))) {
+      exponent = 15;   // largest value below the saturation code
+      mantissa = (uint16_t)((0x7FF & ~mask) - (mask + 1));
+    }
+  }
+  return (uint16_t)((code & 0x8000) | (exponent << 11) | mantissa) >> dropBits;
+}
+
+// sflt16 code of a reduced value - the saturation codes get their low bits back
+static inline uint16_t multiSampleExpand(uint16_t reduced, uint8_t dropBits) {
+  const uint16_t mask = (uint16_t)((1 << dropBits) - 1);
+  uint16_t code = (uint16_t)(reduced << dropBits);
+  if (((code | mask) & 0x7FFF) == 0x7FFF) {
+    code |= mask;
+  }
+  return code;
+}
+
+// small differences of either sign become small numbers: 0, -1, 1, -2, 2 ... -> 0, 1, 2, 3, 4 ...
+static inline uint16_t zigZag16(int16_t value) {
+  return (uint16_t)((uint16_t)value << 1) ^ (uint16_t)(value < 0 ? 0xFFFF : 0);
+}
+
+static inline int16_t unZigZag16(uint16_t value) {
+  return (int16_t)((value >> 1) ^ (uint16_t)(0 - (value & 1)));
+}
+
+static inline uint8_t varintLength(uint16_t value) {
+  return value < 0x80 ? 1 : (value < 0x4000 ? 2 : 3);
+}
+
+static inline uint8_t putVarint(uint8_t *out, uint16_t value) {
+  uint8_t n = 0;
+  while (value >= 0x80) {
+    out[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[n++] = (uint8_t)value;
+  return n;
+}
+
+static inline uint8_t multiSampleDropBits(const uint8_t *frame) {
+  return (frame[0] >> 4) & 0x07;
+}
+
+static inline uint8_t multiSampleCount(const uint8_t *frame) {
+  return frame[0] & 0x0F;
+}
+
+static inline int16_t multiSampleDelta(const uint8_t *previous, const uint8_t *data, uint8_t field, uint8_t dropBits) {
+  return (int16_t)(uint16_t)(multiSampleReduce(multiSampleCode(data, field), dropBits) -
+                             multiSampleReduce(multiSampleCode(previous, field), dropBits));
+}
+
+// bytes the reading data takes in a frame whose last reading decoded to previous
+static inline uint8_t multiSampleDeltaLength(const uint8_t *frame, const uint8_t *previous, const uint8_t *data) {
+  uint8_t length = 0;
+  for (uint8_t f = 0; f < MULTI_SAMPLE_FIELDS; f++) {
+    length += varintLength(zigZag16(multiSampleDelta(previous, data, f, multiSampleDropBits(frame))));
+  }
+  return length;
+}
+
+// start a frame with data as keyframe, returns the frame length
+static inline uint8_t multiSampleStart(uint8_t *frame, uint16_t intervalMinutes, uint8_t dropBits, const uint8_t *data) {
+  frame[0] = (uint8_t)(dropBits << 4 | 1);
+  uint8_t length = 1 + putVarint(frame + 1, intervalMinutes);
+  for (uint8_t i = 0; i < MULTI_SAMPLE_KEYFRAME_LENGTH; i++) {
+    frame[length++] = data[i];
+  }
+  return length;
+}
+
+// append data to a frame of length bytes whose last reading decoded to previous, returns the new length;
+// previous is updated to what the decoder will get for data
+static inline uint8_t multiSampleAppend(uint8_t *frame, uint8_t length, uint8_t *previous, const uint8_t *data) {
+  const uint8_t dropBits = multiSampleDropBits(frame);
+  for (uint8_t f = 0; f < MULTI_SAMPLE_FIELDS; f++) {
+    length += putVarint(frame + length, zigZag16(multiSampleDelta(previous, data, f, dropBits)));
+    multiSampleSetCode(previous, f, multiSampleExpand(multiSampleReduce(multiSampleCode(data, f), dropBits), dropBits));
+  }
+  frame[0]++;
+  return length;
+}
+
+#endif
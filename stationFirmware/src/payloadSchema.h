@@ -0,0 +1,178 @@
+#ifndef PAYLOAD_SCHEMA_H
+#define PAYLOAD_SCHEMA_H
+
+#include <stdint.h>
+#include "sflt16.h"
+
+// Uplink layouts - the one definition the firmware encoders, the host decoder in tools/payloadDecoder and the
+// generated TTN payload formatter are built from. A field is X(name, type, scale): fields follow each other without
+// gaps in list order, all multi-byte values little-endian (LSB first). Decoded value = code * scale; SFLT16 fields
+// are given to the encoder as fixed point values in thousandths and encoded as sflt16FromRatio(value, scale * 1000),
+// SFLT16_NONE (sensor failed) as 0x7800 like zero. The integer fields are given to the encoder as their code.
+//   SFLT16  16 bit float of sflt16.h, 0x7FFF/0xFFFF = saturated
+//   U8 I8 U16 U32  plain integers
+//   I16N    int16_t, 0x8000 = not available
+// Append new fields at the end of a port, decoders take a field only if the uplink is long enough for it.
+
+// the 24 data bytes of a reading - port 1 and port 2, the keyframe of port 5
+#define MEASUREMENT_FIELDS(X) \
+  X(temp, SFLT16, 100) \
+  X(hum, SFLT16, 100) \
+  X(mc_1p0, SFLT16, 100) \
+  X(mc_2p5, SFLT16, 100) \
+  X(mc_4p0, SFLT16, 100) \
+  X(mc_10p0, SFLT16, 100) \
+  X(nc_0p5, SFLT16, 100) \
+  X(nc_1p0, SFLT16, 100) \
+  X(nc_2p5, SFLT16, 100) \
+  X(nc_4p0, SFLT16, 100) \
+  X(nc_10p0, SFLT16, 100) \
+  X(typical_particle_size, SFLT16, 100)
+
+// port 1 - a reading and the wake error of the sleep before it in 10 ms, +-127 = or more
+#define PORT1_FIELDS(X) \
+  MEASUREMENT_FIELDS(X) \
+  X(wake_error_ms, I8, 10)
+
+// port 2 - a reading resent from the store with its slot epoch
+#define PORT2_FIELDS(X) \
+  X(epoch, U32, 1) \
+  MEASUREMENT_FIELDS(X)
+
+// port 4 - settings report
+#define PORT4_FIELDS(X) \
+  X(sendIntervalMinutes, U16, 1) \
+  X(spsCleanIntervalDays, U8, 1) \
+  X(spsStabilizationPreReadoutDelay, U8, 1) \
+  X(spsStopAfterReadout, U8, 1) \
+  X(realTimeResyncIntervalDays, U8, 1) \
+  X(overrideTimeSynchronization, U8, 1) \
+  X(allowDeepSleep, U8, 1) \
+  X(timestamp, U32, 1) \
+  X(samplesPerFrame, U8, 1) \
+  X(watchdogDeviationPercent, I16N, 0.001f) \
+  X(rtcDriftPpm, I16N, 0.01f) \
+  X(resyncIntervalDays, U8, 1) \
+  X(rtcAgingOffset, I8, 1) \
+  X(configHash, U8, 1) \
+  X(deltaHeartbeatSlots, U8, 1) \
+  X(deltaThresholdTemp, U8, 1) \
+  X(deltaThresholdHum, U8, 1) \
+  X(deltaThresholdMc1p0, U8, 1) \
+  X(deltaThresholdMc2p5, U8, 1) \
+  X(deltaThresholdMc4p0, U8, 1) \
+  X(deltaThresholdMc10p0, U8, 1) \
+  X(slotOffsetSeconds, U16, 1) \
+  X(slotOffsetInUse, U16, 1) \
+  X(linkCheckInterval, U8, 1) \
+  X(linkMinDataRate, U8, 1) \
+  X(linkMaxDataRate, U8, 1) \
+  X(linkMinPowerDbm, U8, 1) \
+  X(linkMaxPowerDbm, U8, 1) \
+  X(linkMarginTargetDb, U8, 1) \
+  X(dataRateInUse, U8, 1) \
+  X(txPowerInUse, U8, 1) \
+  X(linkMarginDb, U8, 1)
+
+// port 6 - spread of the samples averaged into the reading of the same slot (OVERSAMPLE_STATS_UPLINK)
+#define PORT6_SPREAD(X, field) \
+  X(field##_min, SFLT16, 100) \
+  X(field##_max, SFLT16, 100) \
+  X(field##_sd, SFLT16, 100)
+#define PORT6_FIELDS(X) \
+  X(epoch, U32, 1) \
+  X(htu_samples, U8, 1) \
+  X(sps_samples, U8, 1) \
+  PORT6_SPREAD(X, temp) \
+  PORT6_SPREAD(X, hum) \
+  PORT6_SPREAD(X, mc_1p0) \
+  PORT6_SPREAD(X, mc_2p5) \
+  PORT6_SPREAD(X, mc_4p0) \
+  PORT6_SPREAD(X, mc_10p0)
+
+// port 7 - diagnostics: running totals since counting started at sinceEpoch, sent at timestamp (both local time)
+#define PORT7_FIELDS(X) \
+  X(timestamp, U32, 1) \
+  X(sinceEpoch, U32, 1) \
+  X(powerDownSeconds, U32, 1) \
+  X(idleSeconds, U32, 1) \
+  X(spsFanSeconds, U32, 1) \
+  X(spsWaitSeconds, U32, 1) \
+  X(radioSeconds, U32, 1) \
+  X(txSeconds, U32, 1) \
+  X(uplinks, U16, 1) \
+  X(joinRequests, U16, 1) \
+  X(timeSyncFailures, U16, 1) \
+  X(spsTimeouts, U16, 1) \
+  X(powerOns, U16, 1) \
+  X(joinSeconds, U32, 1)
+
+#define SCHEMA_SIZE_SFLT16 2
+#define SCHEMA_SIZE_U8     1
+#define SCHEMA_SIZE_I8     1
+#define SCHEMA_SIZE_U16    2
+#define SCHEMA_SIZE_I16N   2
+#define SCHEMA_SIZE_U32    4
+
+#define SFLT16_NONE INT32_MIN   // no value for an SFLT16 field
+
+#define SCHEMA_CTYPE_SFLT16 int32_t
+#define SCHEMA_CTYPE_U8     uint8_t
+#define SCHEMA_CTYPE_I8     int8_t
+#define SCHEMA_CTYPE_U16    uint16_t
+#define SCHEMA_CTYPE_I16N   int16_t
+#define SCHEMA_CTYPE_U32    uint32_t
+
+enum SchemaType : uint8_t { SCHEMA_SFLT16, SCHEMA_U8, SCHEMA_I8, SCHEMA_U16, SCHEMA_I16N, SCHEMA_U32 };
+
+// field offsets PORTn_<name> and the uplink length PORTn_LENGTH - every field takes the enumerator after its last byte
+#define SCHEMA_OFFSETS(port, name, type, scale) port##_##name, port##_##name##_end = port##_##name + SCHEMA_SIZE_##type - 1,
+#define PORT1_OFFSET(name, type, scale) SCHEMA_OFFSETS(PORT1, name, type, scale)
+#define PORT2_OFFSET(name, type, scale) SCHEMA_OFFSETS(PORT2, name, type, scale)
+#define PORT4_OFFSET(name, type, scale) SCHEMA_OFFSETS(PORT4, name, type, scale)
+#define PORT6_OFFSET(name, type, scale) SCHEMA_OFFSETS(PORT6, name, type, scale)
+#define PORT7_OFFSET(name, type, scale) SCHEMA_OFFSETS(PORT7, name, type, scale)
+enum Port1Offset : uint8_t { PORT1_FIELDS(PORT1_OFFSET) PORT1_LENGTH };
+enum Port2Offset : uint8_t { PORT2_FIELDS(PORT2_OFFSET) PORT2_LENGTH };
+enum Port4Offset : uint8_t { PORT4_FIELDS(PORT4_OFFSET) PORT4_LENGTH };
+enum Port6Offset : uint8_t { PORT6_FIELDS(PORT6_OFFSET) PORT6_LENGTH };
+enum Port7Offset : uint8_t { PORT7_FIELDS(PORT7_OFFSET) PORT7_LENGTH };
+#define MEASUREMENT_LENGTH PORT1_wake_error_ms   // data bytes of a reading
+
+static inline void schemaPutSFLT16(uint8_t *p, int32_t value, uint16_t scale) {
+  uint16_t code = value == SFLT16_NONE ? 0x7800 : sflt16FromRatio(value, scale * 1000UL);
+  p[0] = (uint8_t)code;
+  p[1] = (uint8_t)(code >> 8);
+}
+static inline void schemaPutU8(uint8_t *p, uint8_t code, float) { p[0] = code; }
+static inline void schemaPutI8(uint8_t *p, int8_t code, float) { p[0] = (uint8_t)code; }
+static inline void schemaPutU16(uint8_t *p, uint16_t code, float) {
+  p[0] = (uint8_t)code;
+  p[1] = (uint8_t)(code >> 8);
+}
+static inline void schemaPutI16N(uint8_t *p, int16_t code, float scale) { schemaPutU16(p, (uint16_t)code, scale); }
+static inline void schemaPutU32(uint8_t *p, uint32_t code, float) {
+  for (uint8_t i = 0; i < 4; i++) {
+    p[i] = (uint8_t)(code >> (8 * i));
+  }
+}
+
+// encoders - a struct with one member per field and encodePortN(fields, out) writing PORTn_LENGTH bytes
+#define SCHEMA_MEMBER(name, type, scale) SCHEMA_CTYPE_##type name;
+#define PORT1_PUT(name, type, scale) schemaPut##type(out + PORT1_##name, fields.name, scale);
+#define PORT2_PUT(name, type, scale) schemaPut##type(out + PORT2_##name, fields.name, scale);
+#define PORT4_PUT(name, type, scale) schemaPut##type(out + PORT4_##name, fields.name, scale);
+#define PORT6_PUT(name, type, scale) schemaPut##type(out + PORT6_##name, fields.name, scale);
+#define PORT7_PUT(name, type, scale) schemaPut##type(out + PORT7_##name, fields.name, scale);
+struct Port1Fields { PORT1_FIELDS(SCHEMA_MEMBER) };
+struct Port2Fields { PORT2_FIELDS(SCHEMA_MEMBER) };
+struct Port4Fields { PORT4_FIELDS(SCHEMA_MEMBER) };
+struct Port6Fields { PORT6_FIELDS(SCHEMA_MEMBER) };
+struct Port7Fields { PORT7_FIELDS(SCHEMA_MEMBER) };
+static inline void encodePort1(const Port1Fields &fields, uint8_t *out) { PORT1_FIELDS(PORT1_PUT) }
+static inline void encodePort2(const Port2Fields &fields, uint8_t *out) { PORT2_FIELDS(PORT2_PUT) }
+static inline void encodePort4(const Port4Fields &fields, uint8_t *out) { PORT4_FIELDS(PORT4_PUT) }
+static inline void encodePort6(const Port6Fields &fields, uint8_t *out) { PORT6_FIELDS(PORT6_PUT) }
+static inline void encodePort7(const Port7Fields &fields, uint8_t *out) { PORT7_FIELDS(PORT7_PUT) }
+
+#endif
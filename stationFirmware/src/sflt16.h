@@ -0,0 +1,91 @@
+#ifndef SFLT16_H
+#define SFLT16_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Encode a float from (-1, 1) to the 16 bit signed float used in the uplink payload:
+// bit 15 sign, bits 14-11 exponent biased by 15, bits 10-0 mantissa with the leading 1 kept.
+// Works on the IEEE-754 bits only, so no soft-float code is pulled in. The output is
+// bit-identical to the former frexpf()/ldexpf() implementation for every float, including
+// its quirks: zero encodes as 0x7800, values below 2^-16 keep exponent 0 with a normalized
+// mantissa, |f| >= 1 saturates to 0x7FFF/0xFFFF. NaN encodes like zero.
+static inline uint16_t f2sflt16(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  const uint16_t sign = (uint16_t)(bits >> 16) & 0x8000;
+  bits &= 0x7FFFFFFFUL;
+
+  if (bits > 0x7F800000UL || bits == 0)
+    return 0x7800;                     // NaN or zero - frexpf() gives exponent 0
+  if (bits >= 0x3F800000UL)
+    return sign ? 0xFFFF : 0x7FFF;     // |f| >= 1 (incl. infinity) - out of range
+
+  int16_t exponent = (int16_t)(bits >> 23);   // biased by 127, 0..126
+  uint32_t significand = bits & 0x007FFFFFUL;
+  if (exponent == 0) {
+    // subnormal - normalize the significand; the exponent ends up far below 0 and gets clamped
+    while (!(significand & 0x00800000UL))
+      significand <<= 1;
+  } else {
+    significand |= 0x00800000UL;
+  }
+  // frexpf() exponent is (exponent - 126), the format biases it by 15
+  exponent -= 126 - 15;
+  if (exponent < 0)
+    exponent = 0;
+
+  // round the 24 bit significand to 11 bits - only its top 16 bits matter, so stay in 16 bit math
+  uint16_t fraction = (uint16_t)(((uint16_t)(significand >> 8) >> 4) + 1) >> 1;
+  if (fraction >= (1 << 11)) {
+    fraction = 1 << 10;                // rounding carried out of the mantissa
+    exponent++;
+  }
+  if (exponent > 15)
+    return 0x7FFF | sign;
+  return (uint16_t)(sign | ((uint16_t)exponent << 11) | fraction);
+}
+
+// Encode the ratio n / d the same way without any float - for fixed point values, n in thousandths and d the
+// scale times 1000. The mantissa comes from a shift-and-subtract division, so no division routine is pulled in
+// either. Exactly rounded (half away from zero) where f2sflt16() rounds the float quotient; |n| >= d saturates,
+// d has to stay below 2^31.
+static inline uint16_t sflt16FromRatio(int32_t n, uint32_t d) {
+  if (n == 0)
+    return 0x7800;
+  const uint16_t sign = n < 0 ? 0x8000 : 0;
+  uint32_t t = n < 0 ? 0UL - (uint32_t)n : (uint32_t)n;
+  if (t >= d)
+    return sign ? 0xFFFF : 0x7FFF;
+
+  // normalize t / d to [0.5, 1) - the frexpf() exponent is -shift
+  int16_t exponent = 15;
+  while (t < d - t) {
+    t <<= 1;
+    exponent--;
+  }
+  if (exponent < 0)
+    exponent = 0;
+
+  // 12 quotient bits, the first is always 1, then round to 11
+  uint16_t quotient = 0;
+  for (uint8_t i = 0; i < 12; i++) {
+    quotient <<= 1;
+    if (t >= d - t) {
+      t -= d - t;
+      quotient |= 1;
+    } else {
+      t <<= 1;
+    }
+  }
+  uint16_t fraction = (uint16_t)(quotient + 1) >> 1;
+  if (fraction >= (1 << 11)) {
+    fraction = 1 << 10;                // rounding carried out of the mantissa
+    exponent++;
+  }
+  if (exponent > 15)
+    return 0x7FFF | sign;
+  return (uint16_t)(sign | ((uint16_t)exponent << 11) | fraction);
+}
+
+#endif
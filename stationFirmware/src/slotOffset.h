@@ -0,0 +1,20 @@
+#ifndef SLOT_OFFSET_H
+#define SLOT_OFFSET_H
+
+#include <stdint.h>
+
+// Offset of a station's uplinks after the slot, hashed from its DevEUI - FNV-1a, so the sequential DevEUIs of a
+// fleet land spread over the whole window without any coordination. The fleet collision simulation
+// (tools/payloadDecoder/slotCollisionSim.cpp) uses it as well.
+static inline uint16_t slotOffsetFromDevEUI(const uint8_t *devEUI, uint16_t windowSeconds) {
+  if (windowSeconds == 0) {
+    return 0;
+  }
+  uint32_t hash = 2166136261UL;
+  for (uint8_t i = 0; i < 8; i++) {
+    hash = (hash ^ devEUI[i]) * 16777619UL;
+  }
+  return (uint16_t)((hash ^ (hash >> 16)) % windowSeconds);   // the high bits mix better
+}
+
+#endif
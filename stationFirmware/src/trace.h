@@ -0,0 +1,78 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Trace events - the firmware records only the event number and up to two integer arguments, the format strings
+// stay on the host (tools/payloadDecoder/traceDecode). Append new events at the end, numbers must not change.
+// %d signed, %u unsigned argument.
+#define TRACE_EVENTS(X) \
+  X(BOOT, "boot, config version %d") \
+  X(JOIN_ATTEMPT, "join attempt %d") \
+  X(JOINED, "joined after %u s, %d join requests") \
+  X(JOIN_GIVEN_UP, "not joined in setup, measuring into the store") \
+  X(SESSION_CLEARED, "session cleared, rejoining") \
+  X(SLOT, "slot at epoch %u") \
+  X(WAIT_SLOT, "waiting %d s for the next slot") \
+  X(UPLINK, "uplink on port %d, %d bytes") \
+  X(UPLINK_DEFERRED, "airtime limit, uplink on port %d deferred") \
+  X(DUTY_CYCLE_WAIT, "duty cycle wait %d s") \
+  X(READING_MERGED, "reading merged into the next uplink") \
+  X(FRAME_SENT, "multi-sample frame of %d readings") \
+  X(DOWNLINK, "downlink on port %d, %d bytes") \
+  X(DOWNLINK_UNKNOWN, "undefined downlink port %d, %d bytes") \
+  X(CONFIG_BATCH_REJECTED, "config batch rejected at entry %d") \
+  X(CONFIG_SAVED, "config saved to slot %d, sequence %d") \
+  X(CONFIG_LOADED, "config loaded from slot %d, sequence %d") \
+  X(CONFIG_DEFAULTS, "config version changed, config.h values used") \
+  X(TIME_REQUEST, "time request, LoRaWAN flags 0x%x") \
+  X(TIME_SYNCED, "time set to GPS epoch %u, answer %d ms after it") \
+  X(TIME_SYNC_FAILED, "time sync failed %d times, retry in %d min") \
+  X(TIME_FREE_RUNNING, "time sync failing, sending by interval") \
+  X(RTC_DRIFT, "RTC offset %d ms, drift %d x 0.01 ppm") \
+  X(RTC_MISSING, "RTC not found") \
+  X(RTC_LOST_POWER, "RTC lost power") \
+  X(WDT_CALIBRATED, "watchdog base period %u ns in bucket %d") \
+  X(WAKE_ERROR, "wake error %d ms") \
+  X(HTU_ERROR, "HTU21D error %d (1 no answer, 2 CRC, 3 timeout)") \
+  X(SPS_ERROR, "SPS30 read error %d (1 no answer, 2 CRC)") \
+  X(SPS_TIMEOUT, "SPS30 timeout") \
+  X(LINK_CONFIRMED, "link confirmed") \
+  X(LINK_LOST, "link check unanswered, readings kept for resend") \
+  X(STORE_RESEND, "resending stored slot %d") \
+  X(STORE_NEWEST, "store newest slot %d") \
+  X(SESSION_KEYS_CHANGED, "session keys changed, session cleared") \
+  X(READING_UNCHANGED, "reading within the delta thresholds, not sent %d slots in a row") \
+  X(JOIN_BACKOFF, "join request unanswered, next one in %u s") \
+  X(LINK_ADR, "data rate %d, TX power %d dBm") \
+  X(LINK_CHECK, "link check margin %d dB, %d gateways") \
+  X(LINK_FALLBACK, "link checks unanswered, fallback from data rate %d, TX power %d dBm") \
+  X(WAIT_JOB, "waiting %d s for job %d") \
+  X(SPS_FAN_CLEANING, "SPS30 fan cleaning, every %d days")
+
+#define TRACE_ID(name, format) TRACE_##name,
+enum TraceEvent : uint8_t { TRACE_EVENTS(TRACE_ID) TRACE_EVENT_COUNT };
+
+// A record is one header byte - bits 0-5 the event, bits 6-7 the number of arguments - and the arguments as
+// zig-zag LEB128 varints of their int32_t value. Dumps (serial lines and uplinks) start with the number of records
+// overwritten since the last dump (saturates at 255), then the records oldest first.
+#define TRACE_MAX_ARGS 2
+#define TRACE_RECORD_MAX_LENGTH (1 + 5 * TRACE_MAX_ARGS)
+static_assert(TRACE_EVENT_COUNT <= 64, "the record header has 6 bits for the event");
+
+static inline uint8_t traceRecordHeader(uint8_t event, uint8_t args) {
+  return (uint8_t)(event | (args << 6));
+}
+
+static inline uint8_t traceVarint(uint8_t *out, int32_t value) {
+  uint32_t zigZag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+  uint8_t length = 0;
+  while (zigZag >= 0x80) {
+    out[length++] = (uint8_t)(zigZag | 0x80);
+    zigZag >>= 7;
+  }
+  out[length++] = (uint8_t)zigZag;
+  return length;
+}
+
+#endif
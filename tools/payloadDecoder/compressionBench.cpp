@@ -0,0 +1,154 @@
+// Compression and airtime benchmark of the port 5 multi-sample frames on recorded port 1 data
+//
+//   compressionBench [--max-length BYTES] [--drop-bits N] [FILE]
+//
+// Reads port 1 uplinks in the decodePayload input format (e.g. written by the simulation with
+// --uplinks, or exported from the network server), packs them the way the firmware does for
+// every samplesPerFrame from 1 to 15, checks that every frame decodes back to the original
+// readings and prints bytes and airtime per reading against plain port 1 uplinks.
+// --max-length is the largest application payload the data rate allows (51 for SF10-SF12),
+// --drop-bits is MULTI_SAMPLE_DROP_BITS; the largest relative error it causes is printed too.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "payloadDecoder.h"
+#include "multiSample.h"
+#include "airtime.h"
+
+#define PORT1_PAYLOAD_LENGTH 25        // 24 bytes of readings, byte 24 is wake_error_ms
+#define MAX_SAMPLES_PER_FRAME 15
+
+// EU868 airtime in ms at BW125 of an uplink with length application bytes
+static double airtimeMs(int sf, int length) {
+  return loraAirtimeMicros((uint8_t)sf, 125, (uint8_t)(LORAWAN_FRAME_OVERHEAD + length)) / 1000.0;
+}
+
+struct PackResult {
+  size_t frames = 0;
+  size_t bytes = 0;
+  double airtime[13] = {};   // per spreading factor, index 7..12
+  size_t mismatches = 0;
+  double maxRelativeError = 0;
+};
+
+// what the decoder has to give for readings first..first+n: the keyframe exactly, the later ones reduced
+static std::vector<uint8_t> expectedReadings(const uint8_t *readings, size_t n, uint8_t dropBits) {
+  std::vector<uint8_t> expected(readings, readings + n * MEASUREMENT_FRAME_LENGTH);
+  for (size_t i = 1; i < n; i++) {
+    uint8_t *data = &expected[i * MEASUREMENT_FRAME_LENGTH];
+    for (uint8_t f = 0; f < MULTI_SAMPLE_FIELDS; f++) {
+      multiSampleSetCode(data, f, multiSampleExpand(multiSampleReduce(multiSampleCode(data, f), dropBits), dropBits));
+    }
+  }
+  return expected;
+}
+
+static void account(PackResult &r, const uint8_t *frame, uint8_t length, const uint8_t *readings, size_t n) {
+  r.frames++;
+  r.bytes += length;
+  for (int sf = 7; sf <= 12; sf++) r.airtime[sf] += airtimeMs(sf, length);
+  std::vector<uint8_t> decoded;
+  std::vector<uint8_t> expected = expectedReadings(readings, n, multiSampleDropBits(frame));
+  uint16_t interval;
+  if (!decodeMultiSampleFrame(frame, length, decoded, interval) || decoded != expected) {
+    r.mismatches++;
+    return;
+  }
+  for (size_t i = 0; i < n * MULTI_SAMPLE_FIELDS; i++) {
+    float original = sflt16ToFloat(multiSampleCode(readings, (uint8_t)i), 1.0f);
+    float value = sflt16ToFloat(multiSampleCode(decoded.data(), (uint8_t)i), 1.0f);
+    if (original != 0 && isfinite(original)) r.maxRelativeError = fmax(r.maxRelativeError, fabs(value / original - 1));
+  }
+}
+
+// pack the readings like sendReading() does: a frame goes out when it is full or the next reading does not fit
+static PackResult pack(const std::vector<uint8_t> &readings, uint8_t samplesPerFrame, uint8_t maxLength, uint8_t dropBits) {
+  PackResult r;
+  size_t count = readings.size() / MEASUREMENT_FRAME_LENGTH;
+  uint8_t frame[256];
+  uint8_t previous[MULTI_SAMPLE_KEYFRAME_LENGTH];
+  uint8_t length = 0;
+  size_t first = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *data = &readings[i * MEASUREMENT_FRAME_LENGTH];
+    if (length && length + multiSampleDeltaLength(frame, previous, data) > maxLength) {
+      account(r, frame, length, &readings[first * MEASUREMENT_FRAME_LENGTH], i - first);
+      length = 0;
+    }
+    if (length == 0) {
+      first = i;
+      length = multiSampleStart(frame, 5, dropBits, data);
+      memcpy(previous, data, MULTI_SAMPLE_KEYFRAME_LENGTH);
+    } else {
+      length = multiSampleAppend(frame, length, previous, data);
+    }
+    if (multiSampleCount(frame) >= samplesPerFrame) {
+      account(r, frame, length, &readings[first * MEASUREMENT_FRAME_LENGTH], i + 1 - first);
+      length = 0;
+    }
+  }
+  if (length) account(r, frame, length, &readings[first * MEASUREMENT_FRAME_LENGTH], count - first);
+  return r;
+}
+
+int main(int argc, char **argv) {
+  unsigned maxLength = 51, dropBits = 0;
+  const char *path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--max-length") && i + 1 < argc) maxLength = (unsigned)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--drop-bits") && i + 1 < argc) dropBits = (unsigned)atoi(argv[++i]);
+    else if (argv[i][0] != '-' && !path) path = argv[i];
+    else {
+      fprintf(stderr, "usage: %s [--max-length BYTES] [--drop-bits N] [FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (dropBits > MULTI_SAMPLE_MAX_DROP_BITS) {
+    fprintf(stderr, "--drop-bits has to be between 0 and %d\n", MULTI_SAMPLE_MAX_DROP_BITS);
+    return 2;
+  }
+  if (maxLength < 1 + 3 + MULTI_SAMPLE_KEYFRAME_LENGTH || maxLength > 222) {
+    fprintf(stderr, "--max-length has to be between %d and 222\n", 1 + 3 + MULTI_SAMPLE_KEYFRAME_LENGTH);
+    return 2;
+  }
+  FILE *in = path ? fopen(path, "r") : stdin;
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+  std::vector<uint8_t> readings, bytes;
+  char line[1024];
+  while (fgets(line, sizeof(line), in)) {
+    unsigned port;
+    if (line[0] == '#' || line[0] == '\n') continue;
+    if (parseFrameLine(line, 1, port, bytes) && port == 1 && bytes.size() >= MEASUREMENT_FRAME_LENGTH) {
+      readings.insert(readings.end(), bytes.begin(), bytes.begin() + MEASUREMENT_FRAME_LENGTH);
+    }
+  }
+  if (path) fclose(in);
+  size_t count = readings.size() / MEASUREMENT_FRAME_LENGTH;
+  if (count == 0) {
+    fprintf(stderr, "no port 1 readings in the input\n");
+    return 1;
+  }
+
+  double port1Ms[13];
+  for (int sf = 7; sf <= 12; sf++) port1Ms[sf] = airtimeMs(sf, PORT1_PAYLOAD_LENGTH);
+  printf("%zu readings, frames up to %u bytes, %u mantissa bits dropped\n", count, maxLength, dropBits);
+  printf("port 1: %d bytes/reading, airtime ms/reading SF7 %.1f, SF10 %.1f, SF12 %.1f\n\n", PORT1_PAYLOAD_LENGTH,
+         port1Ms[7], port1Ms[10], port1Ms[12]);
+  printf("samples  readings  bytes     ms/reading              airtime gain           max rel.  mismatches\n");
+  printf("/frame   /frame    /reading  SF7     SF10    SF12    SF7    SF10   SF12    error\n");
+  size_t mismatches = 0;
+  for (uint8_t n = 1; n <= MAX_SAMPLES_PER_FRAME; n++) {
+    PackResult r = pack(readings, n, (uint8_t)maxLength, (uint8_t)dropBits);
+    mismatches += r.mismatches;
+    printf("%6u  %8.2f  %8.2f  %6.1f  %6.1f  %6.1f   %5.2fx %5.2fx %5.2fx  %7.2g  %6zu\n", n, (double)count / r.frames,
+           (double)r.bytes / count, r.airtime[7] / count, r.airtime[10] / count, r.airtime[12] / count,
+           port1Ms[7] * count / r.airtime[7], port1Ms[10] * count / r.airtime[10], port1Ms[12] * count / r.airtime[12],
+           r.maxRelativeError, r.mismatches);
+  }
+  return mismatches ? 1 : 0;
+}
@@ -0,0 +1,63 @@
+// Throughput benchmark of the port 1 batch decoder
+//
+//   decodeBench [FRAMES]
+//
+// Encodes random sensor readings with the firmware's saveToPayload() scaling and f2sflt16(),
+// checks that batch decoding matches the scalar reference for every value and that every
+// code round-trips through the firmware encoder, then reports frames per second.
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "payloadDecoder.h"
+#include "sflt16.h"
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? strtoull(argv[1], NULL, 0) : 2000000;
+  std::vector<uint8_t> frames(count * MEASUREMENT_FRAME_LENGTH);
+  srand(1);
+  for (size_t i = 0; i < frames.size(); i += 2) {
+    float value = (rand() % 1200000 - 200000) / 10000.0f;   // -20 .. 100, saturates above 99.95
+    uint16_t code = f2sflt16(value / 100);
+    frames[i] = code & 0xFF;
+    frames[i + 1] = code >> 8;
+  }
+
+  MeasurementColumns columns;
+  auto start = std::chrono::steady_clock::now();
+  decodeMeasurementFrames(frames.data(), count, MEASUREMENT_FRAME_LENGTH, columns, true);
+  double batchSeconds = seconds(start);
+
+  std::vector<float> scalar(count * MEASUREMENT_FIELD_COUNT);
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *frame = &frames[i * MEASUREMENT_FRAME_LENGTH];
+    for (size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++)
+      scalar[i * MEASUREMENT_FIELD_COUNT + f] =
+          sflt16ToFloat((uint16_t)(frame[2 * f] | (frame[2 * f + 1] << 8)), PAYLOAD_SFLT16_SCALE, true);
+  }
+  double scalarSeconds = seconds(start);
+
+  size_t mismatches = 0, roundTripErrors = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t *frame = &frames[i * MEASUREMENT_FRAME_LENGTH];
+    for (size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++) {
+      float batch = columns.field[f][i];
+      if (memcmp(&batch, &scalar[i * MEASUREMENT_FIELD_COUNT + f], sizeof(float))) mismatches++;
+      uint16_t code = (uint16_t)(frame[2 * f] | (frame[2 * f + 1] << 8));
+      if (f2sflt16(batch / PAYLOAD_SFLT16_SCALE) != code) roundTripErrors++;
+    }
+  }
+
+  printf("%zu frames, %zu values\n", count, count * MEASUREMENT_FIELD_COUNT);
+  printf("  batch   %8.3f ms  %12.0f frames/s\n", batchSeconds * 1e3, count / batchSeconds);
+  printf("  scalar  %8.3f ms  %12.0f frames/s\n", scalarSeconds * 1e3, count / scalarSeconds);
+  printf("  batch vs scalar mismatches: %zu, encoder round-trip errors: %zu\n", mismatches, roundTripErrors);
+  return mismatches || roundTripErrors ? 1 : 0;
+}
@@ -0,0 +1,192 @@
+// Command line decoder for station uplinks
+//
+//   decodePayload [--port 1|4|5|6|7] [--keep-saturated] [--currents SLEEP,IDLE,ACTIVE,TX,FAN] [FILE]
+//
+// Reads one frame per line as hex, optionally prefixed by its fport ("1 3f6a..." or "1,3f6a..."),
+// and prints CSV. Frames of other ports are skipped. Port 1 frames end with the wake error in ms and, after a port 11
+// config batch, the config ack (hash and status, empty otherwise). Port 5 frames print one line per reading with
+// the frame number and how many minutes before the frame's last reading it was taken. Saturated values print as inf/-inf unless
+// --keep-saturated asks for the raw value the code stands for. Port 6 prints the oversampling statistics as the schema
+// lists them. Port 7 prints the diagnostics totals and the estimated mAh per day by state since the report before
+// (since counting started for the first one and after a reset of the counts), from the supply currents in mA of
+// --currents - the simulation's defaults otherwise.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "payloadDecoder.h"
+
+int main(int argc, char **argv) {
+  unsigned wantedPort = 1;
+  bool keepSaturated = false;
+  const char *path = NULL;
+  const char *currentsList = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--port") && i + 1 < argc) wantedPort = (unsigned)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--keep-saturated")) keepSaturated = true;
+    else if (!strcmp(argv[i], "--currents") && i + 1 < argc) currentsList = argv[++i];
+    else if (argv[i][0] != '-' && !path) path = argv[i];
+    else {
+      fprintf(stderr, "usage: %s [--port 1|4|5|6|7] [--keep-saturated] [--currents SLEEP,IDLE,ACTIVE,TX,FAN] [FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+  StationCurrents currents;
+  if (currentsList && sscanf(currentsList, "%f,%f,%f,%f,%f", &currents.sleep, &currents.idle, &currents.active,
+                             &currents.tx, &currents.spsFan) != 5) {
+    fprintf(stderr, "--currents takes the sleep, idle, active, tx and SPS30 fan currents in mA\n");
+    return 2;
+  }
+  if (wantedPort != 1 && (wantedPort < 4 || wantedPort > 7)) {
+    fprintf(stderr, "only ports 1, 4, 5, 6 and 7 are decoded\n");
+    return 2;
+  }
+  FILE *in = path ? fopen(path, "r") : stdin;
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+
+  std::vector<uint8_t> frames, bytes;
+  std::vector<unsigned> frameNumber, minutesBeforeLast;   // port 5 - per reading
+  std::vector<int> wakeError;                             // port 1
+  std::vector<ConfigAck> acks;                            // port 1 per frame, port 5 per reading
+  std::vector<SettingsReport> reports;
+  std::vector<std::vector<uint8_t>> statistics;           // port 6
+  std::vector<Diagnostics> diagnostics;                   // port 7
+  size_t skipped = 0, count = 0, multiSampleFrames = 0;
+  const size_t frameLength = wantedPort == 4 ? SETTINGS_REPORT_BASELINE_LENGTH : MEASUREMENT_FRAME_LENGTH;
+  char line[1024];
+  while (fgets(line, sizeof(line), in)) {
+    unsigned port;
+    if (line[0] == '#' || line[0] == '\n') continue;
+    if (!parseFrameLine(line, wantedPort, port, bytes) || port != wantedPort) {
+      skipped++;
+      continue;
+    }
+    if (wantedPort == 5) {
+      uint16_t intervalMinutes;
+      size_t first = count;
+      if (!decodeMultiSampleFrame(bytes.data(), bytes.size(), frames, intervalMinutes)) {
+        skipped++;
+        continue;
+      }
+      size_t length = bytes.size();
+      ConfigAck ack = configAck(port, bytes.data(), length);
+      multiSampleFrames++;
+      count = frames.size() / MEASUREMENT_FRAME_LENGTH;
+      for (size_t i = first; i < count; i++) {
+        frameNumber.push_back((unsigned)multiSampleFrames);
+        minutesBeforeLast.push_back((unsigned)((count - 1 - i) * intervalMinutes));
+        acks.push_back(ack);
+      }
+      continue;
+    }
+    if (wantedPort == 6) {
+      statistics.push_back(bytes);
+      continue;
+    }
+    if (wantedPort == 7) {
+      Diagnostics d;
+      if (decodeDiagnostics(bytes.data(), bytes.size(), d)) diagnostics.push_back(d);
+      else skipped++;
+      continue;
+    }
+    if (bytes.size() < frameLength) {
+      skipped++;
+      continue;
+    }
+    if (wantedPort == 4) {
+      SettingsReport r;
+      if (decodeSettingsReport(bytes.data(), bytes.size(), r)) reports.push_back(r);
+      else skipped++;
+      continue;
+    }
+    size_t length = bytes.size();
+    acks.push_back(configAck(port, bytes.data(), length));
+    frames.insert(frames.end(), bytes.begin(), bytes.begin() + frameLength);
+    wakeError.push_back(wakeErrorMillis(bytes.data(), length));
+    count++;
+  }
+  if (path) fclose(in);
+
+  if (wantedPort == 7) {
+    printf("timestamp,sinceEpoch,powerDownSeconds,idleSeconds,spsFanSeconds,spsWaitSeconds,radioSeconds,txSeconds,"
+           "uplinks,joinRequests,timeSyncFailures,spsTimeouts,powerOns,joinSeconds,days,sleep_mAh_per_day,idle_mAh_per_day,"
+           "active_mAh_per_day,tx_mAh_per_day,sps_fan_mAh_per_day,mAh_per_day\n");
+    for (size_t i = 0; i < diagnostics.size(); i++) {
+      const Diagnostics &d = diagnostics[i];
+      printf("%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%u,%u,%u,%u,%u,%lu", (unsigned long)d.timestamp, (unsigned long)d.sinceEpoch,
+             (unsigned long)d.powerDownSeconds, (unsigned long)d.idleSeconds, (unsigned long)d.spsFanSeconds,
+             (unsigned long)d.spsWaitSeconds, (unsigned long)d.radioSeconds, (unsigned long)d.txSeconds, d.uplinks,
+             d.joinRequests, d.timeSyncFailures, d.spsTimeouts, d.powerOns, (unsigned long)d.joinSeconds);
+      DiagnosticsEnergy e = diagnosticsEnergy(d, i ? &diagnostics[i - 1] : NULL, currents);
+      if (e.days > 0) printf(",%.3f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n", e.days, e.sleep, e.idle, e.active, e.tx, e.spsFan, e.total);
+      else printf(",,,,,,,\n");
+    }
+  } else if (wantedPort == 6) {
+    size_t fieldCount;
+    const SchemaField *fields = uplinkSchema(6, fieldCount);
+    for (size_t f = 0; f < fieldCount; f++) printf(f ? ",%s" : "%s", fields[f].name);
+    putchar('\n');
+    for (const std::vector<uint8_t> &frame : statistics) {
+      for (size_t f = 0; f < fieldCount; f++) {
+        float value;
+        if (f) putchar(',');
+        if (fields[f].type == SCHEMA_U32 && frame.size() >= fields[f].offset + 4u) {   // epoch - exact, not via float
+          const uint8_t *p = frame.data() + fields[f].offset;
+          printf("%lu", (unsigned long)p[0] | (unsigned long)p[1] << 8 | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24);
+        } else if (decodeSchemaField(fields[f], frame.data(), frame.size(), value, keepSaturated)) {
+          printf("%.6g", value);
+        }
+      }
+      putchar('\n');
+    }
+  } else if (wantedPort != 4) {
+    MeasurementColumns columns;
+    decodeMeasurementFrames(frames.data(), count, MEASUREMENT_FRAME_LENGTH, columns, keepSaturated);
+    if (wantedPort == 5) printf("frame,minutes_before_last,");
+    for (size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++) printf(f ? ",%s" : "%s", measurementFieldNames[f]);
+    if (wantedPort == 1) printf(",wake_error_ms");
+    printf(",config_hash,config_status\n");
+    for (size_t i = 0; i < count; i++) {
+      if (wantedPort == 5) printf("%u,%u,", frameNumber[i], minutesBeforeLast[i]);
+      for (size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++) printf(f ? ",%.6g" : "%.6g", columns.field[f][i]);
+      if (wantedPort == 1) printf(",%d", wakeError[i]);
+      if (acks[i].present) printf(",%u,%u\n", acks[i].configHash, acks[i].status);
+      else printf(",,\n");
+    }
+  } else {
+    printf("sendIntervalMinutes,spsCleanIntervalDays,spsStabilizationPreReadoutDelay,spsStopAfterReadout,"
+           "realTimeResyncIntervalDays,overrideTimeSynchronization,allowDeepSleep,timestamp,samplesPerFrame,"
+           "watchdogDeviationPercent,rtcDriftPpm,resyncIntervalDays,rtcAgingOffset,configHash,configHashMatches,"
+           "deltaHeartbeatSlots,deltaThresholdTemp,deltaThresholdHum,deltaThresholdMc1p0,deltaThresholdMc2p5,"
+           "deltaThresholdMc4p0,deltaThresholdMc10p0,slotOffsetSeconds,slotOffsetInUse,linkCheckInterval,"
+           "linkMinDataRate,linkMaxDataRate,linkMinPowerDbm,linkMaxPowerDbm,linkMarginTargetDb,dataRateInUse,txPowerInUse,"
+           "linkMarginDb\n");
+    for (const SettingsReport &r : reports) {
+      printf("%u,%u,%u,%u,%u,%u,%u,%lu", r.sendIntervalMinutes, r.spsCleanIntervalDays,
+             r.spsStabilizationPreReadoutDelay, r.spsStopAfterReadout, r.realTimeResyncIntervalDays,
+             r.overrideTimeSynchronization, r.allowDeepSleep, (unsigned long)r.timestamp);
+      if (!r.full) {
+        printf(",,,,,,,,,,,,,,,,,,,,,,,,,\n");   // the 25 columns from samplesPerFrame on
+        continue;
+      }
+      printf(",%u,", r.samplesPerFrame);
+      if (r.watchdogCalibrated) printf("%.3f", r.watchdogDeviationPercent);
+      putchar(',');
+      if (r.rtcDriftMeasured) printf("%.2f", r.rtcDriftPpm);
+      printf(",%u,%d,%u,%d,%u", r.resyncIntervalDays, r.rtcAgingOffset, r.configHash, r.configHash == settingsHash(r),
+             r.deltaHeartbeatSlots);
+      for (int i = 0; i < 6; i++) printf(",%u", r.deltaThresholds[i]);
+      printf(",%u,%u", r.slotOffsetSeconds, r.slotOffsetInUse);
+      for (int i = 0; i < 6; i++) printf(",%u", r.linkAdr[i]);
+      printf(",%u,%u,", r.dataRateInUse, r.txPowerInUse);
+      if (r.linkMarginDb != 0xFF) printf("%u", r.linkMarginDb);
+      putchar('\n');
+    }
+  }
+  if (skipped) fprintf(stderr, "%zu lines skipped (other port, too short or not hex)\n", skipped);
+  return 0;
+}
@@ -0,0 +1,325 @@
+// Batch decoder for the station uplinks
+//
+// sflt16 layout (see stationFirmware/src/sflt16.h): bit 15 sign, bits 14-11 exponent biased by
+// 15, bits 10-0 mantissa including the leading one, value = mantissa / 2^11 * 2^(exponent - 15).
+// Both the scalar and the vector path build the power of two straight into the float exponent
+// and multiply in the same order, so they give bit-identical results.
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "payloadDecoder.h"
+#include "multiSample.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define FIELD_NAME(name, type, scale) #name,
+const char *const measurementFieldNames[MEASUREMENT_FIELD_COUNT] = {MEASUREMENT_FIELDS(FIELD_NAME)};
+
+#define PORT1_ENTRY(name, type, scale) {#name, SCHEMA_##type, PORT1_##name, scale},
+#define PORT2_ENTRY(name, type, scale) {#name, SCHEMA_##type, PORT2_##name, scale},
+#define PORT4_ENTRY(name, type, scale) {#name, SCHEMA_##type, PORT4_##name, scale},
+#define PORT6_ENTRY(name, type, scale) {#name, SCHEMA_##type, PORT6_##name, scale},
+#define PORT7_ENTRY(name, type, scale) {#name, SCHEMA_##type, PORT7_##name, scale},
+static const SchemaField port1Schema[] = {PORT1_FIELDS(PORT1_ENTRY)};
+static const SchemaField port2Schema[] = {PORT2_FIELDS(PORT2_ENTRY)};
+static const SchemaField port4Schema[] = {PORT4_FIELDS(PORT4_ENTRY)};
+static const SchemaField port6Schema[] = {PORT6_FIELDS(PORT6_ENTRY)};
+static const SchemaField port7Schema[] = {PORT7_FIELDS(PORT7_ENTRY)};
+#define PORT4_INDEX(name, type, scale) PORT4_FIELD_##name,
+enum { PORT4_FIELDS(PORT4_INDEX) };
+static_assert(sizeof(port1Schema) / sizeof(port1Schema[0]) == MEASUREMENT_FIELD_COUNT + 1 &&
+              MEASUREMENT_LENGTH == 2 * MEASUREMENT_FIELD_COUNT && MULTI_SAMPLE_FIELDS == MEASUREMENT_FIELD_COUNT,
+              "a reading is the sflt16 fields the column and multi-sample decoders expect");
+
+// float with exponent field e + 127, i.e. 2^(e), for -126 <= e <= 127
+static inline float powerOfTwo(int32_t e) {
+  uint32_t bits = (uint32_t)(e + 127) << 23;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+float sflt16ToFloat(uint16_t code, float scale, bool keepSaturated) {
+  if (!keepSaturated) {
+    if (code == SFLT16_SATURATED_POSITIVE) return INFINITY;
+    if (code == SFLT16_SATURATED_NEGATIVE) return -INFINITY;
+  }
+  float magnitude = (float)(code & 0x7FF) * powerOfTwo(((code >> 11) & 0x0F) - 15 - 11) * scale;
+  return (code & 0x8000) ? -magnitude : magnitude;
+}
+
+void sflt16DecodeBatch(const uint16_t *codes, float *out, size_t n, float scale, bool keepSaturated) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i mantissaMask = _mm_set1_epi32(0x7FF);
+  const __m128i exponentMask = _mm_set1_epi32(0x0F);
+  const __m128i exponentBias = _mm_set1_epi32(127 - 15 - 11);
+  const __m128 scaleVector = _mm_set1_ps(scale);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i saturatedPositive = _mm_set1_epi32(SFLT16_SATURATED_POSITIVE);
+  const __m128i saturatedNegative = _mm_set1_epi32(SFLT16_SATURATED_NEGATIVE);
+  const __m128 infinity = _mm_set1_ps(INFINITY);
+  for (; i + 8 <= n; i += 8) {
+    __m128i raw = _mm_loadu_si128((const __m128i *)(codes + i));
+    __m128i halves[2] = {_mm_unpacklo_epi16(raw, zero), _mm_unpackhi_epi16(raw, zero)};
+    for (int h = 0; h < 2; h++) {
+      __m128i v = halves[h];
+      __m128 mantissa = _mm_cvtepi32_ps(_mm_and_si128(v, mantissaMask));
+      __m128i exponent = _mm_and_si128(_mm_srli_epi32(v, 11), exponentMask);
+      __m128 power = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(exponent, exponentBias), 23));
+      __m128 magnitude = _mm_mul_ps(_mm_mul_ps(mantissa, power), scaleVector);
+      if (!keepSaturated) {
+        __m128 saturated = _mm_castsi128_ps(
+            _mm_or_si128(_mm_cmpeq_epi32(v, saturatedPositive), _mm_cmpeq_epi32(v, saturatedNegative)));
+        magnitude = _mm_or_ps(_mm_andnot_ps(saturated, magnitude), _mm_and_ps(saturated, infinity));
+      }
+      __m128 sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_srli_epi32(v, 15), 31));
+      _mm_storeu_ps(out + i + 4 * h, _mm_or_ps(magnitude, sign));
+    }
+  }
+#endif
+  for (; i < n; i++) out[i] = sflt16ToFloat(codes[i], scale, keepSaturated);
+}
+
+void decodeMeasurementFrames(const uint8_t *frames, size_t count, size_t stride, MeasurementColumns &out,
+                             bool keepSaturated) {
+  std::vector<uint16_t> column(count);
+  for (size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++) {
+    const uint8_t *p = frames + 2 * f;
+    for (size_t i = 0; i < count; i++, p += stride) column[i] = (uint16_t)(p[0] | (p[1] << 8));   // LSB first
+    out.field[f].resize(count);
+    sflt16DecodeBatch(column.data(), out.field[f].data(), count, PAYLOAD_SFLT16_SCALE, keepSaturated);
+  }
+}
+
+const SchemaField *uplinkSchema(unsigned port, size_t &count) {
+  switch (port) {
+    case 1: count = sizeof(port1Schema) / sizeof(port1Schema[0]); return port1Schema;
+    case 2: count = sizeof(port2Schema) / sizeof(port2Schema[0]); return port2Schema;
+    case 4: count = sizeof(port4Schema) / sizeof(port4Schema[0]); return port4Schema;
+    case 6: count = sizeof(port6Schema) / sizeof(port6Schema[0]); return port6Schema;
+    case 7: count = sizeof(port7Schema) / sizeof(port7Schema[0]); return port7Schema;
+    default: count = 0; return NULL;
+  }
+}
+
+static uint8_t schemaSize(SchemaType type) {
+  switch (type) {
+    case SCHEMA_U8: case SCHEMA_I8: return 1;
+    case SCHEMA_U32: return 4;
+    default: return 2;
+  }
+}
+
+// little-endian code of a field - the caller checks the length
+static uint32_t schemaCode(const uint8_t *data, uint8_t offset, uint8_t size) {
+  uint32_t code = 0;
+  for (uint8_t i = 0; i < size; i++) code |= (uint32_t)data[offset + i] << (8 * i);
+  return code;
+}
+
+bool decodeSchemaField(const SchemaField &field, const uint8_t *data, size_t length, float &value, bool keepSaturated) {
+  uint8_t size = schemaSize(field.type);
+  if (length < (size_t)field.offset + size) return false;
+  uint32_t code = schemaCode(data, field.offset, size);
+  switch (field.type) {
+    case SCHEMA_SFLT16: value = sflt16ToFloat((uint16_t)code, field.scale, keepSaturated); return true;
+    case SCHEMA_I8: value = (int8_t)code * field.scale; return true;
+    case SCHEMA_I16N:
+      if (code == 0x8000) return false;
+      value = (int16_t)code * field.scale;
+      return true;
+    default: value = code * field.scale; return true;
+  }
+}
+
+bool decodeSettingsReport(const uint8_t *data, size_t length, SettingsReport &out) {
+  out = SettingsReport();
+  out.full = length >= PORT4_LENGTH;
+  if (!out.full && length != SETTINGS_REPORT_BASELINE_LENGTH) return false;
+  out.sendIntervalMinutes = (uint16_t)schemaCode(data, PORT4_sendIntervalMinutes, SCHEMA_SIZE_U16);
+  out.spsCleanIntervalDays = data[PORT4_spsCleanIntervalDays];
+  out.spsStabilizationPreReadoutDelay = data[PORT4_spsStabilizationPreReadoutDelay];
+  out.spsStopAfterReadout = data[PORT4_spsStopAfterReadout];
+  out.realTimeResyncIntervalDays = data[PORT4_realTimeResyncIntervalDays];
+  out.overrideTimeSynchronization = data[PORT4_overrideTimeSynchronization];
+  out.allowDeepSleep = data[PORT4_allowDeepSleep];
+  out.timestamp = schemaCode(data, PORT4_timestamp, SCHEMA_SIZE_U32);
+  if (!out.full) return true;
+  out.samplesPerFrame = data[PORT4_samplesPerFrame];
+  out.watchdogCalibrated = decodeSchemaField(port4Schema[PORT4_FIELD_watchdogDeviationPercent], data, length, out.watchdogDeviationPercent);
+  if (!out.watchdogCalibrated) out.watchdogDeviationPercent = 0.0f;
+  out.rtcDriftMeasured = decodeSchemaField(port4Schema[PORT4_FIELD_rtcDriftPpm], data, length, out.rtcDriftPpm);
+  if (!out.rtcDriftMeasured) out.rtcDriftPpm = 0.0f;
+  out.resyncIntervalDays = data[PORT4_resyncIntervalDays];
+  out.rtcAgingOffset = (int8_t)data[PORT4_rtcAgingOffset];
+  out.configHash = data[PORT4_configHash];
+  out.deltaHeartbeatSlots = data[PORT4_deltaHeartbeatSlots];
+  for (int i = 0; i < 6; i++) out.deltaThresholds[i] = data[PORT4_deltaThresholdTemp + i];
+  out.slotOffsetSeconds = (uint16_t)schemaCode(data, PORT4_slotOffsetSeconds, SCHEMA_SIZE_U16);
+  out.slotOffsetInUse = (uint16_t)schemaCode(data, PORT4_slotOffsetInUse, SCHEMA_SIZE_U16);
+  for (int i = 0; i < 6; i++) out.linkAdr[i] = data[PORT4_linkCheckInterval + i];
+  out.dataRateInUse = data[PORT4_dataRateInUse];
+  out.txPowerInUse = data[PORT4_txPowerInUse];
+  out.linkMarginDb = data[PORT4_linkMarginDb];
+  return true;
+}
+
+bool decodeDiagnostics(const uint8_t *data, size_t length, Diagnostics &out) {
+  if (length < PORT7_LENGTH) return false;
+  out.timestamp = schemaCode(data, PORT7_timestamp, SCHEMA_SIZE_U32);
+  out.sinceEpoch = schemaCode(data, PORT7_sinceEpoch, SCHEMA_SIZE_U32);
+  out.powerDownSeconds = schemaCode(data, PORT7_powerDownSeconds, SCHEMA_SIZE_U32);
+  out.idleSeconds = schemaCode(data, PORT7_idleSeconds, SCHEMA_SIZE_U32);
+  out.spsFanSeconds = schemaCode(data, PORT7_spsFanSeconds, SCHEMA_SIZE_U32);
+  out.spsWaitSeconds = schemaCode(data, PORT7_spsWaitSeconds, SCHEMA_SIZE_U32);
+  out.radioSeconds = schemaCode(data, PORT7_radioSeconds, SCHEMA_SIZE_U32);
+  out.txSeconds = schemaCode(data, PORT7_txSeconds, SCHEMA_SIZE_U32);
+  out.uplinks = (uint16_t)schemaCode(data, PORT7_uplinks, SCHEMA_SIZE_U16);
+  out.joinRequests = (uint16_t)schemaCode(data, PORT7_joinRequests, SCHEMA_SIZE_U16);
+  out.timeSyncFailures = (uint16_t)schemaCode(data, PORT7_timeSyncFailures, SCHEMA_SIZE_U16);
+  out.spsTimeouts = (uint16_t)schemaCode(data, PORT7_spsTimeouts, SCHEMA_SIZE_U16);
+  out.powerOns = (uint16_t)schemaCode(data, PORT7_powerOns, SCHEMA_SIZE_U16);
+  out.joinSeconds = schemaCode(data, PORT7_joinSeconds, SCHEMA_SIZE_U32);
+  return true;
+}
+
+DiagnosticsEnergy diagnosticsEnergy(const Diagnostics &report, const Diagnostics *previous, const StationCurrents &currents) {
+  Diagnostics base = {};
+  base.timestamp = report.sinceEpoch;
+  if (previous && previous->sinceEpoch == report.sinceEpoch && previous->timestamp < report.timestamp) base = *previous;
+  DiagnosticsEnergy e = {};
+  double seconds = (double)report.timestamp - base.timestamp;
+  if (report.sinceEpoch == 0 || seconds <= 0) return e;
+  double powerDown = (double)report.powerDownSeconds - base.powerDownSeconds;
+  double idle = (double)report.idleSeconds - base.idleSeconds;
+  double radio = (double)report.radioSeconds - base.radioSeconds;
+  double tx = (double)report.txSeconds - base.txSeconds;
+  double fan = (double)report.spsFanSeconds - base.spsFanSeconds;
+  double active = seconds - powerDown - idle - tx;   // radio waits and whatever no total covers
+  if (active < radio - tx) active = radio - tx;
+  if (active < 0) active = 0;
+  e.days = seconds / 86400.0;
+  const double perDay = 1.0 / 3600.0 / e.days;   // mA s -> mAh per day
+  e.sleep = powerDown * currents.sleep * perDay;
+  e.idle = idle * currents.idle * perDay;
+  e.active = active * currents.active * perDay;
+  e.tx = tx * currents.tx * perDay;
+  e.spsFan = fan * currents.spsFan * perDay;
+  e.total = e.sleep + e.idle + e.active + e.tx + e.spsFan;
+  return e;
+}
+
+// same CRC-8 as the firmware - polynomial 0x31, initial value 0
+static uint8_t crc8(const uint8_t *data, size_t length) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+uint8_t settingsHash(const SettingsReport &settings) {
+  uint8_t bytes[24] = {(uint8_t)(settings.sendIntervalMinutes & 0xFF), (uint8_t)(settings.sendIntervalMinutes >> 8),
+                       settings.spsCleanIntervalDays, settings.spsStabilizationPreReadoutDelay,
+                       settings.spsStopAfterReadout, settings.realTimeResyncIntervalDays,
+                       settings.overrideTimeSynchronization, settings.allowDeepSleep, settings.samplesPerFrame,
+                       settings.deltaHeartbeatSlots};
+  memcpy(bytes + 10, settings.deltaThresholds, 6);
+  bytes[16] = (uint8_t)(settings.slotOffsetSeconds & 0xFF);
+  bytes[17] = (uint8_t)(settings.slotOffsetSeconds >> 8);
+  memcpy(bytes + 18, settings.linkAdr, 6);
+  return crc8(bytes, sizeof(bytes));
+}
+
+ConfigAck configAck(unsigned port, const uint8_t *data, size_t &length) {
+  ConfigAck ack = {false, 0, 0};
+  if (port == 1) ack.present = length >= PORT1_LENGTH + CONFIG_ACK_LENGTH;
+  else if (port == 5) ack.present = length >= 1 + CONFIG_ACK_LENGTH && (data[0] & MULTI_SAMPLE_CONFIG_ACK);
+  if (ack.present) {
+    length -= CONFIG_ACK_LENGTH;
+    ack.configHash = data[length];
+    ack.status = data[length + 1];
+  }
+  return ack;
+}
+
+int wakeErrorMillis(const uint8_t *data, size_t length) {
+  return length > PORT1_wake_error_ms ? (int8_t)data[PORT1_wake_error_ms] * 10 : 0;
+}
+
+// LEB128 varint of at most three bytes, false if it runs past end
+static bool readVarint(const uint8_t *&p, const uint8_t *end, uint16_t &value) {
+  uint32_t v = 0;
+  for (int shift = 0; shift < 21; shift += 7) {
+    if (p == end) return false;
+    uint8_t b = *p++;
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      value = (uint16_t)v;
+      return v <= 0xFFFF;
+    }
+  }
+  return false;
+}
+
+bool decodeMultiSampleFrame(const uint8_t *data, size_t length, std::vector<uint8_t> &readings, uint16_t &intervalMinutes) {
+  const uint8_t *p = data, *end = data + length;
+  if (length < 2) return false;
+  if (data[0] & MULTI_SAMPLE_CONFIG_ACK) {
+    if (length < 2 + CONFIG_ACK_LENGTH) return false;
+    end -= CONFIG_ACK_LENGTH;   // see configAck()
+  }
+  uint8_t count = multiSampleCount(data), dropBits = multiSampleDropBits(data);
+  p++;
+  if (count == 0 || !readVarint(p, end, intervalMinutes) || (size_t)(end - p) < MULTI_SAMPLE_KEYFRAME_LENGTH) return false;
+  size_t first = readings.size();
+  readings.insert(readings.end(), p, p + MULTI_SAMPLE_KEYFRAME_LENGTH);
+  p += MULTI_SAMPLE_KEYFRAME_LENGTH;
+  for (uint8_t r = 1; r < count; r++) {
+    size_t previous = readings.size() - MEASUREMENT_FRAME_LENGTH;
+    readings.resize(readings.size() + MEASUREMENT_FRAME_LENGTH);
+    for (uint8_t f = 0; f < MULTI_SAMPLE_FIELDS; f++) {
+      uint16_t zigZag;
+      if (!readVarint(p, end, zigZag)) {
+        readings.resize(first);
+        return false;
+      }
+      uint16_t reduced = (uint16_t)(multiSampleReduce(multiSampleCode(&readings[previous], f), dropBits) + unZigZag16(zigZag));
+      multiSampleSetCode(&readings[previous + MEASUREMENT_FRAME_LENGTH], f, multiSampleExpand(reduced, dropBits));
+    }
+  }
+  if (p != end) {
+    readings.resize(first);
+    return false;
+  }
+  return true;
+}
+
+static int hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool parseFrameLine(const char *line, unsigned defaultPort, unsigned &port, std::vector<uint8_t> &bytes) {
+  port = defaultPort;
+  const char *hex = line;
+  const char *separator = strpbrk(line, " ,;\t");
+  if (separator && separator > line) {
+    port = (unsigned)strtoul(line, NULL, 10);
+    hex = separator + 1;
+  }
+  while (*hex == ' ' || *hex == '\t') hex++;
+  if (hex[0] == '0' && (hex[1] == 'x' || hex[1] == 'X')) hex += 2;
+  bytes.clear();
+  for (; hexNibble(hex[0]) >= 0; hex += 2) {
+    int hi = hexNibble(hex[0]), lo = hexNibble(hex[1]);
+    if (lo < 0) return false;
+    bytes.push_back((uint8_t)(hi << 4 | lo));
+  }
+  return !bytes.empty();
+}
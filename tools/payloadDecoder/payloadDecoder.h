@@ -0,0 +1,148 @@
+// Batch decoder for the station uplinks - port 1 and port 5 measurements, port 4 settings reports, config acks,
+// port 7 diagnostics
+#ifndef PAYLOAD_DECODER_H
+#define PAYLOAD_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "payloadSchema.h"
+
+// saveToPayload() divides every value by 100 before f2sflt16()
+#define PAYLOAD_SFLT16_SCALE 100.0f
+
+#define SFLT16_SATURATED_POSITIVE 0x7FFF   // value >= 1 before scaling (or rounded up to 1)
+#define SFLT16_SATURATED_NEGATIVE 0xFFFF   // value <= -1 before scaling
+
+#define MEASUREMENT_FIELD_COUNT 12
+#define MEASUREMENT_FRAME_LENGTH ((size_t)MEASUREMENT_LENGTH)  // bytes carrying data - port 1 adds the wake error
+#define SETTINGS_REPORT_BASELINE_LENGTH ((size_t)PORT4_samplesPerFrame) // firmware before the config log, otherwise PORT4_LENGTH
+#define CONFIG_ACK_LENGTH 2                  // config hash and status appended to a port 1 or 5 uplink after a port 11 batch
+#define CONFIG_ACK_REJECTED 0x80             // status bit 7 - batch not applied, bits 0-6 are the index of the bad entry
+
+extern const char *const measurementFieldNames[MEASUREMENT_FIELD_COUNT];
+
+// a field of payloadSchema.h - decoded value = code * scale
+struct SchemaField {
+  const char *name;
+  SchemaType type;
+  uint8_t offset;
+  float scale;
+};
+
+// fields of a port in uplink order, NULL for ports without a fixed layout
+const SchemaField *uplinkSchema(unsigned port, size_t &count);
+
+// decode one field, false if the uplink is too short for it or it is not available (I16N 0x8000)
+bool decodeSchemaField(const SchemaField &field, const uint8_t *data, size_t length, float &value, bool keepSaturated = false);
+
+// decode one sflt16 code and multiply by scale; saturation codes become +/-infinity unless keepSaturated
+float sflt16ToFloat(uint16_t code, float scale, bool keepSaturated = false);
+
+// decode n codes at once - same results as sflt16ToFloat(), vectorized where the CPU allows
+void sflt16DecodeBatch(const uint16_t *codes, float *out, size_t n, float scale, bool keepSaturated = false);
+
+// one vector per payload field, one entry per frame
+struct MeasurementColumns {
+  std::vector<float> field[MEASUREMENT_FIELD_COUNT];   // order of measurementFieldNames
+  size_t frames() const { return field[0].size(); }
+};
+
+// decode count port 1 frames laid out stride bytes apart (stride >= MEASUREMENT_FRAME_LENGTH)
+void decodeMeasurementFrames(const uint8_t *frames, size_t count, size_t stride, MeasurementColumns &out,
+                             bool keepSaturated = false);
+
+struct SettingsReport {
+  uint16_t sendIntervalMinutes;
+  uint8_t spsCleanIntervalDays;
+  uint8_t spsStabilizationPreReadoutDelay;
+  uint8_t spsStopAfterReadout;
+  uint8_t realTimeResyncIntervalDays;
+  uint8_t overrideTimeSynchronization;
+  uint8_t allowDeepSleep;
+  uint32_t timestamp;   // station local time, Unix epoch
+  bool full;                 // false for the 12 byte report of firmware before the config log - the fields below are 0
+  uint8_t samplesPerFrame;
+  bool watchdogCalibrated;   // false before the first measurement
+  float watchdogDeviationPercent;   // measured watchdog period against nominal, + = slow
+  bool rtcDriftMeasured;     // false before the second time sync or without RTC
+  float rtcDriftPpm;         // RTC drift between the last two time syncs, + = fast
+  uint8_t resyncIntervalDays;   // resync interval in use
+  int8_t rtcAgingOffset;     // DS3231 aging offset
+  uint8_t configHash;        // CRC-8 of the settings as the station holds them, see settingsHash()
+  uint8_t deltaHeartbeatSlots;   // 0 = every reading is sent
+  uint8_t deltaThresholds[6];    // temp, hum, mc_1p0, mc_2p5, mc_4p0, mc_10p0 - 0.1 units, 0x80 | n = n %, 0 = not watched
+  uint16_t slotOffsetSeconds;    // setting, 0xFFFF = hashed from the DevEUI
+  uint16_t slotOffsetInUse;      // seconds the uplinks wait after the slot
+  uint8_t linkAdr[6];            // setting as in the port 16 downlink - link check interval, min and max data rate, min and max TX power dBm, margin target dB
+  uint8_t dataRateInUse;         // 0 = SF12 - 5 = SF7
+  uint8_t txPowerInUse;          // dBm
+  uint8_t linkMarginDb;          // of the last LinkCheckAns, 0xFF = none yet
+};
+
+struct ConfigAck {
+  bool present;
+  uint8_t configHash;   // settingsHash() of the station settings after the batch
+  uint8_t status;       // settings applied, or CONFIG_ACK_REJECTED | index of the bad entry
+};
+
+// CRC-8 the station sends in config acks and reports - compare with the hash of the settings sent in a batch
+uint8_t settingsHash(const SettingsReport &settings);
+
+// config ack at the end of a port 1 or port 5 uplink; length is reduced to the data in front of it
+ConfigAck configAck(unsigned port, const uint8_t *data, size_t &length);
+
+// wake error of the sleep before a port 1 reading in ms (byte 24, 10 ms steps, +-1270 = or more), + = late
+int wakeErrorMillis(const uint8_t *data, size_t length);
+
+// decode a port 4 report, false if it has the length of neither layout
+bool decodeSettingsReport(const uint8_t *data, size_t length, SettingsReport &out);
+
+// port 7 - running totals since the station started counting at sinceEpoch, sent at timestamp (station local time)
+struct Diagnostics {
+  uint32_t timestamp;
+  uint32_t sinceEpoch;
+  uint32_t powerDownSeconds;   // MCU in power-down
+  uint32_t idleSeconds;        // CPU idle, Timer0 running - includes the sensor waits
+  uint32_t spsFanSeconds;      // SPS30 measuring
+  uint32_t spsWaitSeconds;     // readouts waiting for SPS30 data ready
+  uint32_t radioSeconds;       // in SendData() and Join() - airtime, receive windows and the waits between
+  uint32_t txSeconds;          // uplink airtime
+  uint16_t uplinks;
+  uint16_t joinRequests;
+  uint16_t timeSyncFailures;
+  uint16_t spsTimeouts;
+  uint16_t powerOns;
+  uint32_t joinSeconds;        // the last join took this long since power-on, 0 = none since power-on
+};
+
+// supply current of the whole station per state in mA - the defaults of the host-native simulation
+struct StationCurrents {
+  float sleep = 0.3f;    // power-down incl. regulator and RFM95 sleep
+  float idle = 6.0f;     // CPU clock stopped
+  float active = 11.0f;  // CPU running, radio idle - also the receive windows and the waits between
+  float tx = 44.0f;      // RFM95 at +14 dBm
+  float spsFan = 60.0f;  // SPS30 in measurement mode, on top of the MCU
+};
+
+// estimated charge per day by state over the span between two diagnostics of one count (or since counting started)
+struct DiagnosticsEnergy {
+  double days;
+  double sleep, idle, active, tx, spsFan, total;   // mAh per day
+};
+
+// decode a port 7 uplink, false if it is too short
+bool decodeDiagnostics(const uint8_t *data, size_t length, Diagnostics &out);
+
+// charge per day from the totals - since previous if it is an earlier report of the same count, else since counting
+// started; the time no total covers is taken as active. days is 0 if the span is empty.
+DiagnosticsEnergy diagnosticsEnergy(const Diagnostics &report, const Diagnostics *previous, const StationCurrents &currents);
+
+// unpack a port 5 multi-sample frame into port 1 data - appends MEASUREMENT_FRAME_LENGTH bytes per reading
+// to readings, oldest first; false if the frame is malformed (readings is left unchanged then)
+bool decodeMultiSampleFrame(const uint8_t *data, size_t length, std::vector<uint8_t> &readings, uint16_t &intervalMinutes);
+
+// one uplink per text line: "<port> <hex>", "<port>,<hex>" or "<hex>" (port is defaultPort then) - false on malformed hex
+bool parseFrameLine(const char *line, unsigned defaultPort, unsigned &port, std::vector<uint8_t> &bytes);
+
+#endif
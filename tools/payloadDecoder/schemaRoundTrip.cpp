@@ -0,0 +1,182 @@
+// Round trip of the uplink layouts of payloadSchema.h - encodes random fields with the encoders the firmware uses and
+// checks that the decoder gives them back
+//
+//   schemaRoundTrip [READINGS]
+//
+// Port 1 readings (a random walk, so port 5 sees realistic deltas) through decodeSchemaField() and the batch decoder,
+// port 5 frames of them with every MULTI_SAMPLE_DROP_BITS, port 4 settings reports in both lengths and port 7
+// diagnostics. Prints the failures and returns 1 if there are any.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "payloadDecoder.h"
+#include "multiSample.h"
+
+#define MAX_FRAME_LENGTH 222   // largest LoRaWAN application payload
+
+static size_t checks = 0, failures = 0;
+
+static void check(bool ok, unsigned port, size_t index, const char *what) {
+  checks++;
+  if (!ok && failures++ < 20) printf("port %u #%zu: %s\n", port, index, what);
+}
+
+static uint32_t random32() {
+  return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+// readings in thousandths, -20 .. 99 in field units - the encoder saturates at 100
+static void port1(size_t count, std::vector<uint8_t> &readings) {
+  int32_t values[MEASUREMENT_FIELD_COUNT];
+  for (size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++) values[f] = (int32_t)(random32() % 119000) - 20000;
+  size_t fieldCount;
+  const SchemaField *schema = uplinkSchema(1, fieldCount);
+  MeasurementColumns expected;
+  for (size_t i = 0; i < count; i++) {
+    Port1Fields fields;
+    int32_t *member[] = {
+#define FIELD_POINTER(name, type, scale) &fields.name,
+        MEASUREMENT_FIELDS(FIELD_POINTER)
+#undef FIELD_POINTER
+    };
+    for (size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++) {
+      values[f] += (int32_t)(random32() % 2001) - 1000;
+      if (values[f] < -20000) values[f] = -20000;
+      if (values[f] > 99000) values[f] = 99000;
+      *member[f] = random32() % 50 == 0 ? SFLT16_NONE : values[f];   // a failed sensor now and then
+    }
+    fields.wake_error_ms = (int8_t)(random32() % 255 - 127);
+    uint8_t data[PORT1_LENGTH];
+    encodePort1(fields, data);
+    readings.insert(readings.end(), data, data + MEASUREMENT_FRAME_LENGTH);
+
+    check(fieldCount == MEASUREMENT_FIELD_COUNT + 1, 1, i, "field count");
+    for (size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++) {
+      float value, exact = *member[f] == SFLT16_NONE ? 0.0f : *member[f] / 1000.0f;
+      bool decoded = decodeSchemaField(schema[f], data, sizeof(data), value);
+      // half a mantissa step - below 2^-16 of the scale the exponent is at 0 and the encoder keeps the mantissa
+      // normalized, as the LMIC encoder did, so values under 0.0015 decode up to twice too large
+      check(decoded && fabsf(value - exact) <= fabsf(exact) / 2048 + 100 * ldexpf(1, -16), 1, i, schema[f].name);
+      expected.field[f].push_back(value);
+    }
+    float wakeError;
+    check(decodeSchemaField(schema[MEASUREMENT_FIELD_COUNT], data, sizeof(data), wakeError) &&
+          wakeError == fields.wake_error_ms * 10.0f && wakeErrorMillis(data, sizeof(data)) == fields.wake_error_ms * 10,
+          1, i, "wake_error_ms");
+    check(!decodeSchemaField(schema[MEASUREMENT_FIELD_COUNT], data, sizeof(data) - 1, wakeError), 1, i,
+          "wake_error_ms decoded from a short uplink");
+  }
+
+  MeasurementColumns batch;
+  decodeMeasurementFrames(readings.data(), count, MEASUREMENT_FRAME_LENGTH, batch);
+  for (size_t f = 0; f < MEASUREMENT_FIELD_COUNT; f++)
+    check(batch.field[f].size() == count && !memcmp(batch.field[f].data(), expected.field[f].data(), count * sizeof(float)),
+          1, f, "batch decoder differs from decodeSchemaField()");
+}
+
+// frames packed like sendReading() does, the keyframe exact and the later readings reduced by dropBits
+static void port5(const std::vector<uint8_t> &readings) {
+  size_t count = readings.size() / MEASUREMENT_FRAME_LENGTH, frames = 0;
+  for (uint8_t dropBits = 0; dropBits <= MULTI_SAMPLE_MAX_DROP_BITS; dropBits++) {
+    for (size_t first = 0; first < count;) {
+      uint8_t frame[MAX_FRAME_LENGTH];
+      uint8_t previous[MULTI_SAMPLE_KEYFRAME_LENGTH];
+      uint16_t interval = (uint16_t)(1 + random32() % 1440);
+      const uint8_t *data = &readings[first * MEASUREMENT_FRAME_LENGTH];
+      uint8_t length = multiSampleStart(frame, interval, dropBits, data);
+      memcpy(previous, data, MULTI_SAMPLE_KEYFRAME_LENGTH);
+      std::vector<uint8_t> expected(data, data + MEASUREMENT_FRAME_LENGTH);
+      size_t n = 1;
+      for (; first + n < count && n < 15; n++) {
+        data = &readings[(first + n) * MEASUREMENT_FRAME_LENGTH];
+        if (length + multiSampleDeltaLength(frame, previous, data) > MAX_FRAME_LENGTH) break;
+        length = multiSampleAppend(frame, length, previous, data);
+        expected.insert(expected.end(), data, data + MEASUREMENT_FRAME_LENGTH);
+        uint8_t *reduced = &expected[expected.size() - MEASUREMENT_FRAME_LENGTH];
+        for (uint8_t f = 0; f < MULTI_SAMPLE_FIELDS; f++)
+          multiSampleSetCode(reduced, f, multiSampleExpand(multiSampleReduce(multiSampleCode(reduced, f), dropBits), dropBits));
+      }
+      std::vector<uint8_t> decoded;
+      uint16_t decodedInterval = 0;
+      check(multiSampleCount(frame) == n && decodeMultiSampleFrame(frame, length, decoded, decodedInterval) &&
+            decoded == expected && decodedInterval == interval, 5, frames, "frame does not decode to its readings");
+      first += n;
+      frames++;
+    }
+  }
+}
+
+static void port4(size_t index) {
+  Port4Fields fields;
+  uint8_t *bytes = (uint8_t *)&fields;
+  for (size_t i = 0; i < sizeof(fields); i++) bytes[i] = (uint8_t)random32();
+  if (index % 4 == 0) fields.watchdogDeviationPercent = (int16_t)0x8000;   // not calibrated yet
+  if (index % 4 == 1) fields.rtcDriftPpm = (int16_t)0x8000;                // not measured yet
+  uint8_t data[PORT4_LENGTH];
+  encodePort4(fields, data);
+
+  SettingsReport report;
+  check(decodeSettingsReport(data, sizeof(data), report) && report.full, 4, index, "full report not decoded");
+  check(report.sendIntervalMinutes == fields.sendIntervalMinutes && report.spsCleanIntervalDays == fields.spsCleanIntervalDays &&
+        report.spsStabilizationPreReadoutDelay == fields.spsStabilizationPreReadoutDelay &&
+        report.spsStopAfterReadout == fields.spsStopAfterReadout &&
+        report.realTimeResyncIntervalDays == fields.realTimeResyncIntervalDays &&
+        report.overrideTimeSynchronization == fields.overrideTimeSynchronization &&
+        report.allowDeepSleep == fields.allowDeepSleep && report.timestamp == fields.timestamp, 4, index, "baseline fields");
+  check(report.samplesPerFrame == fields.samplesPerFrame && report.resyncIntervalDays == fields.resyncIntervalDays &&
+        report.rtcAgingOffset == fields.rtcAgingOffset && report.configHash == fields.configHash, 4, index, "clock fields");
+  check(report.watchdogCalibrated == (fields.watchdogDeviationPercent != (int16_t)0x8000) &&
+        report.watchdogDeviationPercent == (report.watchdogCalibrated ? fields.watchdogDeviationPercent * 0.001f : 0.0f) &&
+        report.rtcDriftMeasured == (fields.rtcDriftPpm != (int16_t)0x8000) &&
+        report.rtcDriftPpm == (report.rtcDriftMeasured ? fields.rtcDriftPpm * 0.01f : 0.0f), 4, index, "not available codes");
+  const uint8_t thresholds[6] = {fields.deltaThresholdTemp, fields.deltaThresholdHum, fields.deltaThresholdMc1p0,
+                                 fields.deltaThresholdMc2p5, fields.deltaThresholdMc4p0, fields.deltaThresholdMc10p0};
+  const uint8_t linkAdr[6] = {fields.linkCheckInterval, fields.linkMinDataRate, fields.linkMaxDataRate,
+                              fields.linkMinPowerDbm, fields.linkMaxPowerDbm, fields.linkMarginTargetDb};
+  check(report.deltaHeartbeatSlots == fields.deltaHeartbeatSlots && !memcmp(report.deltaThresholds, thresholds, 6) &&
+        report.slotOffsetSeconds == fields.slotOffsetSeconds && report.slotOffsetInUse == fields.slotOffsetInUse,
+        4, index, "send on delta and slot offset");
+  check(!memcmp(report.linkAdr, linkAdr, 6) && report.dataRateInUse == fields.dataRateInUse &&
+        report.txPowerInUse == fields.txPowerInUse && report.linkMarginDb == fields.linkMarginDb, 4, index, "link");
+
+  SettingsReport baseline;
+  check(decodeSettingsReport(data, SETTINGS_REPORT_BASELINE_LENGTH, baseline) && !baseline.full &&
+        baseline.timestamp == fields.timestamp && baseline.allowDeepSleep == fields.allowDeepSleep &&
+        baseline.samplesPerFrame == 0 && baseline.linkMarginDb == 0, 4, index, "baseline report");
+  check(!decodeSettingsReport(data, PORT4_LENGTH - 1, baseline) &&
+        !decodeSettingsReport(data, SETTINGS_REPORT_BASELINE_LENGTH + 1, baseline), 4, index, "length of neither layout");
+}
+
+static void port7(size_t index) {
+  Port7Fields fields;
+  uint8_t *bytes = (uint8_t *)&fields;
+  for (size_t i = 0; i < sizeof(fields); i++) bytes[i] = (uint8_t)random32();
+  uint8_t data[PORT7_LENGTH];
+  encodePort7(fields, data);
+  Diagnostics report;
+  check(decodeDiagnostics(data, sizeof(data), report), 7, index, "not decoded");
+  check(report.timestamp == fields.timestamp && report.sinceEpoch == fields.sinceEpoch &&
+        report.powerDownSeconds == fields.powerDownSeconds && report.idleSeconds == fields.idleSeconds &&
+        report.spsFanSeconds == fields.spsFanSeconds && report.spsWaitSeconds == fields.spsWaitSeconds &&
+        report.radioSeconds == fields.radioSeconds && report.txSeconds == fields.txSeconds, 7, index, "totals");
+  check(report.uplinks == fields.uplinks && report.joinRequests == fields.joinRequests &&
+        report.timeSyncFailures == fields.timeSyncFailures && report.spsTimeouts == fields.spsTimeouts &&
+        report.powerOns == fields.powerOns && report.joinSeconds == fields.joinSeconds, 7, index, "counts");
+  check(!decodeDiagnostics(data, sizeof(data) - 1, report), 7, index, "short uplink decoded");
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? strtoull(argv[1], NULL, 0) : 5000;
+  srand(1);
+  std::vector<uint8_t> readings;
+  port1(count, readings);
+  port5(readings);
+  for (size_t i = 0; i < count / 10; i++) {
+    port4(i);
+    port7(i);
+  }
+  printf("%zu readings, %zu settings reports and diagnostics: %zu checks, %zu failures\n", count, count / 10, checks, failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+// Fleet collision simulation of the slot offset (SLOT_OFFSET_WINDOW_SECONDS, downlink port 14)
+//
+//   slotCollisionSim [--window SECONDS] [--data-rate DR] [--channels N] [--clock-error MS] [--slots N] [--seed N]
+//
+// Every station of a fleet with sequential DevEUIs measures at the same slot and sends a 25 byte port 1 uplink
+// on a random one of --channels channels. The clocks are off by up to --clock-error ms either way, the resync
+// limit RTC_SYNC_MAX_ERROR_MILLIS. Uplinks that overlap in time on one channel are all lost - pure ALOHA, no
+// capture effect, so the numbers are on the safe side. Prints the packet loss per fleet size with every station
+// sending at the slot, at the offset the firmware hashes from the DevEUI (slotOffset.h), and at offsets spread
+// evenly over the window by downlink, next to the loss pure ALOHA gives for random offsets in the window.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "airtime.h"
+#include "slotOffset.h"
+
+#define PORT1_PAYLOAD_LENGTH 25
+
+struct Uplink {
+  double start;   // seconds after the slot
+  int channel;
+};
+
+// uplinks of one slot that overlap another one on their channel
+static size_t lostUplinks(std::vector<Uplink> &uplinks, double airtime) {
+  std::sort(uplinks.begin(), uplinks.end(), [](const Uplink &a, const Uplink &b) {
+    return a.channel != b.channel ? a.channel < b.channel : a.start < b.start;
+  });
+  size_t lost = 0;
+  for (size_t i = 0; i < uplinks.size(); i++) {
+    bool overlap = (i > 0 && uplinks[i - 1].channel == uplinks[i].channel && uplinks[i].start - uplinks[i - 1].start < airtime) ||
+                   (i + 1 < uplinks.size() && uplinks[i + 1].channel == uplinks[i].channel && uplinks[i + 1].start - uplinks[i].start < airtime);
+    if (overlap) lost++;
+  }
+  return lost;
+}
+
+int main(int argc, char **argv) {
+  unsigned window = 300, dataRate = 2, channels = 8, slots = 1000, seed = 1;
+  double clockErrorMs = 250;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 < argc && !strcmp(argv[i], "--window")) window = (unsigned)atoi(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "--data-rate")) dataRate = (unsigned)atoi(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "--channels")) channels = (unsigned)atoi(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "--clock-error")) clockErrorMs = atof(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "--slots")) slots = (unsigned)atoi(argv[++i]);
+    else if (i + 1 < argc && !strcmp(argv[i], "--seed")) seed = (unsigned)atoi(argv[++i]);
+    else {
+      fprintf(stderr, "usage: %s [--window SECONDS] [--data-rate DR] [--channels N] [--clock-error MS] [--slots N] [--seed N]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (window == 0 || window > 0xFFFE || dataRate > 6 || channels == 0 || slots == 0) {
+    fprintf(stderr, "window 1-65534 s, data rate 0-6, at least one channel and slot\n");
+    return 2;
+  }
+  const double airtime = uplinkAirtimeMicros((uint8_t)dataRate, PORT1_PAYLOAD_LENGTH) / 1e6;
+  printf("# SF%u, %u channels, %.1f ms airtime, clock error +-%.0f ms, %u s window, %u slots\n",
+         dataRateSpreadingFactor((uint8_t)dataRate), channels, airtime * 1000.0, clockErrorMs, window, slots);
+  printf("stations,loss_at_slot,loss_hashed_offset,loss_assigned_offset,loss_aloha\n");
+
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<double> clockError(-clockErrorMs / 1000.0, clockErrorMs / 1000.0);
+  std::uniform_int_distribution<int> channel(0, (int)channels - 1);
+  const unsigned fleetSizes[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
+  for (unsigned stations : fleetSizes) {
+    std::vector<uint16_t> hashed(stations), assigned(stations);
+    for (unsigned s = 0; s < stations; s++) {
+      uint8_t devEUI[8] = {0x70, 0xB3, 0xD5, 0x7E, 0xD0, 0x00, (uint8_t)(s >> 8), (uint8_t)s};
+      hashed[s] = slotOffsetFromDevEUI(devEUI, (uint16_t)window);
+      assigned[s] = (uint16_t)((uint32_t)s * window / stations);
+    }
+    size_t lost[3] = {0, 0, 0};
+    std::vector<Uplink> uplinks[3];
+    for (unsigned slot = 0; slot < slots; slot++) {
+      for (auto &u : uplinks) u.clear();
+      for (unsigned s = 0; s < stations; s++) {
+        double error = clockError(random);   // the same clock and channel for all three ways
+        int ch = channel(random);
+        uplinks[0].push_back({error, ch});
+        uplinks[1].push_back({hashed[s] + error, ch});
+        uplinks[2].push_back({assigned[s] + error, ch});
+      }
+      for (int way = 0; way < 3; way++) lost[way] += lostUplinks(uplinks[way], airtime);
+    }
+    const double sent = (double)stations * slots;
+    const double aloha = 1.0 - exp(-2.0 * (stations - 1) * airtime / ((double)window * channels));
+    printf("%u,%.4f,%.4f,%.4f,%.4f\n", stations, lost[0] / sent, lost[1] / sent, lost[2] / sent, aloha);
+  }
+  return 0;
+}
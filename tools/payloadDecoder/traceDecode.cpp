@@ -0,0 +1,146 @@
+// Decoder for the station's binary trace (stationFirmware/src/trace.h)
+//
+//   traceDecode [--dictionary] [FILE]
+//
+// Reads serial captures ("TRACE <hex>" lines, other output is skipped) and uplink logs ("8 <hex>", the port 8 trace
+// dumps requested by downlink 1 on port 12) and prints one CSV line per record: dump number, event and the message.
+// --dictionary prints the event table (id, name, format) instead.
+#include <ctype.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "payloadDecoder.h"
+#include "trace.h"
+
+static const unsigned TRACE_PORT = 8;
+
+struct TraceFormat {
+  const char *name;
+  const char *format;
+};
+#define TRACE_DICTIONARY(name, format) {#name, format},
+static const TraceFormat dictionary[] = {TRACE_EVENTS(TRACE_DICTIONARY)};
+
+// zig-zag LEB128 varint at data[pos] - false if the dump ends inside it
+static bool readVarint(const std::vector<uint8_t> &data, size_t &pos, int32_t &value) {
+  uint32_t zigZag = 0;
+  for (unsigned shift = 0; pos < data.size() && shift < 35; shift += 7) {
+    uint8_t b = data[pos++];
+    zigZag |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      value = (int32_t)((zigZag >> 1) ^ (0u - (zigZag & 1)));
+      return true;
+    }
+  }
+  return false;
+}
+
+// the format with %d, %u and %x replaced by the arguments in order
+static std::string formatMessage(const char *format, const int32_t *args, unsigned count) {
+  std::string out;
+  unsigned next = 0;
+  for (const char *p = format; *p; p++) {
+    if (*p != '%' || !p[1]) {
+      out += *p;
+      continue;
+    }
+    char buffer[16];
+    char conversion = *++p;
+    if (conversion == '%') {
+      out += '%';
+      continue;
+    }
+    if (next >= count) {
+      out += "?";
+      continue;
+    }
+    int32_t value = args[next++];
+    if (conversion == 'u') snprintf(buffer, sizeof(buffer), "%lu", (unsigned long)(uint32_t)value);
+    else if (conversion == 'x') snprintf(buffer, sizeof(buffer), "%lx", (unsigned long)(uint32_t)value);
+    else snprintf(buffer, sizeof(buffer), "%ld", (long)value);
+    out += buffer;
+  }
+  return out;
+}
+
+// message text as a CSV field
+static void printField(const std::string &text) {
+  putchar('"');
+  for (char c : text) {
+    if (c == '"') putchar('"');
+    putchar(c);
+  }
+  putchar('"');
+}
+
+int main(int argc, char **argv) {
+  const char *path = NULL;
+  bool printDictionary = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--dictionary")) printDictionary = true;
+    else if (argv[i][0] != '-' && !path) path = argv[i];
+    else {
+      fprintf(stderr, "usage: %s [--dictionary] [FILE]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (printDictionary) {
+    printf("id,name,format\n");
+    for (unsigned i = 0; i < TRACE_EVENT_COUNT; i++) {
+      printf("%u,%s,", i, dictionary[i].name);
+      printField(dictionary[i].format);
+      putchar('\n');
+    }
+    return 0;
+  }
+  FILE *in = path ? fopen(path, "r") : stdin;
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+
+  printf("dump,event,message\n");
+  std::vector<uint8_t> bytes;
+  size_t dumps = 0, records = 0, dropped = 0, truncated = 0;
+  char line[1024];
+  while (fgets(line, sizeof(line), in)) {
+    const char *frame = line;
+    unsigned port;
+    if (!strncmp(line, "TRACE ", 6)) frame = line + 6;
+    else if (!isdigit((unsigned char)line[0])) continue;   // other serial output
+    if (!parseFrameLine(frame, TRACE_PORT, port, bytes) || port != TRACE_PORT || bytes.empty()) continue;
+    dumps++;
+    if (bytes[0]) {
+      dropped += bytes[0];
+      printf("%zu,DROPPED,", dumps);
+      printField(std::to_string(bytes[0]) + (bytes[0] == 255 ? " or more" : "") + " records overwritten before this dump");
+      putchar('\n');
+    }
+    size_t pos = 1;
+    while (pos < bytes.size()) {
+      uint8_t header = bytes[pos++];
+      unsigned event = header & 0x3F, count = header >> 6;
+      int32_t args[3] = {0, 0, 0};
+      bool complete = true;
+      for (unsigned i = 0; i < count && complete; i++) complete = readVarint(bytes, pos, args[i]);
+      if (!complete) {
+        truncated++;
+        break;
+      }
+      records++;
+      if (event < TRACE_EVENT_COUNT) {
+        printf("%zu,%s,", dumps, dictionary[event].name);
+        printField(formatMessage(dictionary[event].format, args, count));
+      } else {
+        printf("%zu,%u,", dumps, event);
+        printField("event unknown to this decoder - newer firmware?");
+      }
+      putchar('\n');
+    }
+  }
+  if (path) fclose(in);
+  fprintf(stderr, "%zu dumps, %zu records, %zu overwritten, %zu truncated\n", dumps, records, dropped, truncated);
+  return 0;
+}
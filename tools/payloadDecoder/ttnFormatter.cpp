@@ -0,0 +1,59 @@
+// Generates the TTN uplink payload formatter (JavaScript) from the layouts in payloadSchema.h
+//
+//   ttnFormatter > ttnFormatter.js
+//
+// The build runs it into the build directory; paste the output into the TTN console as custom JavaScript formatter.
+// Ports 1, 2, 4, 6 and 7 are decoded, fields missing at the end of an uplink from older firmware are left out, saturated
+// sflt16 values and unavailable fields decode to null.
+#include <stdio.h>
+#include "payloadDecoder.h"
+
+static const char *const typeNames[] = {"SFLT16", "U8", "I8", "U16", "I16N", "U32"};
+
+int main() {
+  printf("// TTN uplink payload formatter for the station - generated by ttnFormatter from payloadSchema.h, do not edit\n"
+         "var SCHEMA = {\n");
+  const unsigned ports[] = {1, 2, 4, 6, 7};
+  for (unsigned p = 0; p < sizeof(ports) / sizeof(ports[0]); p++) {
+    size_t count;
+    const SchemaField *fields = uplinkSchema(ports[p], count);
+    printf("  %u: [\n", ports[p]);
+    for (size_t i = 0; i < count; i++)
+      printf("    [\"%s\", \"%s\", %u, %g]%s\n", fields[i].name, typeNames[fields[i].type], fields[i].offset,
+             fields[i].scale, i + 1 < count ? "," : "");
+    printf("  ]%s\n", p + 1 < sizeof(ports) / sizeof(ports[0]) ? "," : "");
+  }
+  printf("};\n"
+         "var SIZE = { SFLT16: 2, U8: 1, I8: 1, U16: 2, I16N: 2, U32: 4 };\n"
+         "\n"
+         "function decodeUplink(input) {\n"
+         "  var fields = SCHEMA[input.fPort];\n"
+         "  if (!fields) return { data: {}, warnings: [\"no fixed layout for fport \" + input.fPort] };\n"
+         "  var bytes = input.bytes, data = {}, warnings = [];\n"
+         "  for (var i = 0; i < fields.length; i++) {\n"
+         "    var name = fields[i][0], type = fields[i][1], offset = fields[i][2], scale = fields[i][3];\n"
+         "    if (bytes.length < offset + SIZE[type]) break; // appended by a later firmware\n"
+         "    var code = 0;\n"
+         "    for (var b = SIZE[type] - 1; b >= 0; b--) code = code * 256 + bytes[offset + b]; // little-endian\n"
+         "    var value;\n"
+         "    if (type === \"SFLT16\") {\n"
+         "      if (code === 0x7FFF || code === 0xFFFF) {\n"
+         "        warnings.push(name + \" saturated\");\n"
+         "        value = null;\n"
+         "      } else {\n"
+         "        value = (code & 0x7FF) * Math.pow(2, ((code >> 11) & 0x0F) - 15 - 11) * scale;\n"
+         "        if (code & 0x8000) value = -value;\n"
+         "      }\n"
+         "    } else if (type === \"I8\") {\n"
+         "      value = (code >= 0x80 ? code - 0x100 : code) * scale;\n"
+         "    } else if (type === \"I16N\") {\n"
+         "      value = code === 0x8000 ? null : (code >= 0x8000 ? code - 0x10000 : code) * scale;\n"
+         "    } else {\n"
+         "      value = code * scale;\n"
+         "    }\n"
+         "    data[name] = value;\n"
+         "  }\n"
+         "  return { data: data, warnings: warnings };\n"
+         "}\n");
+  return 0;
+}
@@ -0,0 +1,160 @@
+// Exhaustive equivalence check and benchmark of the firmware's integer f2sflt16() against the
+// former frexpf()/ldexpf() encoder, and of the fixed point sflt16FromRatio() against exact rounding.
+//
+//   g++ -O2 -I../../stationFirmware/src sflt16Check.cpp -o sflt16Check
+//   ./sflt16Check            every one of the 2^32 float bit patterns
+//   ./sflt16Check 4099       every 4099th bit pattern only (quick run)
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+#include "sflt16.h"
+
+// the encoder as it was in main.cpp before the integer rewrite
+static uint16_t f2sflt16Reference(float f) {
+  if (f <= -1.0f)
+    return 0xFFFF;
+  else if (f >= 1.0f)
+    return 0x7FFF;
+  else {
+    int iExp;
+    float normalValue;
+    uint16_t sign = 0;
+    normalValue = frexpf(f, &iExp);
+    if (normalValue < 0) {
+      sign = 0x8000;
+      normalValue = -normalValue;
+    }
+    iExp += 15;
+    if (iExp < 0) iExp = 0;
+    uint16_t outputFraction = (uint16_t)(ldexpf(normalValue, 11) + 0.5f);
+    if (outputFraction >= (1 << 11)) {
+      outputFraction = 1 << 10;
+      iExp++;
+    }
+    if (iExp > 15)
+      return 0x7FFF | sign;
+    return (uint16_t)(sign | (iExp << 11) | outputFraction);
+  }
+}
+
+// the encoder on the exact quotient - long double holds n / d closely enough that only true ties round up
+static uint16_t ratioReference(int32_t n, uint32_t d) {
+  long double v = (long double)n / d;
+  if (v <= -1.0L) return 0xFFFF;
+  if (v >= 1.0L) return 0x7FFF;
+  if (v == 0.0L) return 0x7800;
+  int iExp;
+  long double normalValue = frexpl(v, &iExp);
+  uint16_t sign = 0;
+  if (normalValue < 0) {
+    sign = 0x8000;
+    normalValue = -normalValue;
+  }
+  iExp += 15;
+  if (iExp < 0) iExp = 0;
+  uint16_t outputFraction = (uint16_t)floorl(ldexpl(normalValue, 11) + 0.5L);
+  if (outputFraction >= (1 << 11)) {
+    outputFraction = 1 << 10;
+    iExp++;
+  }
+  if (iExp > 15) return 0x7FFF | sign;
+  return (uint16_t)(sign | (iExp << 11) | outputFraction);
+}
+
+static float fromBits(uint32_t bits) {
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+template <typename Encoder>
+static void benchmark(const char *name, Encoder encode, const std::vector<float> &input) {
+  volatile uint16_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+#ifdef HAVE_RDTSC
+  uint64_t cyclesStart = __rdtsc();
+#endif
+  for (int round = 0; round < 20; round++)
+    for (float f : input) sink = sink ^ encode(f);
+#ifdef HAVE_RDTSC
+  uint64_t cycles = __rdtsc() - cyclesStart;
+#endif
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  double calls = 20.0 * input.size();
+#ifdef HAVE_RDTSC
+  printf("  %-10s %6.2f ns/call  %6.1f TSC cycles/call\n", name, ns / calls, cycles / calls);
+#else
+  printf("  %-10s %6.2f ns/call\n", name, ns / calls);
+#endif
+}
+
+int main(int argc, char **argv) {
+  uint64_t stride = argc > 1 ? strtoull(argv[1], NULL, 0) : 1;
+  if (stride == 0) stride = 1;
+
+  uint64_t checked = 0, mismatches = 0, nanMismatches = 0;
+  for (uint64_t bits = 0; bits <= 0xFFFFFFFFULL; bits += stride) {
+    float f = fromBits((uint32_t)bits);
+    uint16_t expected = f2sflt16Reference(f);
+    uint16_t actual = f2sflt16(f);
+    checked++;
+    if (expected == actual) continue;
+    if (std::isnan(f)) {
+      nanMismatches++;   // the float path converts NaN to an integer, which is undefined behaviour
+      continue;
+    }
+    if (mismatches++ < 10)
+      printf("mismatch: bits 0x%08llX (%g) reference 0x%04X integer 0x%04X\n", (unsigned long long)bits, f, expected,
+             actual);
+  }
+  printf("checked %llu bit patterns: %llu mismatches, %llu NaN mismatches\n", (unsigned long long)checked,
+         (unsigned long long)mismatches, (unsigned long long)nanMismatches);
+
+  // fixed point readings in thousandths against the scale of the payload fields (100), and the float path the
+  // firmware took before - that one rounds the quotient to a float first, so it may differ by one code
+  const uint32_t d = 100 * 1000;
+  uint64_t ratioChecked = 0, ratioMismatches = 0, floatDifferences = 0;
+  for (int64_t n = -(int64_t)d - 2; n <= (int64_t)d + 2; n++) {
+    uint16_t expected = ratioReference((int32_t)n, d);
+    uint16_t actual = sflt16FromRatio((int32_t)n, d);
+    ratioChecked++;
+    if (f2sflt16((float)n / 1000.0f / 100.0f) != actual) floatDifferences++;
+    if (expected != actual && ratioMismatches++ < 10)
+      printf("ratio mismatch: %lld / %u reference 0x%04X integer 0x%04X\n", (long long)n, d, expected, actual);
+  }
+  for (uint64_t bits = 0; bits <= 0xFFFFFFFFULL; bits += stride * 7919) {
+    int32_t n = (int32_t)(uint32_t)bits;
+    uint32_t divisor = (uint32_t)(bits * 2654435761ULL % 0x7FFFFFFFULL) + 1;
+    uint16_t expected = ratioReference(n, divisor);
+    uint16_t actual = sflt16FromRatio(n, divisor);
+    ratioChecked++;
+    if (expected != actual && ratioMismatches++ < 10)
+      printf("ratio mismatch: %d / %u reference 0x%04X integer 0x%04X\n", n, divisor, expected, actual);
+  }
+  printf("checked %llu ratios: %llu mismatches, %llu differ from the float path by rounding\n",
+         (unsigned long long)ratioChecked, (unsigned long long)ratioMismatches, (unsigned long long)floatDifferences);
+
+  // typical payload inputs: sensor values scaled by 1/100 like saveToPayload() does
+  std::vector<float> input(1 << 16);
+  srand(1);
+  for (float &f : input) f = (rand() % 200000 - 20000) / 100.0f / 100.0f;
+  printf("benchmark, %zu payload values x 20:\n", input.size());
+  benchmark("reference", f2sflt16Reference, input);
+  benchmark("integer", [](float f) { return f2sflt16(f); }, input);
+  std::vector<int32_t> milli(input.size());
+  for (size_t i = 0; i < input.size(); i++) milli[i] = (int32_t)lroundf(input[i] * 100.0f * 1000.0f);
+  volatile uint16_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < 20; round++)
+    for (int32_t n : milli) sink = sink ^ sflt16FromRatio(n, d);
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("  %-10s %6.2f ns/call\n", "ratio", ns / (20.0 * milli.size()));
+  return mismatches || ratioMismatches ? 1 : 0;
+}